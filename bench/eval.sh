@@ -0,0 +1,45 @@
+#!/bin/sh
+# Time evaluation of a large synthetic Hammer file, without the graph cache.
+#   usage: bench/eval.sh [hammer] [sources]
+
+set -e
+
+ham=$(cd "$(dirname "${1:-./hammer}")" && pwd)/$(basename "${1:-./hammer}")
+cnt=${2:-20000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir"
+
+{
+	echo "cc = gcc;"
+	echo "flags = -O2 -Wall -Werror;"
+	echo "cfg = env { inc = -Iinc -Isrc; def = -DNDEBUG; }"
+
+	d=0
+	while [ $((d * 100)) -lt $cnt ]; do
+		echo "{"
+		echo "	name = d$d;"
+		printf "	srcs ="
+		i=0
+		while [ $i -lt 100 ]; do
+			printf " s/d%d/f%d.c" $d $i
+			i=$((i + 1))
+		done
+		echo ";"
+		echo "	objs = \${srcs.pat(s/%.c, o/%.o)};"
+		echo "	for src : \$srcs {"
+		echo "		obj = \${src.pat(s/%.c, o/%.o)};"
+		echo "		dep = \${obj.sub(.o, .d)};"
+		echo "		\$obj : \$src inc/\$name.h { \$cc \$flags \${cfg.inc} \${cfg.def} -c \$< -o \$@ -MF \$dep; }"
+		echo "	}"
+		echo "	lib/\$name.a : \$objs { ar rcs \$@ \$^; }"
+		echo "}"
+		d=$((d + 1))
+	done
+} > Hammer
+
+start=$(date +%s.%N)
+"$ham" .zzz > /dev/null
+end=$(date +%s.%N)
+awk "BEGIN { printf \"eval: %.3fs\\n\", $end - $start }"
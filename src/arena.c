@@ -0,0 +1,108 @@
+#include "inc.h"
+
+
+/**
+ * Chunk structure.
+ *   @len, max: The used and total length.
+ *   @next: The next chunk.
+ *   @data: The data.
+ */
+struct chunk_t {
+	size_t len, max;
+	struct chunk_t *next;
+
+	char data[];
+};
+
+/*
+ * arena definitions
+ */
+#define ARENA_CHUNK (64 * 1024)
+#define ARENA_ALIGN 8
+
+
+/**
+ * Create an arena.
+ *   &returns: The arena.
+ */
+struct arena_t *arena_new(void)
+{
+	struct arena_t *arena;
+
+	arena = malloc(sizeof(struct arena_t));
+	arena->chunk = NULL;
+
+	return arena;
+}
+
+/**
+ * Delete an arena, releasing all allocations.
+ *   @arena: The arena.
+ */
+void arena_delete(struct arena_t *arena)
+{
+	struct chunk_t *chunk;
+
+	while(arena->chunk != NULL) {
+		arena->chunk = (chunk = arena->chunk)->next;
+		free(chunk);
+	}
+
+	free(arena);
+}
+
+
+/**
+ * Allocate memory from an arena.
+ *   @arena: The arena.
+ *   @len: The length in bytes.
+ *   &returns: The memory, aligned to 8 bytes.
+ */
+void *arena_alloc(struct arena_t *arena, size_t len)
+{
+	void *ptr;
+	struct chunk_t *chunk;
+
+	len = (len + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	chunk = arena->chunk;
+	if((chunk == NULL) || ((chunk->len + len) > chunk->max)) {
+		size_t max = (len > ARENA_CHUNK) ? len : ARENA_CHUNK;
+
+		chunk = malloc(sizeof(struct chunk_t) + max);
+		chunk->len = 0;
+		chunk->max = max;
+
+		if((arena->chunk == NULL) || (len < ARENA_CHUNK)) {
+			chunk->next = arena->chunk;
+			arena->chunk = chunk;
+		}
+		else {
+			chunk->next = arena->chunk->next;
+			arena->chunk->next = chunk;
+		}
+	}
+
+	ptr = chunk->data + chunk->len;
+	chunk->len += len;
+
+	return ptr;
+}
+
+/**
+ * Duplicate a string into an arena.
+ *   @arena: The arena.
+ *   @str: The string.
+ *   @len: The string length.
+ *   &returns: The null-terminated copy.
+ */
+char *arena_strdup(struct arena_t *arena, const char *str, size_t len)
+{
+	char *dup;
+
+	dup = arena_alloc(arena, len + 1);
+	memcpy(dup, str, len);
+	dup[len] = '\0';
+
+	return dup;
+}
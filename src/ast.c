@@ -213,7 +213,10 @@ struct raw_t *raw_new(bool spec, bool var, char *str, struct loc_t loc)
 	raw->spec = spec;
 	raw->var = var;
 	raw->str = str;
+	raw->hash = raw_hash(str);
+	raw->lit = raw_lit(str);
 	raw->loc = loc;
+	raw->tpl = NULL;
 	raw->next = NULL;
 
 	return raw;
@@ -235,6 +238,9 @@ struct raw_t *raw_dup(const struct raw_t *raw)
  */
 void raw_delete(struct raw_t *raw)
 {
+	if(raw->tpl != NULL)
+		tpl_delete(raw->tpl);
+
 	free(raw->str);
 	free(raw);
 }
@@ -253,37 +259,76 @@ void raw_clear(struct raw_t *raw)
 	}
 }
 
+/**
+ * Compute the identifier hash of a raw string, so that plain identifiers
+ * and plain variable references never hash at evaluation time.
+ *   @str: The string.
+ *   &returns: The identifier hash, zero if not an identifier or variable.
+ */
+uint32_t raw_hash(const char *str)
+{
+	const char *id;
+
+	id = (*str == '$') ? str + 1 : str;
+	if(*id == '\0')
+		return 0;
+
+	for(str = id; *str != '\0'; str++) {
+		if(!ch_var(*str))
+			return 0;
+	}
+
+	return env_hash(id);
+}
+
+/**
+ * Determine if a raw string is a literal, expanding to itself as a plain
+ * string without needing a template.
+ *   @str: The string.
+ *   &returns: True if literal.
+ */
+bool raw_lit(const char *str)
+{
+	if(*str == '.')
+		return false;
+
+	for(; *str != '\0'; str++) {
+		if(!ch_str(*str))
+			return false;
+	}
+
+	return true;
+}
+
 
 /**
  * Reader structure.
- *   @file: The file.
+ *   @pos, end: The read position and end of the mapped file.
+ *   @cur: The position of the current character.
  *   @ch: The character.
  *   @loc: The location.
  *   @tok: The current token.
- *   @str: The token string.
- *   @len, max: The string length and max.
+ *   @str, len: The token string, referencing the mapped file.
  */
 struct rd_t {
-	FILE *file;
+	const char *pos, *end, *cur;
 	int ch;
 
 	struct loc_t loc, tloc;
 
 	int tok;
 
-	char *str;
-	uint32_t len, max;
+	const char *str;
+	uint32_t len;
 };
 
 /*
  * reader declaraions
  */
 int rd_ch(struct rd_t *rd);
+void rd_seek(struct rd_t *rd, const char *ptr);
 int rd_tok(struct rd_t *rd);
-
-void rd_reset(struct rd_t *rd);
-int rd_push(struct rd_t *rd, char ch);
-int rd_buf(struct rd_t *rd);
+bool rd_eq(struct rd_t *rd, const char *str);
 
 struct ast_block_t *rd_top(struct rd_t *rd);
 struct ast_stmt_t *rd_stmt(struct rd_t *rd);
@@ -298,28 +343,31 @@ struct raw_t *rd_raw(struct rd_t *rd);
  */
 struct ast_block_t *ham_load(const char *path)
 {
+	void *map;
+	size_t len;
+	int64_t size, mtime;
 	struct rd_t rd;
 	struct ast_block_t *block;
 
-	rd.file = fopen(path, "r");
-	if(rd.file == NULL)
+	map = os_map(path, &len);
+	if((map == NULL) && !os_stat(path, &size, &mtime))
 		return NULL;
 
+	rd.pos = map;
+	rd.end = rd.pos + len;
 	rd.loc.path = path;
 	rd.loc.lin = 1;
 	rd.loc.col = 0;
-	rd.str = malloc(64);
+	rd.str = NULL;
 	rd.len = 0;
-	rd.max = 64;
 
 	rd_ch(&rd);
 	rd.tok = rd_tok(&rd);
 
 	block = rd_top(&rd);
 
-	fclose(rd.file);
-
-	free(rd.str);
+	if(map != NULL)
+		os_unmap(map, len);
 
 	return block;
 }
@@ -332,7 +380,9 @@ struct ast_block_t *ham_load(const char *path)
  */
 int rd_ch(struct rd_t *rd)
 {
-	rd->ch = fgetc(rd->file);
+	rd->cur = rd->pos;
+	rd->ch = (rd->pos < rd->end) ? (unsigned char)*rd->pos++ : -1;
+
 	if(rd->ch == '\n') {
 		rd->loc.lin++;
 		rd->loc.col = 0;
@@ -343,42 +393,35 @@ int rd_ch(struct rd_t *rd)
 	return rd->ch;
 }
 
-
-/**
- * Reset the reader's string buffer.
- *   @rd: The reader.
- */
-void rd_reset(struct rd_t *rd)
-{
-	rd->len = 0;
-}
-
 /**
- * Push a character onto the reader's string buffer.
+ * Skip ahead to a position and read the character there.
  *   @rd: The reader.
- *   @ch: The character.
- *   &returns: The next character.
+ *   @ptr: The position, at or after the read position.
  */
-int rd_push(struct rd_t *rd, char ch)
+void rd_seek(struct rd_t *rd, const char *ptr)
 {
-	if(rd->len >= rd->max)
-		rd->str = realloc(rd->str, rd->max *= 2);
+	const char *nl;
 
-	rd->str[rd->len++] = ch;
+	while((nl = memchr(rd->pos, '\n', ptr - rd->pos)) != NULL) {
+		rd->loc.lin++;
+		rd->loc.col = 0;
+		rd->pos = nl + 1;
+	}
 
-	return rd->ch;
+	rd->loc.col += ptr - rd->pos;
+	rd->pos = ptr;
+	rd_ch(rd);
 }
 
 /**
- * Buffer the next character from the reader and advance.
+ * Check if the current token string matches a string.
  *   @rd: The reader.
- *   &returns: The next character.
+ *   @str: The string.
+ *   &returns: True if equal.
  */
-int rd_buf(struct rd_t *rd)
+bool rd_eq(struct rd_t *rd, const char *str)
 {
-	rd_push(rd, rd->ch);
-
-	return rd_ch(rd);
+	return (strlen(str) == rd->len) && (memcmp(rd->str, str, rd->len) == 0);
 }
 
 struct sym_t {
@@ -407,34 +450,34 @@ struct sym_t {
 #define TOK_ADDEQ   0x4000
 #define TOK_EOF     0x7FFF
 
-struct sym_t syms[] = {
-	{ TOK_SHR,   ">>" },
-	{ TOK_SHL,   "<<" },
-	{ TOK_ADDEQ, "+=" },
-	{ '{',       "{" },
-	{ '}',       "}" },
-	{ ':',       ":" },
-	{ ';',       ";" },
-	{ '=',       "=" },
-	{ '<',       "<" },
-	{ '>',       ">" },
-	{ '|',       "|" },
-	{ '?',       "?" },
-	{ 0,         NULL }
+/**
+ * Two-character symbol table, indexed by the first character. All other
+ * symbols are the single characters in `RD_SYM`.
+ */
+#define RD_SYM "{}:;=<>|?"
+
+struct sym_t syms[128] = {
+	['>'] = { TOK_SHR,   ">>" },
+	['<'] = { TOK_SHL,   "<<" },
+	['+'] = { TOK_ADDEQ, "+=" },
 };
 
-struct sym_t keys[] = {
-	{ TOK_DIR,     "dir"      },
-	{ TOK_FOR,     "for"      },
-	{ TOK_IF,      "if"       },
-	{ TOK_ELIF,    "elif"     },
-	{ TOK_ELSE,    "else"     },
-	{ TOK_PRINT,   "print"    },
-	{ TOK_DEF  ,   "default"  },
-	{ TOK_MKDEP,   "makedep"  },
-	{ TOK_INCLUDE, "include"  },
-	{ TOK_IMPORT,  "import"   },
-	{ 0,            NULL      }
+/**
+ * Keyword table, indexed by the perfect hash `RD_KEY`.
+ */
+#define RD_KEY(str, len) ((((unsigned char)(str)[0] << 1) + ((unsigned char)(str)[(len) - 1] << 2) + (len)) & 15)
+
+struct sym_t keys[16] = {
+	[ 1] = { TOK_MKDEP,   "makedep"  },
+	[ 2] = { TOK_ELSE,    "else"     },
+	[ 3] = { TOK_DIR,     "dir"      },
+	[ 5] = { TOK_PRINT,   "print"    },
+	[ 6] = { TOK_ELIF,    "elif"     },
+	[ 7] = { TOK_FOR,     "for"      },
+	[ 8] = { TOK_IMPORT,  "import"   },
+	[12] = { TOK_IF,      "if"       },
+	[13] = { TOK_INCLUDE, "include"  },
+	[15] = { TOK_DEF,     "default"  },
 };
 
 
@@ -458,8 +501,7 @@ bool rd_escape(struct rd_t *rd)
 	if(strchr("tn'\" ,$", rd_ch(rd)) == NULL)
 		loc_err(rd->loc, "Invalid escape character '\\%c'.", rd->ch);
 
-	rd_push(rd, '\\');
-	rd_buf(rd);
+	rd_ch(rd);
 
 	return true;
 }
@@ -480,7 +522,7 @@ void rd_str(struct rd_t *rd)
 		else if(rd->ch == '\\')
 			rd_escape(rd);
 		else if(ch_str(rd->ch))
-			rd_buf(rd);
+			rd_seek(rd, str_plain(rd->pos, rd->end));
 		else
 			break;
 	}
@@ -496,28 +538,30 @@ bool rd_var(struct rd_t *rd)
 	if(rd->ch != '$')
 		return false;
 
-	rd_buf(rd);
+	rd_ch(rd);
 	if(rd->ch == '{') {
-		rd_buf(rd);
+		rd_ch(rd);
 
 		for(;;) {
 			if(rd->ch == '\\')
 				rd_escape(rd);
 			else if(rd->ch == '}')
 				break;
+			else if(rd->ch < 0)
+				loc_err(rd->loc, "Unterminated variable.");
 			else
-				rd_buf(rd);
+				rd_ch(rd);
 		}
 
-		rd_buf(rd);
+		rd_ch(rd);
 	}
 	else if(ch_var(rd->ch)) {
 		do
-			rd_buf(rd);
+			rd_ch(rd);
 		while(ch_var(rd->ch));
 	}
 	else if(strchr("@^<*", rd->ch) != NULL)
-		rd_buf(rd);
+		rd_ch(rd);
 	else
 		loc_err(rd->loc, "Invalid variable name.");
 
@@ -534,7 +578,7 @@ bool rd_quote1(struct rd_t *rd)
 	if(rd->ch != '\'')
 		return false;
 
-	rd_buf(rd);
+	rd_ch(rd);
 
 	for(;;) {
 		if(rd->ch == '\\')
@@ -544,10 +588,10 @@ bool rd_quote1(struct rd_t *rd)
 		else if((rd->ch == '\n') || (rd->ch < 0))
 			loc_err(rd->loc, "Unterminated quote.", rd->ch);
 		else
-			rd_buf(rd);
+			rd_ch(rd);
 	}
 
-	rd_buf(rd);
+	rd_ch(rd);
 
 	return true;
 }
@@ -562,7 +606,7 @@ bool rd_quote2(struct rd_t *rd)
 	if(rd->ch != '"')
 		return false;
 
-	rd_buf(rd);
+	rd_ch(rd);
 
 	for(;;) {
 		if(rd->ch == '\\')
@@ -574,10 +618,10 @@ bool rd_quote2(struct rd_t *rd)
 		else if((rd->ch == '\n') || (rd->ch < 0))
 			loc_err(rd->loc, "Unterminated quote.", rd->ch);
 		else
-			rd_buf(rd);
+			rd_ch(rd);
 	}
 
-	rd_buf(rd);
+	rd_ch(rd);
 
 	return true;
 }
@@ -589,48 +633,46 @@ bool rd_quote2(struct rd_t *rd)
  */
 int rd_tok(struct rd_t *rd)
 {
-	char ch, peek;
+	int ch;
+	const char *nl;
 	struct sym_t *sym;
 
 	for(;;) {
-		while(ch_space(rd->ch))
-			rd_ch(rd);
+		if(ch_space(rd->ch))
+			rd_seek(rd, str_space(rd->pos, rd->end));
 
 		if(rd->ch != '#')
 			break;
 
-		do
-			rd_ch(rd);
-		while((rd->ch >= 0) && (rd->ch != '\n'));
+		nl = memchr(rd->pos, '\n', rd->end - rd->pos);
+		rd_seek(rd, (nl != NULL) ? nl : rd->end);
 	}
 
-	rd_reset(rd);
+	rd->str = rd->cur;
+	rd->len = 0;
 	rd->tloc = rd->loc;
 
 	ch = rd->ch;
-	peek = '\0';
-	for(sym = syms; sym->tok != 0; sym++) {
-		if(ch != sym->str[0])
-			continue;
-
-		if(peek == '\0')
-			peek = rd_ch(rd);
-
-		if(sym->str[1] == '\0')
+	if((ch > 0) && (ch < 128)) {
+		sym = &syms[ch];
+		if((sym->str != NULL) && (rd->pos < rd->end) && (*rd->pos == sym->str[1])) {
+			rd_ch(rd);
+			rd_ch(rd);
 			return rd->tok = sym->tok;
-		else if(sym->str[1] != peek)
-			continue;
-
-		rd_ch(rd);
-		return rd->tok = sym->tok;
+		}
+		else if(strchr(RD_SYM, ch) != NULL) {
+			rd_ch(rd);
+			return rd->tok = ch;
+		}
 	}
 
 	if(ch_str(rd->ch) || (rd->ch == '$') || (rd->ch == '"') || (rd->ch == '\'')) {
 		rd_str(rd);
-		rd_push(rd, '\0');
+		rd->len = rd->cur - rd->str;
 
-		for(sym = keys; sym->tok != 0; sym++) {
-			if(strcmp(rd->str, sym->str) == 0)
+		if((rd->len >= 2) && (rd->len <= 7)) {
+			sym = &keys[RD_KEY(rd->str, rd->len)];
+			if((sym->str != NULL) && rd_eq(rd, sym->str))
 				return rd->tok = sym->tok;
 		}
 
@@ -725,7 +767,7 @@ struct ast_stmt_t *rd_stmt(struct rd_t *rd)
 			imm_delete(lhs);
 			rd_tok(rd);
 
-			if((rd->tok == TOK_STR) && (strcmp(rd->str, "env") == 0)) {
+			if((rd->tok == TOK_STR) && (rd_eq(rd, "env"))) {
 				struct ast_block_t *block;
 
 				rd_tok(rd);
@@ -791,6 +833,15 @@ struct ast_stmt_t *rd_stmt(struct rd_t *rd)
 								loc_err(rd->tloc, "Missing output file path.");
 
 						}
+						else if(rd->tok == '<') {
+							if(proc->in != NULL)
+								loc_err(rd->tloc, "Input redirect already given.");
+
+							rd_tok(rd);
+							proc->in = rd_raw(rd);
+							if(proc->in == NULL)
+								loc_err(rd->tloc, "Missing input file path.");
+						}
 						else
 							loc_err(rd->tloc, "Expected ';'.");
 					}
@@ -816,7 +867,7 @@ struct ast_stmt_t *rd_stmt(struct rd_t *rd)
 		if(rd_tok(rd) != TOK_STR)
 			loc_err(rd->tloc, "Expected variable name.");
 
-		id = strdup(rd->str);
+		id = strndup(rd->str, rd->len);
 		if(rd_tok(rd) != ':')
 			loc_err(rd->tloc, "Expected ':'.");
 
@@ -905,7 +956,7 @@ struct raw_t *rd_raw(struct rd_t *rd)
 	if((rd->tok != TOK_STR) && (rd->tok != TOK_SPEC) && (rd->tok != TOK_VAR))
 		return NULL;
 
-	raw = raw_new(rd->tok == TOK_SPEC, rd->tok == TOK_VAR, strdup(rd->str), rd->tloc);
+	raw = raw_new(rd->tok == TOK_SPEC, rd->tok == TOK_VAR, strndup(rd->str, rd->len), rd->tloc);
 	rd_tok(rd);
 
 	return raw;
@@ -0,0 +1,603 @@
+#include "../inc.h"
+
+
+/*
+ * syntax tree cache definitions
+ */
+#define AST_MAGIC "HAMAST1"
+
+/**
+ * Syntax tree cache header structure. The header is followed by the file
+ * records, the word stream padded to 8 bytes, and the string table.
+ *   @magic: The magic string.
+ *   @nfile: The file count.
+ *   @nword: The number of words in the word stream.
+ *   @nstr: The string table size.
+ *   @hash: The digest of everything following the header.
+ */
+struct ast_hdr_t {
+	char magic[8];
+	uint32_t nfile, nword;
+	uint64_t nstr, hash;
+};
+
+/**
+ * Syntax tree cache file record structure.
+ *   @dev, ino: The device and inode numbers.
+ *   @size, mtime: The size and modification time.
+ *   @hash: The content digest.
+ *   @path: The canonical path string offset.
+ *   @word: The offset of the tree in the word stream.
+ */
+struct ast_rec_t {
+	uint64_t dev, ino;
+	int64_t size, mtime;
+	uint64_t hash;
+	uint32_t path, word;
+};
+
+/**
+ * Syntax tree cache structure. The cache is read-only once opened, so that
+ * trees may be read from several threads.
+ *   @map, size: The mapped cache file.
+ *   @rec, path, nfile: The file records and their interned paths.
+ *   @word, nword: The word stream.
+ *   @str, nstr: The string table.
+ */
+struct ast_cache_t {
+	void *map;
+	size_t size;
+
+	const struct ast_rec_t *rec;
+	const char **path;
+	uint32_t nfile;
+
+	const uint32_t *word;
+	uint32_t nword;
+
+	const char *str;
+	uint64_t nstr;
+};
+
+/*
+ * syntax tree cache declarations
+ */
+void ast_wr_block(struct graph_wr_t *wr, struct ast_block_t *block);
+void ast_wr_stmt(struct graph_wr_t *wr, struct ast_stmt_t *stmt);
+void ast_wr_imm(struct graph_wr_t *wr, struct imm_t *imm);
+void ast_wr_raw(struct graph_wr_t *wr, struct raw_t *raw);
+void ast_wr_loc(struct graph_wr_t *wr, struct loc_t loc);
+
+struct ast_block_t *ast_rd_block(struct graph_rd_t *rd, const char *path);
+struct ast_stmt_t *ast_rd_stmt(struct graph_rd_t *rd, const char *path);
+struct imm_t *ast_rd_imm(struct graph_rd_t *rd, const char *path);
+struct raw_t *ast_rd_raw(struct graph_rd_t *rd, const char *path);
+struct loc_t ast_rd_loc(struct graph_rd_t *rd, const char *path);
+
+
+/**
+ * Open the syntax tree cache.
+ *   @path: The cache path.
+ *   &returns: The cache, or null if missing or invalid.
+ */
+struct ast_cache_t *ast_cache_open(const char *path)
+{
+	void *map;
+	size_t size;
+	uint32_t i;
+	const struct ast_hdr_t *hdr;
+	struct ast_cache_t *cache;
+
+	map = os_map(path, &size);
+	if(map == NULL)
+		return NULL;
+
+	hdr = map;
+	if((size < sizeof(struct ast_hdr_t)) || (memcmp(hdr->magic, AST_MAGIC, 8) != 0))
+		goto fail;
+	else if((sizeof(struct ast_hdr_t) + (uint64_t)hdr->nfile * sizeof(struct ast_rec_t) + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7) + hdr->nstr) != size)
+		goto fail;
+	else if(digest_buf(hdr + 1, size - sizeof(struct ast_hdr_t)) != hdr->hash)
+		goto fail;
+
+	cache = malloc(sizeof(struct ast_cache_t));
+	cache->map = map;
+	cache->size = size;
+	cache->rec = (const struct ast_rec_t *)(hdr + 1);
+	cache->nfile = hdr->nfile;
+	cache->word = (const uint32_t *)(cache->rec + hdr->nfile);
+	cache->nword = hdr->nword;
+	cache->str = (const char *)cache->word + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7);
+	cache->nstr = hdr->nstr;
+	cache->path = malloc(hdr->nfile * sizeof(const char *));
+
+	if((hdr->nstr == 0) || (cache->str[hdr->nstr - 1] != '\0')) {
+		ast_cache_close(cache);
+		return NULL;
+	}
+
+	for(i = 0; i < hdr->nfile; i++) {
+		if((cache->rec[i].path >= hdr->nstr) || (cache->rec[i].word >= hdr->nword)) {
+			ast_cache_close(cache);
+			return NULL;
+		}
+
+		cache->path[i] = intern_str(cache->str + cache->rec[i].path);
+	}
+
+	return cache;
+
+fail:
+	os_unmap(map, size);
+	return NULL;
+}
+
+/**
+ * Close the syntax tree cache.
+ *   @cache: The cache.
+ */
+void ast_cache_close(struct ast_cache_t *cache)
+{
+	os_unmap(cache->map, cache->size);
+	free(cache->path);
+	free(cache);
+}
+
+/**
+ * Retrieve the tree of a file from the cache. The file must match the record
+ * by canonical path, identity, and content digest. Safe to call from several
+ * threads.
+ *   @cache: The cache.
+ *   @fetch: The file, with its identity and source record filled in.
+ *   &returns: The block, or null if not cached.
+ */
+struct ast_block_t *ast_cache_get(struct ast_cache_t *cache, const struct fetch_t *fetch)
+{
+	uint32_t i;
+	struct graph_rd_t rd;
+	struct ast_block_t *block;
+	const struct ast_rec_t *rec;
+
+	for(i = 0; i < cache->nfile; i++) {
+		if(cache->path[i] == fetch->path)
+			break;
+	}
+
+	if(i == cache->nfile)
+		return NULL;
+
+	rec = &cache->rec[i];
+	if((rec->dev != fetch->id.dev) || (rec->ino != fetch->id.ino) || (rec->size != fetch->id.size) || (rec->mtime != fetch->id.mtime) || (rec->hash != fetch->src.hash))
+		return NULL;
+
+	rd = (struct graph_rd_t){ cache->word, rec->word, cache->nword, cache->str, cache->nstr, false };
+	block = ast_rd_block(&rd, fetch->name);
+	if(rd.err) {
+		ast_block_delete(block);
+		return NULL;
+	}
+
+	return block;
+}
+
+/**
+ * Save the trees of every file used by the evaluation to the cache. Nothing
+ * is written if every used tree came from the cache. Failures are ignored,
+ * leaving no cache behind.
+ *   @ctx: The context.
+ *   @path: The cache path.
+ */
+void ast_cache_save(struct rt_ctx_t *ctx, const char *path)
+{
+	FILE *file;
+	char *tmp, *body;
+	size_t len;
+	uint32_t n = 0, max = 64;
+	struct ast_hdr_t hdr;
+	struct ast_rec_t *rec;
+	struct graph_wr_t wr;
+	struct fetch_t *fetch;
+
+	for(fetch = ctx->fetch; fetch != NULL; fetch = fetch->next) {
+		if(fetch->used && (fetch->top != NULL) && !fetch->cached)
+			break;
+	}
+
+	if(fetch == NULL)
+		return;
+
+	wr.word = malloc(1024 * sizeof(uint32_t));
+	wr.nword = 0;
+	wr.maxword = 1024;
+	wr.str = malloc(4096);
+	wr.nstr = 0;
+	wr.maxstr = 4096;
+	wr.smask = 1023;
+	wr.scnt = 0;
+	wr.stab = calloc(wr.smask + 1, sizeof(uint32_t));
+	wr.ttab = NULL;
+	wr.tidx = NULL;
+	wr.tmask = 0;
+
+	rec = malloc(max * sizeof(struct ast_rec_t));
+
+	for(fetch = ctx->fetch; fetch != NULL; fetch = fetch->next) {
+		if(!fetch->used || (fetch->top == NULL))
+			continue;
+
+		if(n == max)
+			rec = realloc(rec, (max *= 2) * sizeof(struct ast_rec_t));
+
+		rec[n++] = (struct ast_rec_t){ fetch->id.dev, fetch->id.ino, fetch->id.size, fetch->id.mtime, fetch->src.hash, graph_intern(&wr, fetch->path), wr.nword };
+		ast_wr_block(&wr, fetch->top);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, AST_MAGIC, 8);
+	hdr.nfile = n;
+
+	hdr.nword = wr.nword;
+	if(wr.nword % 2)
+		graph_word(&wr, 0);
+
+	if(wr.nstr == 0)
+		graph_intern(&wr, "");
+
+	hdr.nstr = wr.nstr;
+
+	len = n * sizeof(struct ast_rec_t) + wr.nword * sizeof(uint32_t) + wr.nstr;
+	body = malloc(len);
+	memcpy(body, rec, n * sizeof(struct ast_rec_t));
+	memcpy(body + n * sizeof(struct ast_rec_t), wr.word, wr.nword * sizeof(uint32_t));
+	memcpy(body + len - wr.nstr, wr.str, wr.nstr);
+	hdr.hash = digest_buf(body, len);
+
+	tmp = str_fmt("%s.tmp", path);
+	file = fopen(tmp, "wb");
+	if(file != NULL) {
+		fwrite(&hdr, sizeof(hdr), 1, file);
+		fwrite(body, 1, len, file);
+
+		if((fclose(file) != 0) || (rename(tmp, path) != 0))
+			remove(tmp);
+	}
+
+	free(tmp);
+	free(body);
+	free(rec);
+	free(wr.word);
+	free(wr.str);
+	free(wr.stab);
+}
+
+
+/**
+ * Write a block.
+ *   @wr: The writer.
+ *   @block: The block.
+ */
+void ast_wr_block(struct graph_wr_t *wr, struct ast_block_t *block)
+{
+	uint32_t n = 0;
+	struct ast_stmt_t *stmt;
+
+	for(stmt = block->stmt; stmt != NULL; stmt = stmt->next)
+		n++;
+
+	graph_word(wr, n);
+	for(stmt = block->stmt; stmt != NULL; stmt = stmt->next)
+		ast_wr_stmt(wr, stmt);
+}
+
+/**
+ * Write a statement.
+ *   @wr: The writer.
+ *   @stmt: The statement.
+ */
+void ast_wr_stmt(struct graph_wr_t *wr, struct ast_stmt_t *stmt)
+{
+	uint32_t n;
+	struct link_t *link;
+	struct ast_cmd_t *cmd;
+	struct ast_pipe_t *pipe;
+
+	graph_word(wr, stmt->tag);
+	ast_wr_loc(wr, stmt->loc);
+
+	switch(stmt->tag) {
+	case ast_bind_v:
+		ast_wr_raw(wr, stmt->data.bind->id);
+		graph_word(wr, stmt->data.bind->tag);
+		graph_word(wr, stmt->data.bind->add);
+
+		switch(stmt->data.bind->tag) {
+		case ast_val_v: ast_wr_imm(wr, stmt->data.bind->data.val); break;
+		case ast_func_v: fatal("FIXME stub");
+		case ast_block_v: ast_wr_block(wr, stmt->data.bind->data.block); break;
+		}
+
+		break;
+
+	case syn_v:
+		ast_wr_loc(wr, stmt->data.syn->loc);
+		ast_wr_imm(wr, stmt->data.syn->gen);
+		ast_wr_imm(wr, stmt->data.syn->dep);
+
+		if(stmt->data.syn->cmd == NULL) {
+			graph_word(wr, 0);
+			break;
+		}
+
+		for(n = 0, link = stmt->data.syn->cmd->head; link != NULL; link = link->next)
+			n++;
+
+		graph_word(wr, n + 1);
+
+		for(link = stmt->data.syn->cmd->head; link != NULL; link = link->next) {
+			cmd = link->val;
+
+			for(n = 0, pipe = cmd->pipe; pipe != NULL; pipe = pipe->next)
+				n++;
+
+			graph_word(wr, n);
+			for(pipe = cmd->pipe; pipe != NULL; pipe = pipe->next)
+				ast_wr_imm(wr, pipe->imm);
+
+			graph_word(wr, (cmd->in != NULL) | ((cmd->out != NULL) << 1) | (cmd->append << 2));
+
+			if(cmd->in != NULL)
+				ast_wr_raw(wr, cmd->in);
+
+			if(cmd->out != NULL)
+				ast_wr_raw(wr, cmd->out);
+		}
+
+		break;
+
+	case loop_v:
+		ast_wr_loc(wr, stmt->data.loop->loc);
+		graph_word(wr, graph_intern(wr, stmt->data.loop->id));
+		ast_wr_imm(wr, stmt->data.loop->imm);
+		ast_wr_stmt(wr, stmt->data.loop->body);
+		break;
+
+	case print_v:
+		ast_wr_imm(wr, stmt->data.print->imm);
+		break;
+
+	case ast_mkdep_v:
+		ast_wr_loc(wr, stmt->data.mkdep->loc);
+		ast_wr_imm(wr, stmt->data.mkdep->path);
+		break;
+
+	case block_v:
+		ast_wr_block(wr, stmt->data.block);
+		break;
+
+	case ast_inc_v:
+		graph_word(wr, stmt->data.inc->nest | (stmt->data.inc->opt << 1));
+		ast_wr_imm(wr, stmt->data.inc->imm);
+		break;
+	}
+}
+
+/**
+ * Write an immediate value.
+ *   @wr: The writer.
+ *   @imm: The immediate value.
+ */
+void ast_wr_imm(struct graph_wr_t *wr, struct imm_t *imm)
+{
+	struct raw_t *raw;
+
+	graph_word(wr, imm_len(imm));
+	for(raw = imm->raw; raw != NULL; raw = raw->next)
+		ast_wr_raw(wr, raw);
+}
+
+/**
+ * Write a raw string.
+ *   @wr: The writer.
+ *   @raw: The raw string.
+ */
+void ast_wr_raw(struct graph_wr_t *wr, struct raw_t *raw)
+{
+	graph_word(wr, raw->spec | (raw->var << 1));
+	graph_word(wr, graph_intern(wr, raw->str));
+	ast_wr_loc(wr, raw->loc);
+}
+
+/**
+ * Write a location, the path being implied by the file.
+ *   @wr: The writer.
+ *   @loc: The location.
+ */
+void ast_wr_loc(struct graph_wr_t *wr, struct loc_t loc)
+{
+	graph_word(wr, loc.lin);
+	graph_word(wr, loc.col);
+}
+
+
+/**
+ * Read a block. A well-formed block is always returned, setting the reader
+ * error flag on malformed data.
+ *   @rd: The reader.
+ *   @path: The file path used for locations.
+ *   &returns: The block.
+ */
+struct ast_block_t *ast_rd_block(struct graph_rd_t *rd, const char *path)
+{
+	uint32_t i, n;
+	struct ast_block_t *block;
+	struct ast_stmt_t **stmt;
+
+	block = ast_block_new();
+	stmt = &block->stmt;
+
+	n = graph_get(rd);
+	for(i = 0; (i < n) && !rd->err; i++) {
+		*stmt = ast_rd_stmt(rd, path);
+		stmt = &(*stmt)->next;
+	}
+
+	return block;
+}
+
+/**
+ * Read a statement.
+ *   @rd: The reader.
+ *   @path: The file path used for locations.
+ *   &returns: The statement.
+ */
+struct ast_stmt_t *ast_rd_stmt(struct graph_rd_t *rd, const char *path)
+{
+	uint32_t i, k, n, m, flags;
+	struct loc_t loc;
+	enum stmt_e tag;
+	union stmt_u data;
+	struct raw_t *id;
+	struct ast_cmd_t *cmd;
+	struct ast_pipe_t *pipe, **ipipe;
+
+	tag = graph_get(rd);
+	loc = ast_rd_loc(rd, path);
+
+	switch(tag) {
+	case ast_bind_v:
+		id = ast_rd_raw(rd, path);
+		k = graph_get(rd);
+		flags = graph_get(rd);
+
+		if(k == ast_block_v)
+			data.bind = ast_bind_block(id, ast_rd_block(rd, path), flags);
+		else {
+			rd->err |= (k != ast_val_v);
+			data.bind = ast_bind_val(id, ast_rd_imm(rd, path), flags);
+		}
+
+		break;
+
+	case syn_v: {
+		struct loc_t sloc = ast_rd_loc(rd, path);
+		struct imm_t *gen = ast_rd_imm(rd, path);
+
+		data.syn = ast_rule_new(gen, ast_rd_imm(rd, path), sloc);
+
+		n = graph_get(rd);
+		if(n-- == 0)
+			break;
+
+		data.syn->cmd = list_new((del_f)ast_cmd_delete);
+
+		for(i = 0; (i < n) && !rd->err; i++) {
+			pipe = NULL;
+			ipipe = &pipe;
+
+			m = graph_get(rd);
+			for(k = 0; (k < m) && !rd->err; k++) {
+				*ipipe = ast_pipe_new(ast_rd_imm(rd, path));
+				ipipe = &(*ipipe)->next;
+			}
+
+			cmd = ast_cmd_new(pipe);
+			list_add(data.syn->cmd, cmd);
+
+			flags = graph_get(rd);
+			cmd->append = (flags & 4) != 0;
+			cmd->in = (flags & 1) ? ast_rd_raw(rd, path) : NULL;
+			cmd->out = (flags & 2) ? ast_rd_raw(rd, path) : NULL;
+		}
+	} break;
+
+	case loop_v: {
+		struct loc_t lloc = ast_rd_loc(rd, path);
+		char *var = strdup(graph_str(rd));
+		struct imm_t *imm = ast_rd_imm(rd, path);
+
+		data.loop = loop_new(var, imm, rd->err ? stmt_new(block_v, (union stmt_u){ .block = ast_block_new() }, loc) : ast_rd_stmt(rd, path), lloc);
+	} break;
+
+	case print_v:
+		data.print = print_new(ast_rd_imm(rd, path));
+		break;
+
+	case ast_mkdep_v: {
+		struct loc_t mloc = ast_rd_loc(rd, path);
+
+		data.mkdep = ast_mkdep_new(ast_rd_imm(rd, path), mloc);
+	} break;
+
+	case block_v:
+		data.block = ast_rd_block(rd, path);
+		break;
+
+	case ast_inc_v:
+		flags = graph_get(rd);
+		data.inc = ast_inc_new(flags & 1, (flags & 2) != 0, ast_rd_imm(rd, path));
+		break;
+
+	default:
+		rd->err = true;
+		tag = block_v;
+		data.block = ast_block_new();
+	}
+
+	return stmt_new(tag, data, loc);
+}
+
+/**
+ * Read an immediate value.
+ *   @rd: The reader.
+ *   @path: The file path used for locations.
+ *   &returns: The immediate value.
+ */
+struct imm_t *ast_rd_imm(struct graph_rd_t *rd, const char *path)
+{
+	uint32_t i, n;
+	struct imm_t *imm;
+	struct raw_t **raw;
+
+	imm = imm_new();
+	raw = &imm->raw;
+
+	n = graph_get(rd);
+	for(i = 0; (i < n) && !rd->err; i++) {
+		*raw = ast_rd_raw(rd, path);
+		raw = &(*raw)->next;
+	}
+
+	return imm;
+}
+
+/**
+ * Read a raw string.
+ *   @rd: The reader.
+ *   @path: The file path used for locations.
+ *   &returns: The raw string.
+ */
+struct raw_t *ast_rd_raw(struct graph_rd_t *rd, const char *path)
+{
+	uint32_t flags;
+	const char *str;
+
+	flags = graph_get(rd);
+	str = graph_str(rd);
+
+	return raw_new(flags & 1, (flags & 2) != 0, strdup(str), ast_rd_loc(rd, path));
+}
+
+/**
+ * Read a location.
+ *   @rd: The reader.
+ *   @path: The file path.
+ *   &returns: The location.
+ */
+struct loc_t ast_rd_loc(struct graph_rd_t *rd, const char *path)
+{
+	uint32_t lin;
+
+	lin = graph_get(rd);
+
+	return (struct loc_t){ path, lin, graph_get(rd) };
+}
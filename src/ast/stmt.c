@@ -110,6 +110,7 @@ void ast_mkdep_delete(struct ast_mkdep_t *dep)
  */
 void ast_mkdep_eval(struct ast_mkdep_t *dep, struct rt_ctx_t *ctx, struct env_t *env)
 {
+	uint32_t i;
 	struct val_t *val;
 	struct rt_obj_t obj;
 
@@ -120,8 +121,9 @@ void ast_mkdep_eval(struct ast_mkdep_t *dep, struct rt_ctx_t *ctx, struct env_t
 	if(obj.tag != rt_val_v)
 		loc_err(dep->loc, "Command `makedep` requires a string value.");
 
-	for(val = obj.data.val; val != NULL; val = val->next)
-		mk_eval(ctx, val->str, false);
+	val = obj.data.val;
+	for(i = 0; i < val_len(val); i++)
+		ctx_mkdep(ctx, val_get(val, i));
 
 	rt_obj_delete(obj);
 }
@@ -166,6 +168,8 @@ void ast_inc_delete(struct ast_inc_t *inc)
  */
 void ast_inc_eval(struct ast_inc_t *inc, struct rt_ctx_t *ctx, struct env_t *env, struct loc_t loc)
 {
+	uint32_t i;
+	const char *path;
 	struct val_t *val;
 	struct rt_obj_t obj;
 	struct env_t *nest;
@@ -177,13 +181,19 @@ void ast_inc_eval(struct ast_inc_t *inc, struct rt_ctx_t *ctx, struct env_t *env
 	else if(obj.tag != rt_val_v)
 		loc_err(loc, "%s require string values.", inc->nest ? "Import" : "Include");
 
-	for(val = obj.data.val; val != NULL; val = val->next) {
-		top = ham_load(val->str);
+	val = obj.data.val;
+	if(val_len(val) > 1)
+		ctx_fetch(ctx, val);
+
+	for(i = 0; i < val_len(val); i++) {
+		path = val_get(val, i);
+
+		top = ctx_load(ctx, path);
 		if(top == NULL) {
 			if(inc->opt)
 				continue;
 
-			loc_err(loc, "Cannot open '%s'.", val->str);
+			loc_err(loc, "Cannot open '%s'.", path);
 		}
 
 		if(inc->nest) {
@@ -193,13 +203,124 @@ void ast_inc_eval(struct ast_inc_t *inc, struct rt_ctx_t *ctx, struct env_t *env
 		}
 		else
 			eval_block(top, ctx, env);
-
-		ast_block_delete(top);
-		rt_obj_delete(obj);
 	}
+
+	rt_obj_delete(obj);
 }
 
 
+/**
+ * Makedep file structure.
+ *   @path: The path.
+ *   @rec: The cache record.
+ *   @found, err: Found flag and syntax error flag. Parsing stops at the
+ *     first syntax error, keeping the rules before it.
+ *   @hit: Set if the cache record is current, leaving the file unparsed.
+ *   @size, mtime: The size and modification time.
+ *   @buf: The null-terminated target paths, back-to-back.
+ *   @cnt, ncnt, maxcnt: The generated and dependency counts of each rule.
+ */
+struct mk_file_t {
+	const char *path;
+	struct mk_rec_t *rec;
+	bool found, err, hit;
+	int64_t size, mtime;
+
+	struct buf_t buf;
+	uint32_t *cnt, ncnt, maxcnt;
+};
+
+/**
+ * Makedep record structure, the rules of a makedep file as of its last
+ * parse, kept in the graph cache.
+ *   @path: The makedep path.
+ *   @size, mtime: The size and modification time when parsed, the size
+ *     negative if the record is empty.
+ *   @cnt, ncnt: The generated and dependency counts of each rule.
+ *   @ref: The cached path index of every target, if loaded from the cache.
+ *   @tgt: The target of every path, if parsed by this run.
+ */
+struct mk_rec_t {
+	const char *path;
+	int64_t size, mtime;
+
+	const uint32_t *cnt;
+	uint32_t ncnt;
+
+	const uint32_t *ref;
+	struct target_t **tgt;
+};
+
+/**
+ * Makedep cache structure.
+ *   @tab, mask, cnt: The records, hashed by path.
+ *   @path, tgt, npath: The cached paths and their targets, resolved on first
+ *     use.
+ *   @dirty: Set if a record changed since the cache was loaded or written.
+ */
+struct mk_cache_t {
+	struct mk_rec_t **tab;
+	uint32_t mask, cnt;
+
+	const char **path;
+	struct target_t **tgt;
+	uint32_t npath;
+
+	bool dirty;
+};
+
+/**
+ * Makedep cache header structure. The header is followed by the records,
+ * the word stream padded to 8 bytes, and the string table. Paths are stored
+ * as indices into the string table, counting strings.
+ *   @nrec, nword: The record and word counts.
+ *   @nstr: The string table size.
+ *   @hash: The digest of everything following the header.
+ */
+struct mk_hdr_t {
+	uint32_t nrec, nword;
+	uint64_t nstr, hash;
+};
+
+/**
+ * Makedep cache entry structure. The rules of an entry are the rule count
+ * times two, the generated and dependency counts of each rule, and the path
+ * index of every target.
+ *   @size, mtime: The size and modification time.
+ *   @path: The path index.
+ *   @word: The word offset of the rules.
+ */
+struct mk_ent_t {
+	int64_t size, mtime;
+	uint32_t path, word;
+};
+
+/**
+ * Makedep target table structure, caching the targets of canonical paths
+ * across files.
+ *   @ent, mask, cnt: The entries, mask and count.
+ */
+struct mk_tab_t {
+	struct target_t **ent;
+	uint32_t mask, cnt;
+};
+
+/*
+ * makedep definitions
+ */
+#define MK_BATCH 256
+
+/*
+ * makedep declarations
+ */
+struct target_t *mk_target(struct mk_tab_t *tab, struct rt_ctx_t *ctx, const char *path);
+void mk_fill(struct mk_file_t *file, struct mk_tab_t *tab, struct rt_ctx_t *ctx);
+void mk_apply(struct mk_rec_t *rec, struct rt_ctx_t *ctx);
+struct mk_rec_t *mk_get(struct mk_cache_t *cache, const char *path);
+void mk_drop(struct mk_cache_t *cache, struct mk_rec_t *rec);
+bool mk_check(const struct mk_ent_t *ent, const uint32_t *word, uint32_t nword, uint32_t npath);
+
+
 /**
  * Parse a make dependency file.
  *   @context: The context.
@@ -208,108 +329,804 @@ void ast_inc_eval(struct ast_inc_t *inc, struct rt_ctx_t *ctx, struct env_t *env
  */
 void mk_eval(struct rt_ctx_t *ctx, const char *path, bool strict)
 {
-	int ch;
-	char *str;
-	FILE *file;
-	struct target_list_t *gens, *deps;
+	mk_load(ctx, &path, 1, strict);
+}
 
-	file = fopen(path, "r");
-	if(file == NULL) {
-		if(!strict)
-			return;
+/**
+ * Parse a set of make dependency files. Files are parsed concurrently in
+ * batches, and the rules of each batch are added in file order. Files with
+ * the size and modification time of their cache record are not parsed, the
+ * record providing their rules.
+ *   @context: The context.
+ *   @paths: The paths.
+ *   @n: The number of paths.
+ *   @strict: The strict flag.
+ */
+void mk_load(struct rt_ctx_t *ctx, const char **paths, uint32_t n, bool strict)
+{
+	uint32_t i, m;
+	struct mk_tab_t tab;
+	struct mk_file_t *file;
+
+	file = malloc(((n < MK_BATCH) ? n : MK_BATCH) * sizeof(struct mk_file_t));
+	tab.mask = 1023;
+	tab.cnt = 0;
+	tab.ent = calloc(tab.mask + 1, sizeof(struct target_t *));
+
+	for(; n > 0; paths += m, n -= m) {
+		m = (n < MK_BATCH) ? n : MK_BATCH;
+		for(i = 0; i < m; i++)
+			file[i] = (struct mk_file_t){ paths[i], mk_get(ctx->mkc, paths[i]), false, false, false, 0, 0, buf_new(4096), malloc(64 * sizeof(uint32_t)), 0, 64 };
+
+		os_par(mk_proc, file, m);
+
+		for(i = 0; i < m; i++) {
+			if(!file[i].found) {
+				if(strict)
+					fatal("Cannot open '%s'.", file[i].path);
+
+				mk_drop(ctx->mkc, file[i].rec);
+			}
+			else if(!file[i].hit)
+				mk_fill(&file[i], &tab, ctx);
 
-		fatal("Cannot open '%s'.", path);
+			mk_apply(file[i].rec, ctx);
+
+			if(file[i].err) {
+				fprintf(stderr, "%s: Invalid makedep file.\n", file[i].path);
+				mk_drop(ctx->mkc, file[i].rec);
+
+				if(strict)
+					exit(1);
+			}
+
+			buf_delete(&file[i].buf);
+			free(file[i].cnt);
+		}
 	}
 
-	gens = target_list_new();
-	deps = target_list_new();
-	ch = fgetc(file);
+	free(file);
+	free(tab.ent);
+}
 
-	for(;;) {
-		while(mk_space(ch) || (ch == '\n'))
-			ch = fgetc(file);
+/**
+ * Makedep stem structure.
+ *   @path, len: The generated path and its stem length.
+ *   @rule: The generating rule, null if generated by several rules.
+ */
+struct mk_stem_t {
+	const char *path;
+	uint32_t len;
+	struct rule_t *rule;
+};
 
-		if(ch == EOF)
-			break;
+/**
+ * Makedep owner table structure, mapping path stems to the rules that
+ * generate them.
+ *   @ent, mask: The entries and mask.
+ */
+struct mk_own_t {
+	struct mk_stem_t *ent;
+	uint32_t mask;
+};
+
+/*
+ * makedep owner declarations
+ */
+uint32_t mk_stem(const char *path);
+uint32_t mk_hash(const char *path, uint32_t len);
+void mk_own(struct mk_own_t *own, struct rt_ctx_t *ctx);
+struct rule_t *mk_find(struct mk_own_t *own, const char *path);
+
+
+/**
+ * Assign the makedep files registered during evaluation to the rules that
+ * own them. A file is owned by the only rule that generates a target with
+ * the same path stem, so that `o/x.d` belongs to the rule of `o/x.o` even
+ * when `o/x.d` has a rule of its own, since only the rule of `o/x.o` needs
+ * its dependencies. Otherwise, a file is owned by the rule generating it.
+ * Files without an owner are read immediately, as part of the evaluation.
+ *   @ctx: The context.
+ */
+void mk_assign(struct rt_ctx_t *ctx)
+{
+	uint32_t i, n = 0;
+	const char **eager;
+	struct rule_t *rule;
+	struct target_t *target;
+	struct mk_own_t own = { NULL, 0 };
+
+	if(ctx->nmk == 0)
+		return;
+
+	for(i = 0; i < ctx->nmk; i++) {
+		target = map_get(ctx->map, false, ctx->mk[i]);
+		if(target != NULL)
+			target->flags |= FLAG_MKDEP;
+	}
 
-		while((str = mk_str(file, &ch)) != NULL) {
-			target_list_add(gens, ctx_target(ctx, false, str));
-			free(str);
+	mk_own(&own, ctx);
+	eager = malloc(ctx->nmk * sizeof(const char *));
+
+	for(i = 0; i < ctx->nmk; i++) {
+		target = map_get(ctx->map, false, ctx->mk[i]);
+		if(target != NULL)
+			target->flags &= ~FLAG_MKDEP;
+
+		rule = mk_find(&own, ctx->mk[i]);
+		if((rule == NULL) && (target != NULL))
+			rule = target->rule;
+
+		if(rule != NULL)
+			rule_mkdep(rule, ctx->mk[i]);
+		else {
+			ctx_source(ctx, ctx->mk[i]);
+			eager[n++] = ctx->mk[i];
 		}
+	}
+
+	ctx->nmk = 0;
+	free(own.ent);
+
+	mk_load(ctx, eager, n, false);
+	free(eager);
+}
+
+/**
+ * Load the makedep files of every rule reachable from a set of targets.
+ * Files are loaded in rounds, each round loading the files of the rules
+ * newly reached by the previous one. Every file is loaded before any rule
+ * is queued, since a file may add dependencies to rules other than its
+ * owner.
+ *   @ctx: The context.
+ *   @paths: The interned target paths.
+ *   @n: The number of paths.
+ */
+void mk_reach(struct rt_ctx_t *ctx, const char **paths, uint32_t n)
+{
+	uint32_t i, k, cnt = 0, nmk, max;
+	const char **mk;
+	struct rule_t *rule, **list;
+	struct target_t *target;
+	struct target_iter_t iter;
+	struct rule_iter_t irule;
+
+	for(max = 1, irule = rule_iter(ctx->rules); rule_next(&irule) != NULL; max++);
+	list = malloc(max * sizeof(struct rule_t *));
+
+	for(i = 0; i < n; i++) {
+		target = map_get(ctx->map, false, paths[i]);
+		if((target != NULL) && (target->rule != NULL) && !target->rule->add) {
+			target->rule->add = true;
+			list[cnt++] = target->rule;
+		}
+	}
+
+	do {
+		for(i = 0; i < cnt; i++) {
+			iter = target_iter(list[i]->deps);
+			while((target = target_next(&iter)) != NULL) {
+				rule = target->rule;
+				if((rule == NULL) || rule->add)
+					continue;
+
+				if(cnt == max)
+					list = realloc(list, (max *= 2) * sizeof(struct rule_t *));
+
+				rule->add = true;
+				list[cnt++] = rule;
+			}
+		}
+
+		for(nmk = 0, i = 0; i < cnt; i++)
+			nmk += list[i]->nmk;
+
+		mk = malloc(nmk * sizeof(const char *));
+
+		for(nmk = 0, i = 0; i < cnt; i++) {
+			for(k = 0; k < list[i]->nmk; k++)
+				mk[nmk++] = list[i]->mk[k];
+
+			list[i]->nmk = 0;
+		}
+
+		mk_load(ctx, mk, nmk, false);
+		free(mk);
+	} while(nmk > 0);
+
+	for(i = 0; i < cnt; i++)
+		list[i]->add = false;
+
+	free(list);
+}
+
+/**
+ * Compute the stem length of a path, excluding the extension.
+ *   @path: The path.
+ *   &returns: The stem length.
+ */
+uint32_t mk_stem(const char *path)
+{
+	const char *dot;
+
+	dot = strrchr(path, '.');
+	if((dot == NULL) || (dot == path) || (strchr(dot, '/') != NULL) || (dot[-1] == '/'))
+		return strlen(path);
+
+	return dot - path;
+}
+
+/**
+ * Hash a path stem.
+ *   @path: The path.
+ *   @len: The stem length.
+ *   &returns: The hash.
+ */
+uint32_t mk_hash(const char *path, uint32_t len)
+{
+	uint32_t i, hash = 2166136261u;
+
+	for(i = 0; i < len; i++)
+		hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+
+	return hash;
+}
+
+/**
+ * Build the owner table from the generated targets of every rule, skipping
+ * the makedep files themselves. Stems generated by more than one rule are
+ * kept with a null rule.
+ *   @own: The owner table.
+ *   @ctx: The context.
+ */
+void mk_own(struct mk_own_t *own, struct rt_ctx_t *ctx)
+{
+	uint32_t i, len, n = 0;
+	struct rule_t *rule;
+	struct target_t *target;
+	struct rule_iter_t irule;
+	struct target_iter_t iter;
+
+	irule = rule_iter(ctx->rules);
+	while((rule = rule_next(&irule)) != NULL) {
+		iter = target_iter(rule->gens);
+		while(target_next(&iter) != NULL)
+			n++;
+	}
+
+	for(own->mask = 255; own->mask < 2 * n; own->mask = 2 * own->mask + 1);
+	own->ent = calloc(own->mask + 1, sizeof(struct mk_stem_t));
+
+	irule = rule_iter(ctx->rules);
+	while((rule = rule_next(&irule)) != NULL) {
+		iter = target_iter(rule->gens);
+		while((target = target_next(&iter)) != NULL) {
+			if(target->flags & (FLAG_SPEC | FLAG_MKDEP))
+				continue;
+
+			len = mk_stem(target->path);
+			for(i = mk_hash(target->path, len) & own->mask; own->ent[i].path != NULL; i = (i + 1) & own->mask) {
+				if((own->ent[i].len == len) && (memcmp(own->ent[i].path, target->path, len) == 0))
+					break;
+			}
+
+			if(own->ent[i].path == NULL)
+				own->ent[i] = (struct mk_stem_t){ target->path, len, rule };
+			else if(own->ent[i].rule != rule)
+				own->ent[i].rule = NULL;
+		}
+	}
+}
+
+/**
+ * Find the owner of a makedep file by its stem.
+ *   @own: The owner table.
+ *   @path: The makedep path.
+ *   &returns: The owning rule or null.
+ */
+struct rule_t *mk_find(struct mk_own_t *own, const char *path)
+{
+	uint32_t i, len;
+
+	len = mk_stem(path);
+	for(i = mk_hash(path, len) & own->mask; own->ent[i].path != NULL; i = (i + 1) & own->mask) {
+		if((own->ent[i].len == len) && (memcmp(own->ent[i].path, path, len) == 0))
+			return own->ent[i].rule;
+	}
+
+	return NULL;
+}
+
+/**
+ * Resolve the parsed rules of a file into targets, replacing its cache
+ * record.
+ *   @file: The parsed file.
+ *   @tab: The target table.
+ *   @ctx: The context.
+ */
+void mk_fill(struct mk_file_t *file, struct mk_tab_t *tab, struct rt_ctx_t *ctx)
+{
+	uint32_t i, n = 0;
+	const char *str;
+	struct mk_rec_t *rec = file->rec;
+
+	mk_drop(ctx->mkc, rec);
+
+	for(i = 0; i < file->ncnt; i++)
+		n += file->cnt[i];
+
+	rec->tgt = malloc(n * sizeof(struct target_t *));
+	for(i = 0, str = file->buf.str; i < n; i++, str += strlen(str) + 1)
+		rec->tgt[i] = mk_target(tab, ctx, str);
 
-		mk_trim(file, &ch);
-		if(ch != ':') {
-			fprintf(stderr, "%s: Invalid makedep file.\n", path);
+	rec->cnt = file->cnt;
+	rec->ncnt = file->ncnt;
+	rec->size = file->size;
+	rec->mtime = digest_racy(file->mtime) ? INT64_MIN : file->mtime;
+	file->cnt = NULL;
+	ctx->mkc->dirty = true;
+}
+
+/**
+ * Add the rules of a cache record to the context.
+ *   @rec: The record.
+ *   @ctx: The context.
+ */
+void mk_apply(struct mk_rec_t *rec, struct rt_ctx_t *ctx)
+{
+	uint32_t i, j, k, cnt;
+	struct mk_cache_t *cache = ctx->mkc;
+	struct target_list_t *list[2];
+
+	for(i = k = 0; i < rec->ncnt; i += 2) {
+		for(j = 0; j < 2; j++) {
+			list[j] = target_list_new(ctx->arena);
 
-			if(strict)
-				exit(1);
+			for(cnt = rec->cnt[i + j]; cnt > 0; cnt--, k++) {
+				if(rec->tgt != NULL)
+					target_list_add(ctx->arena, list[j], rec->tgt[k]);
+				else {
+					if(cache->tgt[rec->ref[k]] == NULL)
+						cache->tgt[rec->ref[k]] = ctx_target(ctx, false, cache->path[rec->ref[k]]);
 
-			goto clean;
+					target_list_add(ctx->arena, list[j], cache->tgt[rec->ref[k]]);
+				}
+			}
 		}
 
-		ch = fgetc(file);
-		mk_trim(file, &ch);
+		ctx_deps(ctx, list[0], list[1]);
+	}
+}
 
-		while((str = mk_str(file, &ch)) != NULL) {
-			target_list_add(deps, ctx_target(ctx, false, str));
-			free(str);
+/**
+ * Retrieve the cache record of a makedep file, adding an empty one as needed.
+ *   @cache: The cache.
+ *   @path: The path.
+ *   &returns: The record.
+ */
+struct mk_rec_t *mk_get(struct mk_cache_t *cache, const char *path)
+{
+	uint32_t i, k;
+	struct mk_rec_t *rec, **old;
+
+	for(i = hash64(0, path) & cache->mask; cache->tab[i] != NULL; i = (i + 1) & cache->mask) {
+		if(strcmp(cache->tab[i]->path, path) == 0)
+			return cache->tab[i];
+	}
+
+	rec = malloc(sizeof(struct mk_rec_t));
+	*rec = (struct mk_rec_t){ path, -1, 0, NULL, 0, NULL, NULL };
+	cache->tab[i] = rec;
+
+	if((2 * ++cache->cnt) > (cache->mask + 1)) {
+		old = cache->tab;
+		cache->mask = 2 * cache->mask + 1;
+		cache->tab = calloc(cache->mask + 1, sizeof(struct mk_rec_t *));
+
+		for(k = 0; k <= (cache->mask / 2); k++) {
+			if(old[k] == NULL)
+				continue;
+
+			for(i = hash64(0, old[k]->path) & cache->mask; cache->tab[i] != NULL; i = (i + 1) & cache->mask);
+			cache->tab[i] = old[k];
 		}
 
-		ctx_rule(ctx, NULL, gens, deps);
-		gens = target_list_new();
-		deps = target_list_new();
+		free(old);
+	}
+
+	return rec;
+}
+
+/**
+ * Empty a cache record.
+ *   @cache: The cache.
+ *   @rec: The record.
+ */
+void mk_drop(struct mk_cache_t *cache, struct mk_rec_t *rec)
+{
+	if(rec->size >= 0)
+		cache->dirty = true;
+
+	if(rec->tgt != NULL) {
+		free(rec->tgt);
+		free((uint32_t *)rec->cnt);
 	}
 
-clean:
-	target_list_delete(gens);
-	target_list_delete(deps);
-	fclose(file);
+	*rec = (struct mk_rec_t){ rec->path, -1, 0, NULL, 0, NULL, NULL };
 }
 
 
 /**
- * Trim whitespace.
+ * Create an empty makedep cache.
+ *   &returns: The cache.
+ */
+struct mk_cache_t *mk_cache_new(void)
+{
+	struct mk_cache_t *cache;
+
+	cache = malloc(sizeof(struct mk_cache_t));
+	cache->mask = 255;
+	cache->cnt = 0;
+	cache->tab = calloc(cache->mask + 1, sizeof(struct mk_rec_t *));
+	cache->path = NULL;
+	cache->tgt = NULL;
+	cache->npath = 0;
+	cache->dirty = false;
+
+	return cache;
+}
+
+/**
+ * Delete a makedep cache.
+ *   @cache: The cache.
+ */
+void mk_cache_delete(struct mk_cache_t *cache)
+{
+	uint32_t i;
+
+	for(i = 0; i <= cache->mask; i++) {
+		if(cache->tab[i] == NULL)
+			continue;
+
+		mk_drop(cache, cache->tab[i]);
+		free(cache->tab[i]);
+	}
+
+	free(cache->tab);
+	free(cache->path);
+	free(cache->tgt);
+	free(cache);
+}
+
+/**
+ * Check if a makedep cache has records that are not yet written.
+ *   @cache: The cache.
+ *   &returns: True if changed.
+ */
+bool mk_cache_dirty(const struct mk_cache_t *cache)
+{
+	return cache->dirty;
+}
+
+/**
+ * Load the records of a makedep cache section. The records reference the
+ * section, which must outlive the cache. Invalid sections are ignored.
+ *   @cache: The empty cache.
+ *   @ptr: The section.
+ *   @len: The section length.
+ *   &returns: True if any record was loaded.
+ */
+bool mk_cache_load(struct mk_cache_t *cache, const void *ptr, size_t len)
+{
+	uint32_t i, n, end;
+	const char *str;
+	const uint32_t *word;
+	struct mk_rec_t *rec;
+	const struct mk_ent_t *ent;
+	const struct mk_hdr_t *hdr = ptr;
+
+	if(len < sizeof(struct mk_hdr_t))
+		return false;
+
+	ent = (const struct mk_ent_t *)(hdr + 1);
+	word = (const uint32_t *)(ent + hdr->nrec);
+	str = (const char *)word + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7);
+
+	if((sizeof(struct mk_hdr_t) + (uint64_t)hdr->nrec * sizeof(struct mk_ent_t) + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7) + hdr->nstr) != len)
+		return false;
+	else if((hdr->nrec == 0) || (hdr->nstr == 0) || (str[hdr->nstr - 1] != '\0'))
+		return false;
+	else if(digest_buf(hdr + 1, len - sizeof(struct mk_hdr_t)) != hdr->hash)
+		return false;
+
+	for(i = n = 0; i < hdr->nstr; i += strlen(str + i) + 1)
+		n++;
+
+	cache->path = malloc(n * sizeof(const char *));
+	cache->tgt = calloc(n, sizeof(struct target_t *));
+	cache->npath = n;
+
+	for(i = n = 0; i < hdr->nstr; i += strlen(str + i) + 1)
+		cache->path[n++] = str + i;
+
+	for(i = 0; i < hdr->nrec; i++) {
+		end = ((i + 1) < hdr->nrec) ? ent[i + 1].word : hdr->nword;
+		if((end > hdr->nword) || !mk_check(&ent[i], word, end, cache->npath))
+			continue;
+
+		rec = mk_get(cache, cache->path[ent[i].path]);
+		n = word[ent[i].word];
+		*rec = (struct mk_rec_t){ rec->path, ent[i].size, ent[i].mtime, word + ent[i].word + 1, n, word + ent[i].word + 1 + n, NULL };
+	}
+
+	return true;
+}
+
+/**
+ * Check that a cache entry is well formed.
+ *   @ent: The entry.
+ *   @word: The word stream.
+ *   @end: The end of the entry rules.
+ *   @npath: The number of paths.
+ *   &returns: True if valid.
+ */
+bool mk_check(const struct mk_ent_t *ent, const uint32_t *word, uint32_t end, uint32_t npath)
+{
+	uint32_t i, ncnt;
+	uint64_t n = 0;
+
+	if((ent->path >= npath) || (ent->word >= end))
+		return false;
+
+	ncnt = word[ent->word];
+	if(((ncnt % 2) != 0) || (ncnt > (end - ent->word - 1)))
+		return false;
+
+	for(i = 0; i < ncnt; i++)
+		n += word[ent->word + 1 + i];
+
+	if(n != (end - ent->word - 1 - ncnt))
+		return false;
+
+	for(i = ent->word + 1 + ncnt; i < end; i++) {
+		if(word[i] >= npath)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Write the records of a makedep cache as a section.
+ *   @cache: The cache.
  *   @file: The file.
- *   @ch: The character reference.
  */
-void mk_trim(FILE *file, int *ch)
+void mk_cache_write(struct mk_cache_t *cache, FILE *file)
+{
+	char *body;
+	size_t len;
+	uint32_t i, k, n, end, *idx, *word, nword = 0, maxword = 1024, nrec = 0;
+	struct mk_rec_t *rec;
+	struct mk_ent_t *ent;
+	struct mk_hdr_t hdr;
+	struct graph_wr_t wr;
+
+	wr.str = malloc(4096);
+	wr.nstr = 0;
+	wr.maxstr = 4096;
+	wr.smask = 1023;
+	wr.scnt = 0;
+	wr.stab = calloc(wr.smask + 1, sizeof(uint32_t));
+
+	ent = malloc(cache->cnt * sizeof(struct mk_ent_t));
+	word = malloc(maxword * sizeof(uint32_t));
+
+	for(i = 0; i <= cache->mask; i++) {
+		rec = cache->tab[i];
+		if((rec == NULL) || (rec->size < 0))
+			continue;
+
+		for(n = k = 0; k < rec->ncnt; k++)
+			n += rec->cnt[k];
+
+		while((nword + 2 + rec->ncnt + n) > maxword)
+			word = realloc(word, (maxword *= 2) * sizeof(uint32_t));
+
+		ent[nrec++] = (struct mk_ent_t){ rec->size, rec->mtime, graph_intern(&wr, rec->path), nword };
+		word[nword++] = rec->ncnt;
+		memcpy(word + nword, rec->cnt, rec->ncnt * sizeof(uint32_t));
+		nword += rec->ncnt;
+
+		for(k = 0; k < n; k++)
+			word[nword++] = graph_intern(&wr, (rec->tgt != NULL) ? rec->tgt[k]->path : cache->path[rec->ref[k]]);
+	}
+
+	/* replace string offsets with string indices */
+	idx = malloc(wr.nstr * sizeof(uint32_t));
+	for(i = n = 0; i < wr.nstr; i += strlen(wr.str + i) + 1)
+		idx[i] = n++;
+
+	for(i = 0; i < nrec; i++) {
+		end = ((i + 1) < nrec) ? ent[i + 1].word : nword;
+		for(k = ent[i].word + 1 + word[ent[i].word]; k < end; k++)
+			word[k] = idx[word[k]];
+
+		ent[i].path = idx[ent[i].path];
+	}
+
+	hdr.nrec = nrec;
+	hdr.nword = nword;
+	hdr.nstr = wr.nstr;
+
+	if(nword % 2)
+		word[nword++] = 0;
+
+	len = nrec * sizeof(struct mk_ent_t) + nword * sizeof(uint32_t) + wr.nstr;
+	body = malloc(len);
+	memcpy(body, ent, nrec * sizeof(struct mk_ent_t));
+	memcpy(body + nrec * sizeof(struct mk_ent_t), word, nword * sizeof(uint32_t));
+	memcpy(body + len - wr.nstr, wr.str, wr.nstr);
+	hdr.hash = digest_buf(body, len);
+
+	fwrite(&hdr, sizeof(hdr), 1, file);
+	fwrite(body, 1, len, file);
+	cache->dirty = false;
+
+	free(body);
+	free(idx);
+	free(ent);
+	free(word);
+	free(wr.str);
+	free(wr.stab);
+}
+
+
+/**
+ * Retrieve the target of a path through the target table.
+ *   @tab: The target table.
+ *   @ctx: The context.
+ *   @path: The path.
+ *   &returns: The target.
+ */
+struct target_t *mk_target(struct mk_tab_t *tab, struct rt_ctx_t *ctx, const char *path)
+{
+	uint32_t i, k;
+	struct target_t *target, **old;
+
+	for(i = hash64(0, path) & tab->mask; tab->ent[i] != NULL; i = (i + 1) & tab->mask) {
+		if(strcmp(tab->ent[i]->path, path) == 0)
+			return tab->ent[i];
+	}
+
+	target = ctx_target(ctx, false, path);
+	if(strcmp(target->path, path) != 0)
+		return target;
+
+	tab->ent[i] = target;
+	if((2 * ++tab->cnt) > (tab->mask + 1)) {
+		old = tab->ent;
+		tab->mask = 2 * tab->mask + 1;
+		tab->ent = calloc(tab->mask + 1, sizeof(struct target_t *));
+
+		for(k = 0; k <= (tab->mask / 2); k++) {
+			if(old[k] == NULL)
+				continue;
+
+			for(i = hash64(0, old[k]->path) & tab->mask; tab->ent[i] != NULL; i = (i + 1) & tab->mask);
+			tab->ent[i] = old[k];
+		}
+
+		free(old);
+	}
+
+	return target;
+}
+
+/**
+ * Parse a make dependency file into its buffered rules.
+ *   @arg: The file array.
+ *   @idx: The file index.
+ */
+void mk_proc(void *arg, uint32_t idx)
 {
+	void *map;
+	size_t len;
+	uint32_t cnt[2];
+	const char *ptr, *end;
+	struct mk_file_t *file = (struct mk_file_t *)arg + idx;
+
+	file->found = os_stat(file->path, &file->size, &file->mtime);
+	if(!file->found)
+		return;
+	else if((file->rec->size == file->size) && (file->rec->mtime == file->mtime)) {
+		file->hit = true;
+		return;
+	}
+
+	map = os_map(file->path, &len);
+	if(map == NULL)
+		return;
+
+	ptr = map;
+	end = ptr + len;
+
 	for(;;) {
-		while(mk_space(*ch))
-			*ch = fgetc(file);
+		while((ptr < end) && (mk_space(*ptr) || (*ptr == '\n')))
+			ptr++;
 
-		if(*ch != '\\')
+		if(ptr == end)
 			break;
 
-		if((*ch = fgetc(file)) != '\n')
+		cnt[0] = cnt[1] = 0;
+		while(mk_str(&ptr, end, &file->buf))
+			cnt[0]++;
+
+		mk_trim(&ptr, end);
+		if((ptr == end) || (*ptr != ':')) {
+			file->err = true;
 			break;
+		}
 
-		*ch = fgetc(file);
+		ptr++;
+		mk_trim(&ptr, end);
+
+		while(mk_str(&ptr, end, &file->buf))
+			cnt[1]++;
+
+		if((file->ncnt + 2) > file->maxcnt)
+			file->cnt = realloc(file->cnt, (file->maxcnt *= 2) * sizeof(uint32_t));
+
+		file->cnt[file->ncnt++] = cnt[0];
+		file->cnt[file->ncnt++] = cnt[1];
 	}
+
+	os_unmap(map, len);
 }
 
+
 /**
- * Parse a string.
- *   @file: The file.
- *   @ch: The character reference.
- *   &returns: The string, or null if no string.
+ * Trim whitespace and line continuations.
+ *   @ptr: Ref. The position.
+ *   @end: The end.
  */
-char *mk_str(FILE *file, int *ch)
+void mk_trim(const char **ptr, const char *end)
 {
-	struct buf_t buf;
+	for(;;) {
+		while((*ptr < end) && mk_space(**ptr))
+			(*ptr)++;
+
+		if((*ptr == end) || (**ptr != '\\'))
+			break;
+
+		if((++*ptr == end) || (**ptr != '\n'))
+			break;
 
-	mk_trim(file, ch);
+		(*ptr)++;
+	}
+}
+
+/**
+ * Parse a string, appending it to a buffer.
+ *   @ptr: Ref. The position.
+ *   @end: The end.
+ *   @buf: The buffer.
+ *   &returns: True if a string was parsed.
+ */
+bool mk_str(const char **ptr, const char *end, struct buf_t *buf)
+{
+	const char *str;
 
-	if(!mk_ident(*ch))
-		return NULL;
+	mk_trim(ptr, end);
 
-	buf = buf_new(32);
+	if((*ptr == end) || !mk_ident((unsigned char)**ptr))
+		return false;
 
-	do
-		buf_ch(&buf, *ch);
-	while(mk_ident(*ch = fgetc(file)));
+	str = *ptr;
+	*ptr = str_stop(str, end, " \t\r\n:");
+	buf_mem(buf, str, *ptr - str);
+	buf_ch(buf, '\0');
 
-	return buf_done(&buf);
+	return true;
 }
 
 
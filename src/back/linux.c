@@ -64,66 +64,244 @@ void unreachable(void)
 }
 
 #include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 
+/**
+ * Process structure.
+ *   @pid: The process identifier, zero once reaped.
+ *   @fd: The process file descriptor, negative if tracked through `SIGCHLD`.
+ */
+struct os_proc_t {
+	pid_t pid;
+	int fd;
+};
+
+/**
+ * Job slot structure.
+ *   @proc: The process array.
+ *   @len, run: The number of processes and running processes.
+ *   @fd: The output and error capture pipes, negative once closed.
+ *   @stat: The first failing status.
+ *   @out: The captured output and error.
+ */
+struct os_slot_t {
+	struct os_proc_t *proc;
+	uint32_t len, run;
+
+	int fd[2], stat;
+	struct buf_t out[2];
+};
+
+/*
+ * event definitions
+ */
+#define OS_PROC 1ull
+#define OS_OUT  2ull
+#define OS_SIG  3ull
+#define OS_EVENT(kind, id, idx) (((kind) << 62) | ((uint64_t)(id) << 32) | (uint64_t)(idx))
+
+/*
+ * kill definitions
+ */
+#define OS_GRACE 2000000
+
+/*
+ * backend variables
+ */
+int os_epoll = -1, os_sigfd = -1;
+sigset_t os_sigset;
+bool os_pidfd = true;
+struct os_slot_t *os_slot = NULL;
+uint32_t os_nslot = 0, *os_done = NULL, os_ndone = 0;
+
+/*
+ * backend declarations
+ */
+struct os_slot_t *os_get(uint32_t id);
+void os_watch(int fd, uint64_t data);
+void os_event(uint64_t data);
+void os_reap(uint32_t id, struct os_proc_t *proc, int stat);
+void os_chld(void);
+void os_kill(int sig) __attribute__((noreturn));
+
+
+/**
+ * Ring structure.
+ *   @fd: The ring descriptor, `-2` if not yet initialized and `-1` if
+ *     unavailable.
+ *   @ents: The number of submission entries.
+ *   @sq_tail, sq_mask, sq_array: The submission ring.
+ *   @cq_head, cq_tail, cq_mask: The completion ring.
+ *   @sqe: The submission entries.
+ *   @cqe: The completion entries.
+ */
+struct os_ring_t {
+	int fd;
+	uint32_t ents;
+
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+};
+
+/*
+ * ring definitions
+ */
+#define OS_RING 256
+
+/*
+ * ring variables
+ */
+struct os_ring_t os_ring = { -2 };
+
+/*
+ * ring declarations
+ */
+bool os_ring_init(void);
+bool os_ring_op(struct io_uring_probe *probe, int op);
+struct io_uring_sqe *os_ring_get(uint32_t i);
+void os_ring_run(uint32_t n, int *res);
+
+
+/**
+ * Stat batch structure.
+ *   @path: The path array.
+ *   @mtime: The modification time array.
+ */
+struct os_stat_t {
+	const char **path;
+	int64_t *mtime;
+};
+
+/*
+ * stat declarations
+ */
+void os_mtimes_proc(void *arg, uint32_t idx);
+
+
 /**
  * Initialize the OS backend.
  */
 void os_init(void)
 {
 	setlinebuf(stdout);
-}
 
-struct os_job_t {
-	int *pid;
+	os_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if(os_epoll < 0)
+		fatal("Failed to create event poll. %s.", strerror(errno));
 
-	uint32_t len;
-};
+	sigemptyset(&os_sigset);
+	sigaddset(&os_sigset, SIGINT);
+	sigaddset(&os_sigset, SIGTERM);
+	sigaddset(&os_sigset, SIGHUP);
+}
 
 /**
- * Execute a command based off of a value.
+ * Execute a command based off of a value. Every process in the pipeline is
+ * tracked by a process file descriptor, or through `SIGCHLD` on the signal
+ * descriptor when the kernel does not provide them. The standard output of the last
+ * process and the standard error of every process are captured separately,
+ * so each is written to the matching stream once the command completes.
  *   @cmd: The command.
+ *   @id: The job slot identifier.
  */
-int os_exec(struct cmd_t *cmd)
+void os_exec(struct cmd_t *cmd, uint32_t id)
 {
 	uint32_t i, n;
 	char **args;
 	struct val_t *val;
 	struct rt_pipe_t *iter;
+	struct os_slot_t *slot;
 	pid_t pid = 0;
-	int in = -1, out = -1, pair[2];
+	int fd, in = -1, out = -1, pair[2], cap[2][2], redir[2] = { -1, -1 };
+
+	if(os_sigfd < 0) {
+		fd = syscall(SYS_pidfd_open, getpid(), 0);
+		if(fd >= 0)
+			close(fd);
+		else {
+			os_pidfd = false;
+			sigaddset(&os_sigset, SIGCHLD);
+		}
+
+		sigprocmask(SIG_BLOCK, &os_sigset, NULL);
+
+		os_sigfd = signalfd(-1, &os_sigset, SFD_CLOEXEC | SFD_NONBLOCK);
+		if(os_sigfd < 0)
+			fatal("Failed to create signal descriptor. %s.", strerror(errno));
+
+		os_watch(os_sigfd, OS_EVENT(OS_SIG, 0, 0));
+	}
+
+	slot = os_get(id);
+	slot->len = slot->run = 0;
+	slot->stat = 0;
+
+	for(i = 0; i < 2; i++) {
+		if(pipe2(cap[i], O_CLOEXEC) < 0)
+			fatal("Cannot create pipe. %s.", strerror(errno));
+
+		fcntl(cap[i][0], F_SETFL, O_NONBLOCK);
+		slot->fd[i] = cap[i][0];
+		os_watch(cap[i][0], OS_EVENT(OS_OUT, id, i));
+	}
+
+	if(cmd->in && cmd->out) {
+		const char *path[2] = { cmd->in, cmd->out };
+		int flags[2] = { O_RDONLY | O_CLOEXEC, O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->append ? O_APPEND : O_TRUNC) };
+
+		os_open(path, flags, redir, 2);
+	}
+	else if(cmd->in)
+		redir[0] = open(cmd->in, O_RDONLY | O_CLOEXEC);
+	else if(cmd->out)
+		redir[1] = open(cmd->out, O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->append ? O_APPEND : O_TRUNC), 0644);
+
+	if(cmd->in && (redir[0] < 0))
+		fatal("Cannot open '%s' for reading. %s.", cmd->in, strerror(errno));
+
+	if(cmd->out && (redir[1] < 0))
+		fatal("Cannot open '%s' for writing . %s.", cmd->out, strerror(errno));
 
 	for(iter = cmd->pipe; iter != NULL; iter = iter->next) {
 		val = iter->cmd;
 
 		n = val_len(val);
 		args = malloc(sizeof(void *) * (n + 1));
-		for(i = 0; i < n; i++) {
-			args[i] = strdup(val->str);
-			val = val->next;
-		}
+		for(i = 0; i < n; i++)
+			args[i] = strdup(val_get(val, i));
+
 		args[n] = NULL;
 
-		if(cmd->in && (iter == cmd->pipe)) {
-			in = open(cmd->in, O_RDONLY);
-			if(in < 0)
-				fatal("Cannot open '%s' for reading. %s.", in, strerror(errno));
-		}
+		if(cmd->in && (iter == cmd->pipe))
+			in = redir[0];
 		else if(iter != cmd->pipe)
 			in = pair[0];
 		else
 			in = -1;
 
-		if(cmd->out && (iter->next == NULL)) {
-			out = open(cmd->out, O_WRONLY | O_CREAT | (cmd->append ? O_APPEND : O_TRUNC), 0644);
-			if(out < 0)
-				fatal("Cannot open '%s' for writing . %s.", out, strerror(errno));
-		}
+		if(cmd->out && (iter->next == NULL))
+			out = redir[1];
 		else if(iter->next != NULL) {
-			if(pipe(pair) < 0)
+			if(pipe2(pair, O_CLOEXEC) < 0)
 				fatal("Cannot create pipe. %s.", strerror(errno));
 
 			out = pair[1];
@@ -133,19 +311,34 @@ int os_exec(struct cmd_t *cmd)
 
 		pid = vfork();
 		if(pid == 0) {
-			if(in >= 0) {
+			sigprocmask(SIG_UNBLOCK, &os_sigset, NULL);
+
+			if(in >= 0)
 				dup2(in, STDIN_FILENO);
-				close(in);
-			}
 
-			if(out >= 0) {
-				dup2(out, STDOUT_FILENO);
-				close(out);
-			}
+			dup2((out >= 0) ? out : cap[0][1], STDOUT_FILENO);
+			dup2(cap[1][1], STDERR_FILENO);
 
 			execvp(args[0], args);
+			_exit(127);
+		}
+		else if(pid < 0)
+			fatal("Failed to start process. %s.", strerror(errno));
+
+		fd = -1;
+		if(os_pidfd) {
+			fd = syscall(SYS_pidfd_open, pid, 0);
+			if(fd < 0)
+				fatal("Failed to track process. %s.", strerror(errno));
+
+			os_watch(fd, OS_EVENT(OS_PROC, id, slot->len));
 		}
 
+		slot->proc = realloc(slot->proc, (slot->len + 1) * sizeof(struct os_proc_t));
+		slot->proc[slot->len] = (struct os_proc_t){ pid, fd };
+		slot->len++;
+		slot->run++;
+
 		if(in >= 0)
 			close(in);
 
@@ -158,33 +351,251 @@ int os_exec(struct cmd_t *cmd)
 		free(args);
 	}
 
-	return pid;
+	close(cap[0][1]);
+	close(cap[1][1]);
 }
 
 /**
- * Wait for a child to exit.
+ * Wait for a command to complete, writing its captured output.
+ *   @block: Block until a command completes.
+ *   @id: Out. The job slot identifier.
+ *   @stat: Out. The exit status, or the negated signal number.
+ *   &returns: True if a command completed.
  */
-int os_wait(void)
+bool os_wait(bool block, uint32_t *id, int *stat)
 {
-	int pid, stat;
-
-	for(;;) {
-		pid = wait(&stat);
-		if(WIFSIGNALED(stat))
-			fatal("Command failed with signal '%d'.", WTERMSIG(stat));
+	int i, n;
+	struct os_slot_t *slot;
+	struct epoll_event ev[16];
 
-		if(pid >= 0)
-			break;
+	while(os_ndone == 0) {
+		n = epoll_wait(os_epoll, ev, 16, block ? -1 : 0);
+		if(n < 0) {
+			if(errno == EINTR)
+				continue;
 
-		if(errno != EINTR)
 			fatal("Failed to wait. %s.", strerror(errno));
+		}
+		else if(n == 0)
+			return false;
+
+		for(i = 0; i < n; i++)
+			os_event(ev[i].data.u64);
 	}
 
-	stat = WEXITSTATUS(stat);
-	if(stat != 0)
-		fatal("Command terminated with status %d.", stat);
+	*id = os_done[--os_ndone];
+	slot = &os_slot[*id];
+	*stat = slot->stat;
 
-	return pid;
+	fwrite(slot->out[0].str, 1, slot->out[0].len, stdout);
+	fwrite(slot->out[1].str, 1, slot->out[1].len, stderr);
+	slot->out[0].len = slot->out[1].len = 0;
+
+	return true;
+}
+
+
+/**
+ * Retrieve a job slot, allocating as needed.
+ *   @id: The job slot identifier.
+ *   &returns: The slot.
+ */
+struct os_slot_t *os_get(uint32_t id)
+{
+	if(id >= os_nslot) {
+		os_slot = realloc(os_slot, (id + 1) * sizeof(struct os_slot_t));
+		os_done = realloc(os_done, (id + 1) * sizeof(uint32_t));
+
+		while(os_nslot <= id)
+			os_slot[os_nslot++] = (struct os_slot_t){ NULL, 0, 0, { -1, -1 }, 0, { buf_new(256), buf_new(256) } };
+	}
+
+	return &os_slot[id];
+}
+
+/**
+ * Watch a file descriptor for input.
+ *   @fd: The file descriptor.
+ *   @data: The event data.
+ */
+void os_watch(int fd, uint64_t data)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = data;
+
+	if(epoll_ctl(os_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+		fatal("Failed to watch descriptor. %s.", strerror(errno));
+}
+
+/**
+ * Handle a single event.
+ *   @data: The event data.
+ */
+void os_event(uint64_t data)
+{
+	int stat, *fd;
+	ssize_t len;
+	uint32_t id;
+	struct buf_t *buf;
+	struct os_proc_t *proc;
+	struct os_slot_t *slot;
+	struct signalfd_siginfo info;
+
+	if((data >> 62) == OS_SIG) {
+		while(read(os_sigfd, &info, sizeof(info)) == sizeof(info)) {
+			if(info.ssi_signo != SIGCHLD)
+				os_kill(info.ssi_signo);
+		}
+
+		os_chld();
+
+		return;
+	}
+
+	id = (data >> 32) & 0x3FFFFFFF;
+	slot = &os_slot[id];
+
+	if((data >> 62) == OS_PROC) {
+		proc = &slot->proc[(uint32_t)data];
+
+		while(waitpid(proc->pid, &stat, 0) < 0) {
+			if(errno != EINTR)
+				fatal("Failed to wait. %s.", strerror(errno));
+		}
+
+		os_reap(id, proc, stat);
+	}
+	else {
+		fd = &slot->fd[(uint32_t)data];
+		buf = &slot->out[(uint32_t)data];
+
+		for(;;) {
+			if((buf->max - buf->len) < 256)
+				buf->str = realloc(buf->str, buf->max *= 2);
+
+			len = read(*fd, buf->str + buf->len, buf->max - buf->len);
+			if(len > 0)
+				buf->len += len;
+			else if((len == 0) || ((errno != EINTR) && (errno != EAGAIN)))
+				break;
+			else if(errno == EAGAIN)
+				return;
+		}
+
+		epoll_ctl(os_epoll, EPOLL_CTL_DEL, *fd, NULL);
+		close(*fd);
+		*fd = -1;
+
+		if((slot->run == 0) && (slot->fd[1 - (uint32_t)data] < 0))
+			os_done[os_ndone++] = id;
+	}
+}
+
+/**
+ * Record a reaped process, completing its slot once nothing is left to read.
+ *   @id: The job slot identifier.
+ *   @proc: The process.
+ *   @stat: The wait status.
+ */
+void os_reap(uint32_t id, struct os_proc_t *proc, int stat)
+{
+	struct os_slot_t *slot = &os_slot[id];
+
+	if(proc->fd >= 0) {
+		epoll_ctl(os_epoll, EPOLL_CTL_DEL, proc->fd, NULL);
+		close(proc->fd);
+		proc->fd = -1;
+	}
+
+	proc->pid = 0;
+	slot->run--;
+
+	if(slot->stat == 0)
+		slot->stat = WIFSIGNALED(stat) ? -WTERMSIG(stat) : WEXITSTATUS(stat);
+
+	if((slot->run == 0) && (slot->fd[0] < 0) && (slot->fd[1] < 0))
+		os_done[os_ndone++] = id;
+}
+
+/**
+ * Reap every exited process that is tracked through `SIGCHLD`. Signals
+ * coalesce, so each running process is polled.
+ */
+void os_chld(void)
+{
+	int stat;
+	uint32_t i, k;
+	struct os_proc_t *proc;
+
+	for(i = 0; i < os_nslot; i++) {
+		for(k = 0; k < os_slot[i].len; k++) {
+			proc = &os_slot[i].proc[k];
+			if((proc->pid > 0) && (proc->fd < 0) && (waitpid(proc->pid, &stat, WNOHANG) > 0))
+				os_reap(i, proc, stat);
+		}
+	}
+}
+
+/**
+ * Terminate all running processes and exit with a signal. Every process is
+ * signaled before any is reaped, and those still running after a grace
+ * period are killed.
+ *   @sig: The signal.
+ *   &noreturn
+ */
+void os_kill(int sig)
+{
+	uint32_t i, k, left;
+	int64_t end;
+	struct os_proc_t *proc;
+
+	for(i = 0; i < os_nslot; i++) {
+		for(k = 0; k < os_slot[i].len; k++) {
+			proc = &os_slot[i].proc[k];
+			if(proc->pid <= 0)
+				continue;
+
+			if(proc->fd >= 0)
+				syscall(SYS_pidfd_send_signal, proc->fd, sig, NULL, 0);
+			else
+				kill(proc->pid, sig);
+		}
+	}
+
+	end = os_time() + OS_GRACE;
+
+	do {
+		left = 0;
+
+		for(i = 0; i < os_nslot; i++) {
+			for(k = 0; k < os_slot[i].len; k++) {
+				proc = &os_slot[i].proc[k];
+				if(proc->pid <= 0)
+					continue;
+
+				if(waitpid(proc->pid, NULL, WNOHANG) != 0)
+					proc->pid = 0;
+				else if(os_time() < end)
+					left++;
+				else {
+					kill(proc->pid, SIGKILL);
+					waitpid(proc->pid, NULL, 0);
+					proc->pid = 0;
+				}
+			}
+		}
+
+		if(left > 0)
+			usleep(10000);
+	} while(left > 0);
+
+	fflush(stdout);
+	signal(sig, SIG_DFL);
+	sigprocmask(SIG_UNBLOCK, &os_sigset, NULL);
+	raise(sig);
+	exit(1);
 }
 
 /**
@@ -206,3 +617,907 @@ void os_mkdir(const char *path)
 {
 	mkdir(path, 0777);
 }
+
+/**
+ * Create every parent directory of a path, ignoring existing directories.
+ * The directories are created as a single linked batch when the ring is
+ * available.
+ *   @path: The path.
+ */
+void os_mkdirs(const char *path)
+{
+	int *res;
+	char **dir;
+	uint32_t i, n = 0;
+	const char *iter;
+	struct io_uring_sqe *sqe;
+
+	for(iter = path; (iter = strchr(iter, '/')) != NULL; iter++)
+		n++;
+
+	if(n == 0)
+		return;
+
+	dir = malloc(n * sizeof(char *));
+	for(i = 0, iter = path; (iter = strchr(iter, '/')) != NULL; iter++)
+		dir[i++] = strndup(path, iter - path);
+
+	if(os_ring_init() && (n <= os_ring.ents)) {
+		res = malloc(n * sizeof(int));
+
+		for(i = 0; i < n; i++) {
+			sqe = os_ring_get(i);
+			sqe->opcode = IORING_OP_MKDIRAT;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uintptr_t)dir[i];
+			sqe->len = 0777;
+			sqe->flags = (i + 1 < n) ? IOSQE_IO_HARDLINK : 0;
+			sqe->user_data = i;
+		}
+
+		os_ring_run(n, res);
+		free(res);
+	}
+	else {
+		for(i = 0; i < n; i++)
+			mkdir(dir[i], 0777);
+	}
+
+	for(i = 0; i < n; i++)
+		free(dir[i]);
+
+	free(dir);
+}
+
+/**
+ * Retrieve the size and modification time for a file path.
+ *   @path: The file path.
+ *   @size: Out. The size in bytes.
+ *   @mtime: Out. The modification time in microseconds.
+ *   &returns: True if the file exists.
+ */
+bool os_stat(const char *path, int64_t *size, int64_t *mtime)
+{
+	struct stat info;
+
+	if(stat(path, &info) < 0)
+		return false;
+
+	*size = info.st_size;
+	*mtime = 1000000 * info.st_mtim.tv_sec + info.st_mtim.tv_nsec / 1000;
+
+	return true;
+}
+
+/**
+ * Retrieve the identity of a file.
+ *   @path: The path.
+ *   @id: Out. The identity.
+ *   &returns: True if found, false otherwise.
+ */
+bool os_ident(const char *path, struct os_ident_t *id)
+{
+	struct stat info;
+
+	if(stat(path, &info) < 0)
+		return false;
+
+	id->dev = info.st_dev;
+	id->ino = info.st_ino;
+	id->size = info.st_size;
+	id->mtime = 1000000 * info.st_mtim.tv_sec + info.st_mtim.tv_nsec / 1000;
+
+	return true;
+}
+
+
+/**
+ * Determine the number of usable processors. The affinity mask is limited
+ * by the cgroup v2 CPU quota of the process and any of its ancestors. The
+ * processor count from `/proc/cpuinfo` is used when the affinity mask is
+ * unavailable.
+ *   &returns: The number of processors, at least one.
+ */
+uint32_t os_ncpu(void)
+{
+	FILE *file;
+	cpu_set_t set;
+	char line[4096], *dir, *end;
+	long quota, period;
+	uint32_t n = 0, lim;
+
+	if(sched_getaffinity(0, sizeof(set), &set) == 0)
+		n = CPU_COUNT(&set);
+	else if((file = fopen("/proc/cpuinfo", "r")) != NULL) {
+		while(fgets(line, sizeof(line), file) != NULL) {
+			if(strncmp(line, "processor", 9) == 0)
+				n++;
+		}
+
+		fclose(file);
+	}
+
+	if(n == 0)
+		n = 1;
+
+	file = fopen("/proc/self/cgroup", "r");
+	if(file == NULL)
+		return n;
+
+	dir = NULL;
+	while(fgets(line, sizeof(line), file) != NULL) {
+		if(strncmp(line, "0::/", 4) != 0)
+			continue;
+
+		line[strcspn(line, "\n")] = '\0';
+		dir = str_fmt("/sys/fs/cgroup%s", line + 3);
+		break;
+	}
+
+	fclose(file);
+
+	if(dir == NULL)
+		return n;
+
+	for(;;) {
+		char *path;
+
+		path = str_fmt("%s/cpu.max", dir);
+		file = fopen(path, "r");
+		free(path);
+
+		if(file != NULL) {
+			if((fscanf(file, "%ld %ld", &quota, &period) == 2) && (quota > 0) && (period > 0)) {
+				lim = (quota + period - 1) / period;
+				if(lim < n)
+					n = (lim > 0) ? lim : 1;
+			}
+
+			fclose(file);
+		}
+
+		end = strrchr(dir, '/');
+		if((end == NULL) || (end - dir) <= (ptrdiff_t)strlen("/sys/fs/cgroup"))
+			break;
+
+		*end = '\0';
+	}
+
+	free(dir);
+
+	return n;
+}
+
+/**
+ * Retrieve the current time.
+ *   &returns: The time in microseconds.
+ */
+int64_t os_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return 1000000 * (int64_t)ts.tv_sec + ts.tv_nsec / 1000;
+}
+
+/**
+ * Map a file read-only.
+ *   @path: The file path.
+ *   @len: Out. The length.
+ *   &returns: The mapping, or null if the file is missing or empty.
+ */
+void *os_map(const char *path, size_t *len)
+{
+	int fd;
+	void *ptr;
+	struct stat info;
+
+	*len = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return NULL;
+
+	if((fstat(fd, &info) < 0) || (info.st_size == 0)) {
+		close(fd);
+		return NULL;
+	}
+
+	ptr = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(ptr == MAP_FAILED)
+		return NULL;
+
+	*len = info.st_size;
+
+	return ptr;
+}
+
+/**
+ * Unmap a file.
+ *   @ptr: The mapping.
+ *   @len: The length.
+ */
+void os_unmap(void *ptr, size_t len)
+{
+	munmap(ptr, len);
+}
+
+
+/**
+ * Retrieve the modification times of a set of paths. The paths are stat'd
+ * in batches through the ring when available, or by the worker pool
+ * otherwise.
+ *   @path: The path array.
+ *   @mtime: Out. The modification times, `INT64_MIN` if missing.
+ *   @n: The number of paths.
+ */
+void os_mtimes(const char **path, int64_t *mtime, uint32_t n)
+{
+	int *res;
+	uint32_t i, k, cnt;
+	struct statx *info;
+	struct io_uring_sqe *sqe;
+	struct os_stat_t arg = { path, mtime };
+
+	if(!os_ring_init())
+		return os_par(os_mtimes_proc, &arg, n);
+
+	res = malloc(os_ring.ents * sizeof(int));
+	info = malloc(os_ring.ents * sizeof(struct statx));
+
+	for(k = 0; k < n; k += cnt) {
+		cnt = ((n - k) < os_ring.ents) ? (n - k) : os_ring.ents;
+
+		for(i = 0; i < cnt; i++) {
+			sqe = os_ring_get(i);
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uintptr_t)path[k + i];
+			sqe->len = STATX_MTIME;
+			sqe->off = (uintptr_t)&info[i];
+			sqe->user_data = i;
+		}
+
+		os_ring_run(cnt, res);
+
+		for(i = 0; i < cnt; i++)
+			mtime[k + i] = (res[i] < 0) ? INT64_MIN : (1000000 * info[i].stx_mtime.tv_sec + info[i].stx_mtime.tv_nsec / 1000);
+	}
+
+	free(res);
+	free(info);
+}
+
+/**
+ * Retrieve the modification time of a single path, called in parallel.
+ *   @arg: The stat structure.
+ *   @idx: The path index.
+ */
+void os_mtimes_proc(void *arg, uint32_t idx)
+{
+	struct os_stat_t *stat = arg;
+
+	stat->mtime[idx] = os_mtime(stat->path[idx]);
+}
+
+/**
+ * Open a set of files in order, stopping at the first failure. The files are
+ * opened as a single linked batch through the ring when available.
+ *   @path: The path array.
+ *   @flags: The open flags array.
+ *   @fd: Out. The file descriptors, negative for the failed file and every
+ *     file after it, with `errno` set from the failure.
+ *   @n: The number of files.
+ */
+void os_open(const char **path, const int *flags, int *fd, uint32_t n)
+{
+	uint32_t i;
+	struct io_uring_sqe *sqe;
+
+	if(!os_ring_init() || (n > os_ring.ents)) {
+		for(i = 0; i < n; i++)
+			fd[i] = ((i > 0) && (fd[i - 1] < 0)) ? -1 : open(path[i], flags[i], 0644);
+
+		return;
+	}
+
+	for(i = 0; i < n; i++) {
+		sqe = os_ring_get(i);
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)path[i];
+		sqe->len = 0644;
+		sqe->open_flags = flags[i];
+		sqe->flags = (i + 1 < n) ? IOSQE_IO_LINK : 0;
+		sqe->user_data = i;
+	}
+
+	os_ring_run(n, fd);
+
+	for(i = 0; i < n; i++) {
+		if(fd[i] < 0)
+			break;
+	}
+
+	if(i < n)
+		errno = -fd[i];
+
+	for(; i < n; i++) {
+		if(fd[i] >= 0)
+			close(fd[i]);
+
+		fd[i] = -1;
+	}
+}
+
+
+/**
+ * Parallel work structure.
+ *   @func: The work function.
+ *   @arg: The work argument.
+ *   @n, next: The number of items and the next unclaimed item.
+ */
+struct os_par_t {
+	void (*func)(void *arg, uint32_t idx);
+	void *arg;
+	uint32_t n, next;
+};
+
+/*
+ * parallel work variables
+ */
+uint32_t os_npar = 0;
+
+/*
+ * parallel work declarations
+ */
+void *os_par_run(void *arg);
+
+/**
+ * Run a function over a range of indices using a thread per usable
+ * processor. The calling thread participates, and the function returns once
+ * every index has been processed.
+ *   @func: The function.
+ *   @arg: The argument passed to every call.
+ *   @n: The number of indices.
+ */
+void os_par(void (*func)(void *arg, uint32_t idx), void *arg, uint32_t n)
+{
+	uint32_t i, cnt;
+	pthread_t *thread;
+	struct os_par_t par = { func, arg, n, 0 };
+
+	if(os_npar == 0)
+		os_npar = os_ncpu();
+
+	cnt = (os_npar < n) ? os_npar : n;
+	thread = malloc(cnt * sizeof(pthread_t));
+
+	for(i = 1; i < cnt; i++) {
+		if(pthread_create(&thread[i], NULL, os_par_run, &par) != 0)
+			break;
+	}
+
+	cnt = i;
+	os_par_run(&par);
+
+	for(i = 1; i < cnt; i++)
+		pthread_join(thread[i], NULL);
+
+	free(thread);
+}
+
+/**
+ * Process parallel work items until none remain.
+ *   @arg: The parallel work structure.
+ *   &returns: Always null.
+ */
+void *os_par_run(void *arg)
+{
+	uint32_t i;
+	struct os_par_t *par = arg;
+
+	while((i = __atomic_fetch_add(&par->next, 1, __ATOMIC_RELAXED)) < par->n)
+		par->func(par->arg, i);
+
+	return NULL;
+}
+
+
+/**
+ * Initialize the ring on first use. The ring is unavailable if the kernel
+ * does not support io_uring or any of the required operations, or if the
+ * `HAMMER_NOURING` environment variable is set.
+ *   &returns: True if the ring is available.
+ */
+bool os_ring_init(void)
+{
+	int fd;
+	bool okay;
+	size_t sqlen, cqlen;
+	void *sq, *cq, *sqe;
+	struct io_uring_params param;
+	struct io_uring_probe *probe;
+
+	if(os_ring.fd != -2)
+		return os_ring.fd >= 0;
+
+	os_ring.fd = -1;
+	if(getenv("HAMMER_NOURING") != NULL)
+		return false;
+
+	memset(&param, 0, sizeof(param));
+	fd = syscall(SYS_io_uring_setup, OS_RING, &param);
+	if(fd < 0)
+		return false;
+
+	probe = calloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+	okay = (syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+		&& os_ring_op(probe, IORING_OP_STATX) && os_ring_op(probe, IORING_OP_MKDIRAT) && os_ring_op(probe, IORING_OP_OPENAT);
+	free(probe);
+
+	if(!okay) {
+		close(fd);
+		return false;
+	}
+
+	sqlen = param.sq_off.array + param.sq_entries * sizeof(unsigned);
+	cqlen = param.cq_off.cqes + param.cq_entries * sizeof(struct io_uring_cqe);
+	if(param.features & IORING_FEAT_SINGLE_MMAP)
+		sqlen = cqlen = (sqlen > cqlen) ? sqlen : cqlen;
+
+	sq = mmap(NULL, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if(param.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else
+		cq = mmap(NULL, cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+	sqe = mmap(NULL, param.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+	if((sq == MAP_FAILED) || (cq == MAP_FAILED) || (sqe == MAP_FAILED)) {
+		close(fd);
+		return false;
+	}
+
+	os_ring.ents = param.sq_entries;
+	os_ring.sq_tail = (void *)((char *)sq + param.sq_off.tail);
+	os_ring.sq_mask = (void *)((char *)sq + param.sq_off.ring_mask);
+	os_ring.sq_array = (void *)((char *)sq + param.sq_off.array);
+	os_ring.cq_head = (void *)((char *)cq + param.cq_off.head);
+	os_ring.cq_tail = (void *)((char *)cq + param.cq_off.tail);
+	os_ring.cq_mask = (void *)((char *)cq + param.cq_off.ring_mask);
+	os_ring.sqe = sqe;
+	os_ring.cqe = (void *)((char *)cq + param.cq_off.cqes);
+	os_ring.fd = fd;
+
+	return true;
+}
+
+/**
+ * Determine if the ring supports an operation.
+ *   @probe: The probe result.
+ *   @op: The operation.
+ *   &returns: True if supported.
+ */
+bool os_ring_op(struct io_uring_probe *probe, int op)
+{
+	return (op <= probe->last_op) && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+/**
+ * Retrieve a cleared submission entry that has not yet been submitted.
+ *   @i: The index among the pending entries.
+ *   &returns: The submission entry.
+ */
+struct io_uring_sqe *os_ring_get(uint32_t i)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = &os_ring.sqe[(*os_ring.sq_tail + i) & *os_ring.sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	return sqe;
+}
+
+/**
+ * Submit pending entries and wait for all of their completions.
+ *   @n: The number of pending entries, at most the ring size.
+ *   @res: Out. The results, indexed by the entry user data.
+ */
+void os_ring_run(uint32_t n, int *res)
+{
+	int ret;
+	uint32_t i, sub = n, done = 0;
+	unsigned head, tail;
+	struct io_uring_cqe *cqe;
+
+	tail = *os_ring.sq_tail;
+	for(i = 0; i < n; i++)
+		os_ring.sq_array[(tail + i) & *os_ring.sq_mask] = (tail + i) & *os_ring.sq_mask;
+
+	__atomic_store_n(os_ring.sq_tail, tail + n, __ATOMIC_RELEASE);
+
+	while(done < n) {
+		ret = syscall(SYS_io_uring_enter, os_ring.fd, sub, n - done, IORING_ENTER_GETEVENTS, NULL, 0);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+
+			fatal("Failed to submit I/O. %s.", strerror(errno));
+		}
+
+		sub -= ret;
+
+		head = *os_ring.cq_head;
+		tail = __atomic_load_n(os_ring.cq_tail, __ATOMIC_ACQUIRE);
+		for(; head != tail; head++, done++) {
+			cqe = &os_ring.cqe[head & *os_ring.cq_mask];
+			res[cqe->user_data] = cqe->res;
+		}
+
+		__atomic_store_n(os_ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+
+/**
+ * Create the listening socket of a build server, replacing any stale socket
+ * file.
+ *   @path: The socket path.
+ *   &returns: The socket.
+ */
+int os_server(const char *path)
+{
+	int sock;
+	struct sockaddr_un addr;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+		fatal("Socket path '%s' too long.", path);
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0)
+		fatal("Cannot create socket. %s.", strerror(errno));
+
+	unlink(path);
+	if((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(sock, 16) < 0))
+		fatal("Cannot listen on '%s'. %s.", path, strerror(errno));
+
+	signal(SIGPIPE, SIG_IGN);
+
+	return sock;
+}
+
+/**
+ * Run a build on a server, passing the arguments and environment along with
+ * the standard input, output and error descriptors.
+ *   @path: The socket path.
+ *   @args: The null-terminated arguments.
+ *   @stat: Out. The exit status of the build.
+ *   &returns: True if a server handled the build, false if none is running.
+ */
+bool os_client(const char *path, char **args, int *stat)
+{
+	int sock, fd[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	uint32_t i, len, size[2] = { 0, 0 };
+	ssize_t ret;
+	char *buf, ctrl[CMSG_SPACE(sizeof(fd))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct sockaddr_un addr;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+		return false;
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(sock < 0)
+		return false;
+
+	if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sock);
+		return false;
+	}
+
+	for(i = 0; args[i] != NULL; i++)
+		size[0] += strlen(args[i]) + 1;
+
+	for(i = 0; environ[i] != NULL; i++)
+		size[1] += strlen(environ[i]) + 1;
+
+	buf = malloc(sizeof(size) + size[0] + size[1]);
+	memcpy(buf, size, sizeof(size));
+	len = sizeof(size);
+
+	for(i = 0; args[i] != NULL; i++) {
+		strcpy(buf + len, args[i]);
+		len += strlen(args[i]) + 1;
+	}
+
+	for(i = 0; environ[i] != NULL; i++) {
+		strcpy(buf + len, environ[i]);
+		len += strlen(environ[i]) + 1;
+	}
+
+	iov = (struct iovec){ buf, len };
+	msg = (struct msghdr){ .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+	memcpy(CMSG_DATA(cmsg), fd, sizeof(fd));
+
+	ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	free(buf);
+
+	if(ret != (ssize_t)len)
+		fatal("Failed to send request to server. %s.", strerror(errno));
+
+	do
+		ret = recv(sock, stat, sizeof(int), MSG_WAITALL);
+	while((ret < 0) && (errno == EINTR));
+
+	if(ret != sizeof(int))
+		fatal("Lost connection to server.");
+
+	close(sock);
+
+	return true;
+}
+
+/**
+ * Accept a build request and fork a process to handle it. The child takes
+ * over the descriptors passed by the client as its standard input, output
+ * and error, replaces its environment with the client's, so that commands
+ * run as they would without the server, and gets a fresh event poll and
+ * ring.
+ *   @sock: The listening socket.
+ *   @conn: Out. The connection, for the parent only.
+ *   @args: Out. The null-terminated arguments, for the child only.
+ *   &returns: Zero in the child, the child process identifier in the parent,
+ *     or negative if no valid request was received.
+ */
+int os_request(int sock, int *conn, char ***args)
+{
+	pid_t pid;
+	int c, fd[3];
+	uint32_t i, n, len, size[2];
+	ssize_t ret;
+	char *buf, **env, ctrl[CMSG_SPACE(sizeof(fd))];
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+
+	c = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+	if(c < 0)
+		return -1;
+
+	iov = (struct iovec){ size, sizeof(size) };
+	msg = (struct msghdr){ .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctrl, .msg_controllen = sizeof(ctrl) };
+	ret = recvmsg(c, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	cmsg = CMSG_FIRSTHDR(&msg);
+
+	if((ret != sizeof(size)) || (cmsg == NULL) || (cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN(sizeof(fd)))) {
+		close(c);
+		return -1;
+	}
+
+	memcpy(fd, CMSG_DATA(cmsg), sizeof(fd));
+
+	len = size[0] + size[1];
+	buf = malloc(len + 1);
+	buf[len] = '\0';
+	if((len > 0) && (recv(c, buf, len, MSG_WAITALL) != (ssize_t)len)) {
+		free(buf);
+		close(c);
+		for(i = 0; i < 3; i++)
+			close(fd[i]);
+
+		return -1;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if(pid == 0) {
+		for(i = 0; i < 3; i++) {
+			dup2(fd[i], i);
+			close(fd[i]);
+		}
+
+		close(c);
+		close(sock);
+
+		close(os_epoll);
+		os_epoll = epoll_create1(EPOLL_CLOEXEC);
+		if(os_epoll < 0)
+			fatal("Failed to create event poll. %s.", strerror(errno));
+
+		if(os_ring.fd >= 0)
+			close(os_ring.fd);
+
+		os_ring.fd = -2;
+
+		for(i = n = 0; i < size[0]; i += strlen(buf + i) + 1)
+			n++;
+
+		*args = malloc((n + 1) * sizeof(char *));
+		for(i = n = 0; i < size[0]; i += strlen(buf + i) + 1)
+			(*args)[n++] = buf + i;
+
+		(*args)[n] = NULL;
+
+		for(i = size[0], n = 0; i < len; i += strlen(buf + i) + 1)
+			n++;
+
+		env = malloc((n + 1) * sizeof(char *));
+		for(i = size[0], n = 0; i < len; i += strlen(buf + i) + 1)
+			env[n++] = buf + i;
+
+		env[n] = NULL;
+		environ = env;
+
+		return 0;
+	}
+
+	for(i = 0; i < 3; i++)
+		close(fd[i]);
+
+	free(buf);
+
+	if(pid < 0) {
+		close(c);
+		return -1;
+	}
+
+	*conn = c;
+
+	return pid;
+}
+
+/**
+ * Wait for a request process to complete and send its exit status to the
+ * client. The process is interrupted if the client disconnects first.
+ *   @conn: The connection.
+ *   @pid: The process identifier.
+ */
+void os_respond(int conn, int pid)
+{
+	int fd, stat;
+	struct pollfd pfd[2];
+
+	fd = syscall(SYS_pidfd_open, pid, 0);
+	pfd[0] = (struct pollfd){ fd, POLLIN, 0 };
+	pfd[1] = (struct pollfd){ conn, POLLIN, 0 };
+
+	while(fd >= 0) {
+		if(ppoll(pfd, 2, NULL, NULL) < 0) {
+			if(errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		if(pfd[0].revents != 0)
+			break;
+
+		if(pfd[1].revents != 0) {
+			kill(pid, SIGTERM);
+			pfd[1].fd = -1;
+		}
+	}
+
+	while((waitpid(pid, &stat, 0) < 0) && (errno == EINTR));
+
+	stat = WIFEXITED(stat) ? WEXITSTATUS(stat) : (128 + WTERMSIG(stat));
+	send(conn, &stat, sizeof(int), MSG_NOSIGNAL);
+
+	if(fd >= 0)
+		close(fd);
+
+	close(conn);
+}
+
+/**
+ * Wait until a descriptor or a listening socket is readable.
+ *   @fd: The descriptor.
+ *   @sock: The socket.
+ *   &returns: True if the socket is readable.
+ */
+bool os_ready(int fd, int sock)
+{
+	struct pollfd pfd[2];
+
+	pfd[0] = (struct pollfd){ fd, POLLIN, 0 };
+	pfd[1] = (struct pollfd){ sock, POLLIN, 0 };
+
+	while(ppoll(pfd, 2, NULL, NULL) < 0) {
+		if(errno != EINTR)
+			fatal("Failed to wait. %s.", strerror(errno));
+	}
+
+	return pfd[1].revents != 0;
+}
+
+/**
+ * Create a non-blocking file change notifier.
+ *   &returns: The notifier.
+ */
+int os_notify(void)
+{
+	int fd;
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd < 0)
+		fatal("Cannot create file notifier. %s.", strerror(errno));
+
+	return fd;
+}
+
+/**
+ * Watch a directory for changes to its entries.
+ *   @fd: The notifier.
+ *   @dir: The directory path.
+ *   &returns: The watch descriptor, or negative on failure.
+ */
+int os_notify_add(int fd, const char *dir)
+{
+	return inotify_add_watch(fd, dir, IN_ONLYDIR | IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+}
+
+/**
+ * Read all pending change notifications without blocking. The callback
+ * receives the watch descriptor and the entry name, a null name if the
+ * watched directory itself went away, or a negative watch descriptor if
+ * notifications were lost.
+ *   @fd: The notifier.
+ *   @func: The callback.
+ *   @arg: The callback argument.
+ */
+void os_notify_read(int fd, void (*func)(void *arg, int wd, const char *name), void *arg)
+{
+	ssize_t len, off;
+	const struct inotify_event *ev;
+	char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	for(;;) {
+		len = read(fd, buf, sizeof(buf));
+		if(len < 0) {
+			if(errno == EINTR)
+				continue;
+			else if(errno == EAGAIN)
+				break;
+
+			fatal("Failed to read file notifications. %s.", strerror(errno));
+		}
+
+		for(off = 0; off < len; off += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(buf + off);
+
+			if(ev->mask & IN_Q_OVERFLOW)
+				func(arg, -1, NULL);
+			else if(ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+				func(arg, ev->wd, NULL);
+			else if(ev->len > 0)
+				func(arg, ev->wd, ev->name);
+		}
+	}
+}
+
+/**
+ * Close a descriptor.
+ *   @fd: The descriptor.
+ */
+void os_close(int fd)
+{
+	close(fd);
+}
@@ -1,6 +1,19 @@
 #include "inc.h"
 
 
+/*
+ * environment cache variables, the epoch advancing whenever a cached
+ * binding may be stale
+ */
+uint32_t env_epoch = 1;
+
+/*
+ * value declarations
+ */
+struct val_t *val_alloc(uint32_t max);
+void val_mark(struct val_t *val, uint32_t idx, bool spec);
+
+
 /**
  * Create a new binding.
  *   @id: Consumed. The identifier.
@@ -13,7 +26,7 @@ struct bind_t *bind_new(char *id, struct rt_obj_t obj, struct loc_t loc)
 	struct bind_t *bind;
 
 	bind = malloc(sizeof(struct bind_t));
-	*bind = (struct bind_t){ id, obj, loc, NULL };
+	*bind = (struct bind_t){ id, env_hash(id), obj, loc, NULL };
 
 	return bind;
 }
@@ -162,28 +175,29 @@ struct rt_obj_t rt_obj_func(func_t *func)
 
 /**
  * Add two objects.
- *   @dst: The destination object.
+ *   @dst: The destination object reference.
  *   @src: Consumed. The source object.
  */
-void rt_obj_add(struct rt_obj_t dst, struct rt_obj_t src, struct loc_t loc)
+void rt_obj_add(struct rt_obj_t *dst, struct rt_obj_t src, struct loc_t loc)
 {
-	switch(dst.tag) {
+	switch(dst->tag) {
 	case rt_null_v:
 		fatal("FIXME stub rt_obj_add null");
 		break;
 
 	case rt_val_v:
-		if(src.tag != dst.tag)
+		if(src.tag != dst->tag)
 			loc_err(loc, "Cannot add non-string value to a string value.");
 
-		*val_tail(&dst.data.val) = src.data.val;
+		val_append(&dst->data.val, src.data.val);
 		break;
 
 	case rt_env_v:
-		if(src.tag != dst.tag)
+		if(src.tag != dst->tag)
 			loc_err(loc, "Cannot add non-environment value to an environment value.");
 
-		*rt_env_tail(&dst.data.env) = src.data.env;
+		*rt_env_tail(&dst->data.env) = src.data.env;
+		env_epoch++;
 		break;
 
 	case rt_func_v:
@@ -194,6 +208,24 @@ void rt_obj_add(struct rt_obj_t dst, struct rt_obj_t src, struct loc_t loc)
 }
 
 
+/**
+ * Allocate an empty value.
+ *   @max: The capacity.
+ *   &returns: The value.
+ */
+struct val_t *val_alloc(uint32_t max)
+{
+	struct val_t *val;
+
+	val = malloc(sizeof(struct val_t) + max * sizeof(union val_str_u));
+	val->nrefs = 1;
+	val->len = 0;
+	val->max = max;
+	val->spec = NULL;
+
+	return val;
+}
+
 /**
  * Create a value.
  *   @spec: Special value flag.
@@ -202,62 +234,233 @@ void rt_obj_add(struct rt_obj_t dst, struct rt_obj_t src, struct loc_t loc)
  */
 struct val_t *val_new(bool spec, char *str)
 {
-	struct val_t *val;
+	struct val_t *val = NULL;
+
+	val_add(&val, spec, str);
+
+	return val;
+}
+
+/**
+ * Create a value referencing an interned string.
+ *   @spec: Special value flag.
+ *   @str: The interned string.
+ *   &returns: The value.
+ */
+struct val_t *val_ref(bool spec, const char *str)
+{
+	struct val_t *val = NULL;
 
-	val = malloc(sizeof(struct val_t));
-	val->spec = spec;
-	val->str = str;
-	val->next = NULL;
+	val_add_ref(&val, spec, str);
 
 	return val;
 }
 
 /**
- * Duplicate a value.
+ * Duplicate a value, sharing the list.
  *   @val: The value.
  *   &returns: The duplicated value.
  */
-struct val_t *val_dup(const struct val_t *val)
+struct val_t *val_dup(struct val_t *val)
+{
+	if(val != NULL)
+		val->nrefs++;
+
+	return val;
+}
+
+/**
+ * Release a value, deleting it once no longer shared.
+ *   @val: The value.
+ */
+void val_clear(struct val_t *val)
 {
-	struct val_t *ret, **iter;
+	uint32_t i;
+
+	if((val == NULL) || (--val->nrefs > 0))
+		return;
 
-	iter = &ret;
-	while(val != NULL) {
-		*iter = malloc(sizeof(struct val_t));
-		(*iter)->spec = val->spec;
-		(*iter)->str = strdup(val->str);
-		iter = &(*iter)->next;
-		val = val->next;
+	for(i = 0; i < val->len; i++) {
+		if(val->arr[i].ext.tag == VAL_OWN)
+			free(val->arr[i].ext.ptr);
 	}
 
-	*iter = NULL;
-	return ret;
+	free(val->spec);
+	free(val);
 }
 
+
 /**
- * Delete a value.
+ * Set the special flag of a string.
  *   @val: The value.
+ *   @idx: The string index.
+ *   @spec: The special flag.
  */
-void val_delete(struct val_t *val)
+void val_mark(struct val_t *val, uint32_t idx, bool spec)
 {
-	free(val->str);
-	free(val);
+	if(val->spec == NULL) {
+		if(!spec)
+			return;
+
+		val->spec = calloc((val->max + 31) / 32, sizeof(uint32_t));
+	}
+
+	if(spec)
+		val->spec[idx / 32] |= 1u << (idx % 32);
+	else
+		val->spec[idx / 32] &= ~(1u << (idx % 32));
 }
 
 /**
- * Clear a list of values.
- *   @val: The value list.
+ * Reserve space for strings at the end of a value, copying it first if it
+ * is shared. Capacity at least doubles so that appending is amortized
+ * constant time.
+ *   @val: The value reference.
+ *   @cnt: The number of strings.
  */
-void val_clear(struct val_t *val)
+void val_reserve(struct val_t **val, uint32_t cnt)
 {
-	struct val_t *tmp;
+	uint32_t i, max, nspec;
+	struct val_t *orig = *val;
+
+	if(orig == NULL)
+		*val = val_alloc(cnt);
+	else if(orig->nrefs > 1) {
+		*val = val_alloc(orig->len + cnt);
+		for(i = 0; i < orig->len; i++)
+			val_add_copy(val, orig, i);
 
-	while(val != NULL) {
-		val = (tmp = val)->next;
-		val_delete(tmp);
+		val_clear(orig);
+	}
+	else if((orig->len + cnt) > orig->max) {
+		max = orig->len + cnt;
+		if(max < (2 * orig->max))
+			max = 2 * orig->max;
+
+		*val = realloc(orig, sizeof(struct val_t) + max * sizeof(union val_str_u));
+		if((*val)->spec != NULL) {
+			nspec = ((*val)->max + 31) / 32;
+			(*val)->spec = realloc((*val)->spec, ((max + 31) / 32) * sizeof(uint32_t));
+			memset((*val)->spec + nspec, 0, ((max + 31) / 32 - nspec) * sizeof(uint32_t));
+		}
+
+		(*val)->max = max;
 	}
 }
 
+/**
+ * Add a string to the end of a value.
+ *   @val: The value reference.
+ *   @spec: Special value flag.
+ *   @str: Consumed. The string.
+ */
+void val_add(struct val_t **val, bool spec, char *str)
+{
+	size_t len;
+	union val_str_u *elem;
+
+	val_reserve(val, 1);
+	elem = &(*val)->arr[(*val)->len];
+
+	len = strlen(str);
+	if(len < VAL_INLINE) {
+		memset(elem->buf, 0, VAL_INLINE);
+		memcpy(elem->buf, str, len);
+		free(str);
+	}
+	else {
+		elem->ext.ptr = str;
+		elem->ext.tag = VAL_OWN;
+	}
+
+	val_mark(*val, (*val)->len++, spec);
+}
+
+/**
+ * Add a reference to an interned string to the end of a value.
+ *   @val: The value reference.
+ *   @spec: Special value flag.
+ *   @str: The interned string.
+ */
+void val_add_ref(struct val_t **val, bool spec, const char *str)
+{
+	union val_str_u *elem;
+
+	val_reserve(val, 1);
+	elem = &(*val)->arr[(*val)->len];
+	elem->ext.ptr = (char *)str;
+	elem->ext.tag = VAL_REF;
+
+	val_mark(*val, (*val)->len++, spec);
+}
+
+/**
+ * Add a copy of a string from another value to the end of a value. Inline
+ * and interned strings copy their slot, and owned strings are duplicated.
+ *   @val: The value reference.
+ *   @src: The source value, distinct from the value.
+ *   @idx: The source string index.
+ */
+void val_add_copy(struct val_t **val, const struct val_t *src, uint32_t idx)
+{
+	union val_str_u *elem;
+
+	val_reserve(val, 1);
+	elem = &(*val)->arr[(*val)->len];
+	*elem = src->arr[idx];
+
+	if(elem->ext.tag == VAL_OWN)
+		elem->ext.ptr = strdup(elem->ext.ptr);
+
+	val_mark(*val, (*val)->len++, val_spec(src, idx));
+}
+
+
+/**
+ * Retrieve a string from a value.
+ *   @val: The value.
+ *   @idx: The string index.
+ *   &returns: The string.
+ */
+const char *val_get(const struct val_t *val, uint32_t idx)
+{
+	const union val_str_u *elem = &val->arr[idx];
+
+	return (elem->ext.tag == 0) ? elem->buf : elem->ext.ptr;
+}
+
+/**
+ * Retrieve the special flag of a string from a value.
+ *   @val: The value.
+ *   @idx: The string index.
+ *   &returns: The special flag.
+ */
+bool val_spec(const struct val_t *val, uint32_t idx)
+{
+	return (val->spec != NULL) && (val->spec[idx / 32] & (1u << (idx % 32)));
+}
+
+/**
+ * Take the string from a single value, copying it if shared.
+ *   @val: Consumed. The value.
+ *   &returns: The allocated string.
+ */
+char *val_take(struct val_t *val)
+{
+	char *str;
+
+	if((val->nrefs > 1) || (val->arr[0].ext.tag != VAL_OWN)) {
+		str = strdup(val_get(val, 0));
+		val_clear(val);
+	}
+	else {
+		str = val->arr[0].ext.ptr;
+		free(val->spec);
+		free(val);
+	}
+
+	return str;
+}
 
 /**
  * Unwrap an identifier from a value.
@@ -267,15 +470,10 @@ void val_clear(struct val_t *val)
  */
 char *val_id(struct val_t *val, struct loc_t loc)
 {
-	char *id;
-
 	if((val == NULL) || (val_len(val) >= 2))
 		loc_err(loc, "Invalid variable name.");
 
-	id = val->str;
-	free(val);
-
-	return id;
+	return val_take(val);
 }
 
 /**
@@ -286,15 +484,10 @@ char *val_id(struct val_t *val, struct loc_t loc)
  */
 char *val_str(struct val_t *val, struct loc_t loc)
 {
-	char *id;
-
 	if((val == NULL) || (val_len(val) >= 2))
 		loc_err(loc, "Must be a single string.");
 
-	id = val->str;
-	free(val);
-
-	return id;
+	return val_take(val);
 }
 
 /**
@@ -302,29 +495,50 @@ char *val_str(struct val_t *val, struct loc_t loc)
  *   @val: The value.
  *   &returns: The length.
  */
-uint32_t val_len(struct val_t *val)
+uint32_t val_len(const struct val_t *val)
 {
-	uint32_t n = 0;
-
-	while(val != NULL) {
-		n++;
-		val = val->next;
-	}
-
-	return n;
+	return (val != NULL) ? val->len : 0;
 }
 
 /**
- * Retrieve the tail of a value.
- *   @val: The value reference.
- *   &return: The tail reference.
+ * Append to a value. Shared values are copied first, leaving the other
+ * references unchanged, and the strings of an unshared source are moved
+ * instead of copied.
+ *   @dst: The destination value reference.
+ *   @src: Consumed. The source value.
  */
-struct val_t **val_tail(struct val_t **val)
+void val_append(struct val_t **dst, struct val_t *src)
 {
-	while(*val != NULL)
-		val = &(*val)->next;
+	uint32_t i, len;
 
-	return val;
+	if(src == NULL)
+		return;
+	else if(*dst == NULL) {
+		*dst = src;
+		return;
+	}
+
+	val_reserve(dst, src->len);
+
+	if(src->nrefs == 1) {
+		len = (*dst)->len;
+		memcpy((*dst)->arr + len, src->arr, src->len * sizeof(union val_str_u));
+		(*dst)->len += src->len;
+
+		if(src->spec != NULL) {
+			for(i = 0; i < src->len; i++)
+				val_mark(*dst, len + i, val_spec(src, i));
+		}
+
+		free(src->spec);
+		free(src);
+	}
+	else {
+		for(i = 0; i < src->len; i++)
+			val_add_copy(dst, src, i);
+
+		val_clear(src);
+	}
 }
 
 
@@ -336,9 +550,8 @@ struct env_t *rt_env_new(struct env_t *up)
 {
 	struct env_t *env;
 
-	env = malloc(sizeof(struct env_t));
+	env = calloc(1, sizeof(struct env_t));
 	env->nrefs = 1;
-	env->map = map0_new((cmp_f)strcmp, (del_f)bind_delete);
 	env->next = up;
 
 	return env;
@@ -365,10 +578,23 @@ struct env_t *rt_env_dup(struct env_t *env)
  */
 void rt_env_delete(struct env_t *env)
 {
+	uint32_t i;
+
 	if(env->nrefs-- >= 2)
 		return;
 
-	map0_delete(env->map);
+	if(env->held)
+		env_epoch++;
+
+	if(env->tab != NULL) {
+		for(i = 0; i <= env->mask; i++) {
+			if(env->tab[i] != NULL)
+				bind_delete(env->tab[i]);
+		}
+
+		free(env->tab);
+	}
+
 	free(env);
 }
 
@@ -387,6 +613,21 @@ void rt_env_clear(struct env_t *env)
 }
 
 
+/**
+ * Compute the hash of an identifier.
+ *   @id: The identifier.
+ *   &returns: The hash, never zero.
+ */
+uint32_t env_hash(const char *id)
+{
+	uint32_t hash = 2166136261u;
+
+	while(*id != '\0')
+		hash = (hash ^ (uint8_t)*id++) * 16777619u;
+
+	return hash ? hash : 1;
+}
+
 /**
  * Lookup a binding from the current environment (not recursively).
  *   @env: The environment.
@@ -395,30 +636,84 @@ void rt_env_clear(struct env_t *env)
  */
 struct bind_t *rt_env_lookup(struct env_t *env, const char *id)
 {
-	return map0_get(env->map, id);
+	return env_probe(env, id, env_hash(id));
 }
 
 /**
- * Get a binding from an environment.
+ * Lookup a binding from the current environment using a precomputed hash.
  *   @env: The environment.
  *   @id: The identifier.
+ *   @hash: The identifier hash.
  *   &returns: The binding if found.
  */
-struct bind_t *env_get(struct env_t *env, const char *id)
+struct bind_t *env_probe(struct env_t *env, const char *id, uint32_t hash)
 {
-	struct bind_t *bind;
+	uint32_t i;
 
-	while(env != NULL) {
-		bind = map0_get(env->map, id);
-		if(bind != NULL)
-			return bind;
+	if(env->tab == NULL)
+		return NULL;
 
-		env = env->next;
+	for(i = hash & env->mask; env->tab[i] != NULL; i = (i + 1) & env->mask) {
+		if((env->tab[i]->hash == hash) && (strcmp(env->tab[i]->id, id) == 0))
+			return env->tab[i];
 	}
 
 	return NULL;
 }
 
+/**
+ * Get a binding from an environment.
+ *   @env: The environment.
+ *   @id: The identifier.
+ *   &returns: The binding if found.
+ */
+struct bind_t *env_get(struct env_t *env, const char *id)
+{
+	return env_find(env, id, env_hash(id));
+}
+
+/**
+ * Get a binding from an environment using a precomputed hash. Bindings
+ * found in a parent are cached on every environment passed through, and
+ * the cache stays valid until a binding that may shadow or replace a
+ * cached one is added.
+ *   @env: The environment.
+ *   @id: The identifier.
+ *   @hash: The identifier hash.
+ *   &returns: The binding if found.
+ */
+struct bind_t *env_find(struct env_t *env, const char *id, uint32_t hash)
+{
+	struct env_t *iter;
+	struct bind_t *bind = NULL;
+	struct env_cache_t *ent;
+
+	for(iter = env; iter != NULL; iter = iter->next) {
+		bind = env_probe(iter, id, hash);
+		if(bind != NULL) {
+			if(iter != env)
+				iter->held = true;
+
+			break;
+		}
+		else if(iter->next == NULL)
+			return NULL;
+
+		ent = &iter->cache[hash % ENV_CACHE];
+		if((ent->epoch == env_epoch) && (ent->hash == hash) && (strcmp(ent->bind->id, id) == 0)) {
+			bind = ent->bind;
+			break;
+		}
+
+		iter->look = true;
+	}
+
+	for(; env != iter; env = env->next)
+		env->cache[hash % ENV_CACHE] = (struct env_cache_t){ hash, env_epoch, bind };
+
+	return bind;
+}
+
 /**
  * Add a binding to an environment.
  *   @env: The environment.
@@ -426,13 +721,45 @@ struct bind_t *env_get(struct env_t *env, const char *id)
  */
 void env_put(struct env_t *env, struct bind_t *bind)
 {
-	struct bind_t *cur;
+	uint32_t i, k;
+	struct bind_t **tab;
 
-	cur = map_rem(env->map, bind->id);
-	if(cur != NULL)
-		bind_delete(cur);
+	if(env->tab == NULL) {
+		env->mask = 7;
+		env->tab = calloc(env->mask + 1, sizeof(struct bind_t *));
+	}
+
+	for(i = bind->hash & env->mask; env->tab[i] != NULL; i = (i + 1) & env->mask) {
+		if((env->tab[i]->hash == bind->hash) && (strcmp(env->tab[i]->id, bind->id) == 0)) {
+			if(env->held)
+				env_epoch++;
+
+			bind_delete(env->tab[i]);
+			env->tab[i] = bind;
+			return;
+		}
+	}
+
+	if(env->look)
+		env_epoch++;
+
+	env->tab[i] = bind;
+	if(4 * ++env->cnt <= 3 * (env->mask + 1))
+		return;
+
+	tab = env->tab;
+	env->mask = 2 * env->mask + 1;
+	env->tab = calloc(env->mask + 1, sizeof(struct bind_t *));
+
+	for(k = 0; k < (env->mask + 1) / 2; k++) {
+		if(tab[k] == NULL)
+			continue;
+
+		for(i = tab[k]->hash & env->mask; env->tab[i] != NULL; i = (i + 1) & env->mask);
+		env->tab[i] = tab[k];
+	}
 
-	map0_add(env->map, bind->id, bind);
+	free(tab);
 }
 
 /**
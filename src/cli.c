@@ -27,27 +27,140 @@ void arr_add(const char ***arr, uint32_t *cnt, const char *str)
 }
 
 /**
- * Process the arguments.
+ * Process the arguments. Setting the `HAMMER_NOFREE` environment variable
+ * skips releasing the graph and syntax tree before exiting.
  *   @args: The arguments.
  */
 void cli_proc(char **args)
 {
-	struct ast_block_t *top;
+	int sock, stat;
 	struct opt_t opt;
 	struct rt_ctx_t *ctx;
 	const char **arr;
-	uint32_t i, k, cnt;
+	uint32_t cnt;
+
+	cli_opts(args, &opt, &arr, &cnt);
+
+	if(opt.slowest > 0) {
+		struct log_t *log;
+
+		log = log_open(".hammer.log");
+		log_slow(log, opt.slowest);
+		log_close(log);
+	}
+	else if(opt.server) {
+		sock = os_server(".hammer.sock");
+
+		for(;;) {
+			ctx = ctx_new(&opt);
+			cli_load(ctx);
+			serve_run(ctx, sock);
+			ctx_delete(ctx);
+		}
+	}
+	else if(os_client(".hammer.sock", args, &stat)) {
+		arr_delete(arr, cnt);
+		exit(stat);
+	}
+	else {
+		ctx = ctx_new(&opt);
+		cli_load(ctx);
+		ctx_run(ctx, arr);
+
+		if(getenv("HAMMER_NOFREE") != NULL) {
+			ctx_close(ctx);
+			return;
+		}
+
+		ctx_delete(ctx);
+	}
+
+	arr_delete(arr, cnt);
+	intern_clear();
+}
 
-	opt.force = false;
-	opt.jobs = -1;
-	opt.dir = NULL;
+/**
+ * Load the build graph into a context, either from the graph cache or by
+ * evaluating the Hammer file and refreshing the cache. Output printed by the
+ * evaluation is replayed when the graph is loaded from the cache. With
+ * `--ast-cache`, parsed files are also taken from and saved to the syntax
+ * tree cache.
+ *   @ctx: The context.
+ */
+void cli_load(struct rt_ctx_t *ctx)
+{
+	struct ast_block_t *top;
+
+	if(graph_load(ctx, ".hammer.graph")) {
+		if(ctx->out != NULL)
+			print("%s", ctx->out);
 
-	arr_init(&arr, &cnt);
+		return;
+	}
+
+	if(ctx->opt->ast)
+		ctx->cache = ast_cache_open(".hammer.ast");
+
+	top = ctx_load(ctx, "Hammer");
+	if(top == NULL)
+		cli_err("Cannot open '%s'.", "Hammer");
+
+	eval_top(top, ctx);
+
+	graph_save(ctx, ".hammer.graph");
+
+	if(ctx->opt->ast)
+		ast_cache_save(ctx, ".hammer.ast");
+}
+
+/**
+ * Parse the command-line options.
+ *   @args: The arguments.
+ *   @opt: Out. The options.
+ *   @arr: Out. The null-terminated build targets.
+ *   @cnt: Out. The target count.
+ */
+void cli_opts(char **args, struct opt_t *opt, const char ***arr, uint32_t *cnt)
+{
+	uint32_t i, k;
+
+	opt->force = false;
+	opt->digest = false;
+	opt->server = false;
+	opt->ast = false;
+	opt->jobs = -1;
+	opt->slowest = 0;
+	opt->dir = NULL;
+
+	arr_init(arr, cnt);
 
 	for(i = 0; args[i] != NULL; i++) {
 		if(args[i][0] == '-') {
 			if(args[i][1] == '-') {
-				fatal("FIXME stub");
+				if(strcmp(args[i], "--digest") == 0)
+					opt->digest = true;
+				else if(strcmp(args[i], "--server") == 0)
+					opt->server = true;
+				else if(strcmp(args[i], "--ast-cache") == 0)
+					opt->ast = true;
+				else if(strncmp(args[i], "--slowest", 9) == 0) {
+					unsigned long n = 20;
+
+					if(args[i][9] == '=') {
+						char *endptr;
+
+						errno = 0;
+						n = strtoul(args[i] + 10, &endptr, 0);
+						if((errno != 0) || (*endptr != '\0') || (n == 0))
+							cli_err("Invalid count (--slowest).");
+					}
+					else if(args[i][9] != '\0')
+						cli_err("Unknown option '%s'.", args[i]);
+
+					opt->slowest = (n > UINT32_MAX) ? UINT32_MAX : n;
+				}
+				else
+					cli_err("Unknown option '%s'.", args[i]);
 			}
 			else {
 				k = 1;
@@ -56,17 +169,17 @@ void cli_proc(char **args)
 					bool end = false;
 
 					switch(args[i][k]) {
-					case 'B': opt.force = true; break;
+					case 'B': opt->force = true; break;
 
 					case 'd':
-						if(opt.dir != NULL)
+						if(opt->dir != NULL)
 							cli_err("Directory already given.");
 						else if(args[i][k + 1] == '\0') {
-							if((opt.dir = args[++i]) == NULL)
+							if((opt->dir = args[++i]) == NULL)
 								cli_err("Missing directory (-d).");
 						}
 						else
-							opt.dir = args[i] + k + 1;
+							opt->dir = args[i] + k + 1;
 
 						end = true;
 						break;
@@ -76,7 +189,7 @@ void cli_proc(char **args)
 						const char *str;
 						unsigned long val;
 
-						if(opt.jobs >= 0)
+						if(opt->jobs >= 0)
 							cli_err("Jobs (-j) already given.");
 						else if(args[i][k + 1] == '\0') {
 							if((str = args[++i]) == NULL)
@@ -85,12 +198,16 @@ void cli_proc(char **args)
 						else
 							str = args[i] + k + 1;
 
-						errno = 0;
-						val = strtol(str, &endptr, 0);
-						if((errno != 0) || (*endptr != '\0') || (val == 0))
-							cli_err("Invalid job count (-j).");
+						if(strcmp(str, "auto") == 0)
+							val = os_ncpu();
+						else {
+							errno = 0;
+							val = strtol(str, &endptr, 0);
+							if((errno != 0) || (*endptr != '\0') || (val == 0))
+								cli_err("Invalid job count (-j).");
+						}
 
-						opt.jobs = (val > 1024) ? 1024 : val;
+						opt->jobs = (val > 1024) ? 1024 : val;
 
 						k = strlen(args[i]);
 						end = true;
@@ -107,23 +224,13 @@ void cli_proc(char **args)
 			}
 		}
 		else
-			arr_add(&arr, &cnt, args[i]);
+			arr_add(arr, cnt, args[i]);
 	}
 
-	arr_add(&arr, &cnt, NULL);
-
-	top = ham_load("Hammer");
-	if(top == NULL)
-		cli_err("Cannot open '%s'.", "Hammer");
-
-	ctx = ctx_new(&opt);
+	arr_add(arr, cnt, NULL);
 
-	eval_top(top, ctx);
-	ctx_run(ctx, arr);
-
-	ast_block_delete(top);
-	ctx_delete(ctx);
-	arr_delete(arr, cnt);
+	if(opt->jobs < 0)
+		opt->jobs = os_ncpu();
 }
 
 /**
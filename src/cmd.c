@@ -41,6 +41,38 @@ void seq_delete(struct seq_t *seq)
 }
 
 
+/**
+ * Compute a hash of the fully expanded commands of a sequence.
+ *   @seq: Optional. The sequence.
+ *   &returns: The hash.
+ */
+uint64_t seq_hash(struct seq_t *seq)
+{
+	uint32_t i;
+	uint64_t hash = 0;
+	struct cmd_t *cmd;
+	struct rt_pipe_t *pipe;
+
+	if(seq == NULL)
+		return 0;
+
+	for(cmd = seq->head; cmd != NULL; cmd = cmd->next) {
+		for(pipe = cmd->pipe; pipe != NULL; pipe = pipe->next) {
+			for(i = 0; i < val_len(pipe->cmd); i++)
+				hash = hash64(hash64(hash, val_get(pipe->cmd, i)), " ");
+
+			hash = hash64(hash, "|");
+		}
+
+		hash = hash64(hash64(hash, "<"), cmd->in ? cmd->in : "");
+		hash = hash64(hash64(hash, cmd->append ? ">>" : ">"), cmd->out ? cmd->out : "");
+		hash = hash64(hash, ";");
+	}
+
+	return hash;
+}
+
+
 /**
  * Add a command to a sequence.
  *   @seq: The sequence.
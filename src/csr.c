@@ -0,0 +1,258 @@
+#include "inc.h"
+
+
+/*
+ * compressed graph declarations
+ */
+uint32_t csr_row(struct csr_t *csr, uint32_t *mark, uint32_t stamp, uint32_t n, struct target_list_t *list);
+
+
+/**
+ * Freeze the graph of a context into compressed sparse rows. Every rule and
+ * target is numbered, duplicate targets within a rule row are dropped, and
+ * the forward edges of each target are derived from the dependency rows.
+ * The rows are held by the graph arena, and the lists they were built from
+ * are left as is.
+ *   @ctx: The context.
+ *   &returns: The compressed graph.
+ */
+struct csr_t *csr_new(struct rt_ctx_t *ctx)
+{
+	uint32_t i, k, n, cnt;
+	uint32_t *mark, *pos;
+	struct ent_t *ent;
+	struct csr_t *csr;
+	struct rule_t *rule;
+	struct rule_iter_t irule;
+	struct target_inst_t *inst;
+
+	csr = arena_alloc(ctx->arena, sizeof(struct csr_t));
+
+	csr->ntarget = ctx->map->cnt;
+	csr->target = arena_alloc(ctx->arena, csr->ntarget * sizeof(struct target_t *));
+
+	for(i = 0, ent = ctx->map->ent; ent != NULL; ent = ent->next, i++) {
+		ent->target->idx = i;
+		csr->target[i] = ent->target;
+	}
+
+	n = cnt = 0;
+	irule = rule_iter(ctx->rules);
+	while((rule = rule_next(&irule)) != NULL) {
+		for(inst = rule->gens->inst; inst != NULL; inst = inst->next)
+			cnt++;
+
+		for(inst = rule->deps->inst; inst != NULL; inst = inst->next)
+			cnt++;
+
+		n++;
+	}
+
+	csr->nrule = n;
+	csr->rule = arena_alloc(ctx->arena, n * sizeof(struct rule_t *));
+	csr->off = arena_alloc(ctx->arena, (2 * n + 1) * sizeof(uint32_t));
+	csr->adj = arena_alloc(ctx->arena, cnt * sizeof(uint32_t));
+	csr->off[0] = 0;
+
+	mark = calloc(csr->ntarget, sizeof(uint32_t));
+
+	i = 0;
+	irule = rule_iter(ctx->rules);
+	while((rule = rule_next(&irule)) != NULL) {
+		rule->idx = i;
+		csr->rule[i] = rule;
+		csr->off[2 * i + 1] = csr_row(csr, mark, 2 * i + 1, csr->off[2 * i], rule->gens);
+		csr->off[2 * i + 2] = csr_row(csr, mark, 2 * i + 2, csr->off[2 * i + 1], rule->deps);
+		i++;
+	}
+
+	csr->eoff = arena_alloc(ctx->arena, (csr->ntarget + 1) * sizeof(uint32_t));
+	memset(csr->eoff, 0, (csr->ntarget + 1) * sizeof(uint32_t));
+
+	for(i = 0; i < csr->nrule; i++) {
+		for(k = csr->off[2 * i + 1]; k < csr->off[2 * i + 2]; k++)
+			csr->eoff[csr->adj[k] + 1]++;
+	}
+
+	for(i = 0; i < csr->ntarget; i++)
+		csr->eoff[i + 1] += csr->eoff[i];
+
+	pos = mark;
+	memcpy(pos, csr->eoff, csr->ntarget * sizeof(uint32_t));
+	csr->edge = arena_alloc(ctx->arena, csr->eoff[csr->ntarget] * sizeof(uint32_t));
+
+	for(i = 0; i < csr->nrule; i++) {
+		for(k = csr->off[2 * i + 1]; k < csr->off[2 * i + 2]; k++)
+			csr->edge[pos[csr->adj[k]]++] = i;
+	}
+
+	free(mark);
+
+	return csr;
+}
+
+/**
+ * Write a row of distinct target indices, keeping the first occurrence of
+ * each target.
+ *   @csr: The compressed graph.
+ *   @mark: The mark of each target, the stamp of the last row it was added to.
+ *   @stamp: The row stamp, unique and non-zero.
+ *   @n: The row offset.
+ *   @list: The target list.
+ *   &returns: The offset past the row.
+ */
+uint32_t csr_row(struct csr_t *csr, uint32_t *mark, uint32_t stamp, uint32_t n, struct target_list_t *list)
+{
+	struct target_inst_t *inst;
+
+	for(inst = list->inst; inst != NULL; inst = inst->next) {
+		if(mark[inst->target->idx] == stamp)
+			continue;
+
+		mark[inst->target->idx] = stamp;
+		csr->adj[n++] = inst->target->idx;
+	}
+
+	return n;
+}
+
+/**
+ * Find the strongly connected components among the rules added to the
+ * queue, following each rule to the rules that generate its dependencies.
+ * The search is an iterative Tarjan search, so deep chains do not exhaust
+ * the stack. Each component is written to the order consecutively, after
+ * every component it depends on.
+ *   @csr: The compressed graph.
+ *   @comp: Out. The component of each rule, indexed by rule.
+ *   @ord: Out. The added rules in dependency order.
+ *   &returns: The number of added rules.
+ */
+uint32_t csr_scc(struct csr_t *csr, uint32_t *comp, uint32_t *ord)
+{
+	uint32_t i, v, w, sp, top = 0, n = 0, cnt = 1, nc = 0;
+	uint32_t *num, *low, *pos, *stack, *call;
+	struct target_t *target;
+
+	num = calloc(csr->nrule, sizeof(uint32_t));
+	low = malloc(csr->nrule * sizeof(uint32_t));
+	pos = malloc(csr->nrule * sizeof(uint32_t));
+	stack = malloc(csr->nrule * sizeof(uint32_t));
+	call = malloc(csr->nrule * sizeof(uint32_t));
+
+	for(i = 0; i < csr->nrule; i++) {
+		if(!csr->rule[i]->add || (num[i] != 0))
+			continue;
+
+		sp = 0;
+		w = i;
+
+		for(;;) {
+			if(w != UINT32_MAX) {
+				num[w] = low[w] = cnt++;
+				pos[w] = csr->off[2 * w + 1];
+				comp[w] = UINT32_MAX;
+				stack[top++] = w;
+				call[sp++] = w;
+			}
+
+			v = call[sp - 1];
+			w = UINT32_MAX;
+
+			if(pos[v] < csr->off[2 * v + 2]) {
+				target = csr->target[csr->adj[pos[v]++]];
+				if(target->rule == NULL)
+					continue;
+
+				if(num[target->rule->idx] == 0)
+					w = target->rule->idx;
+				else if((comp[target->rule->idx] == UINT32_MAX) && (num[target->rule->idx] < low[v]))
+					low[v] = num[target->rule->idx];
+
+				continue;
+			}
+
+			if(low[v] == num[v]) {
+				do {
+					w = stack[--top];
+					comp[w] = nc;
+					ord[n++] = w;
+				} while(w != v);
+
+				w = UINT32_MAX;
+				nc++;
+			}
+
+			if(--sp == 0)
+				break;
+
+			if(low[v] < low[call[sp - 1]])
+				low[call[sp - 1]] = low[v];
+		}
+	}
+
+	free(num);
+	free(low);
+	free(pos);
+	free(stack);
+	free(call);
+
+	return n;
+}
+
+/**
+ * Find a dependency cycle through a rule with a breadth-first search within
+ * its component. The cycle is written as target indices, each generated by
+ * a rule that the previous target's rule depends on, and it starts and ends
+ * with the same target.
+ *   @csr: The compressed graph.
+ *   @comp: The component of each rule.
+ *   @root: The rule.
+ *   @tmp: Scratch space of three entries per rule. The first third must be
+ *     filled with `UINT32_MAX` and is left marked for the searched component.
+ *   @path: Out. The cycle, up to the component size plus one.
+ *   &returns: The number of targets in the cycle, zero if there is none.
+ */
+uint32_t csr_cycle(struct csr_t *csr, const uint32_t *comp, uint32_t root, uint32_t *tmp, uint32_t *path)
+{
+	uint32_t i, k, v, w, t, head = 0, tail = 0, n = 0;
+	uint32_t *from = tmp, *via = tmp + csr->nrule, *fifo = tmp + 2 * csr->nrule;
+	struct target_t *target;
+
+	from[root] = root;
+	fifo[tail++] = root;
+
+	while(head < tail) {
+		v = fifo[head++];
+
+		for(k = csr->off[2 * v + 1]; k < csr->off[2 * v + 2]; k++) {
+			t = csr->adj[k];
+			target = csr->target[t];
+			if(target->rule == NULL)
+				continue;
+
+			w = target->rule->idx;
+			if(w == root) {
+				path[n++] = t;
+				for(; v != root; v = from[v])
+					path[n++] = via[v];
+
+				for(i = 1; i < (n + 1) / 2; i++) {
+					t = path[i];
+					path[i] = path[n - i];
+					path[n - i] = t;
+				}
+
+				path[n++] = path[0];
+
+				return n;
+			}
+			else if((comp[w] == comp[root]) && (from[w] == UINT32_MAX)) {
+				from[w] = v;
+				via[w] = t;
+				fifo[tail++] = w;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -1,6 +1,13 @@
 #include "inc.h"
 
 
+/*
+ * prefetch declarations
+ */
+struct fetch_t *ctx_entry(struct rt_ctx_t *ctx, const char *name, const char *path);
+void ctx_proc(void *arg, uint32_t idx);
+
+
 /**
  * Create a new context.
  *   @opt: The options structure.
@@ -11,52 +18,129 @@ struct rt_ctx_t *ctx_new(const struct opt_t *opt)
 	struct rt_ctx_t *ctx;
 
 	ctx = malloc(sizeof(struct rt_ctx_t));
+	ctx->arena = arena_new();
+	ctx->csr = NULL;
+	ctx->fetch = NULL;
+	ctx->cache = NULL;
 	ctx->opt = opt;
-	ctx->map = map_new();
-	ctx->rules = rule_list_new();
+	ctx->log = log_open(".hammer.log");
+	ctx->digest = opt->digest ? digest_open(".hammer.db") : NULL;
+	ctx->map = map_new(ctx->arena);
+	ctx->rules = rule_list_new(ctx->arena);
 	ctx->cur = NULL;
 	ctx->gens = ctx->deps = NULL;
+	ctx->src = NULL;
+	ctx->nsrc = 0;
+	ctx->out = NULL;
+	ctx->nout = 0;
+	ctx->mk = NULL;
+	ctx->nmk = 0;
+	ctx->mkc = mk_cache_new();
+	ctx->graph = NULL;
+	ctx->ngraph = 0;
+	ctx->body = NULL;
+	ctx->nbody = 0;
 
 	return ctx;
 }
 
 /**
- * Delete the context.
+ * Delete the context. The graph is released with its arena in one step.
  *   @ctx: The context.
  */
 void ctx_delete(struct rt_ctx_t *ctx)
 {
+	struct fetch_t *fetch;
+
+	ctx_close(ctx);
+
+	while((fetch = ctx->fetch) != NULL) {
+		ctx->fetch = fetch->next;
+
+		if(fetch->top != NULL)
+			ast_block_delete(fetch->top);
+
+		free(fetch->err);
+		free(fetch);
+	}
+
+	if(ctx->cache != NULL)
+		ast_cache_close(ctx->cache);
+
 	map_delete(ctx->map);
-	rule_list_delete(ctx->rules);
+	rule_list_clear(ctx->rules);
+	arena_delete(ctx->arena);
+	free(ctx->src);
+	free(ctx->out);
+	free(ctx->mk);
+	free(ctx->body);
+	mk_cache_delete(ctx->mkc);
+
+	if(ctx->graph != NULL)
+		os_unmap(ctx->graph, ctx->ngraph);
+
 	free(ctx);
 }
 
+/**
+ * Close the build log and digest database of the context without releasing
+ * its memory, for use when the process is about to exit.
+ *   @ctx: The context.
+ */
+void ctx_close(struct rt_ctx_t *ctx)
+{
+	if(ctx->log != NULL)
+		log_close(ctx->log);
+
+	if(ctx->digest != NULL)
+		digest_close(ctx->digest);
+
+	ctx->log = NULL;
+	ctx->digest = NULL;
+}
+
 
 /**
- * Run all outdated rules on the context.
+ * Run all outdated rules on the context. Besides the timestamp or digest
+ * check, a rule with commands is outdated when its expanded commands differ
+ * from the ones last recorded for its primary target in the build log, or
+ * when the log has no record of it.
  *   @ctx: The context.
  *   @builds: The set of target to build.
  */
 void ctx_run(struct rt_ctx_t *ctx, const char **builds)
 {
+	uint32_t i, k, n;
+	struct csr_t *csr;
 	struct ctrl_t *ctrl;
 	struct rule_t *rule;
-	struct rule_iter_t irule;
+	struct target_t *target;
 	struct queue_t *queue;
+	const char **paths;
 
-	queue = queue_new();
-	ctrl = ctrl_new(queue, 4);
+	for(n = 0; builds[n] != NULL; n++);
 
-	irule = rule_iter(ctx->rules);
-	while((rule = rule_next(&irule)) != NULL) {
-		uint32_t i;
-		struct target_t *target;
-		struct target_iter_t iter;
+	paths = malloc(n * sizeof(const char *));
+	for(i = 0; i < n; i++)
+		paths[i] = intern_path(builds[i]);
+
+	mk_reach(ctx, paths, n);
+	if(mk_cache_dirty(ctx->mkc))
+		graph_update(ctx, ".hammer.graph");
+
+	csr = ctx->csr = csr_new(ctx);
+	queue = queue_new(csr, ctx->log);
+	ctrl = ctrl_new(queue, ctx->log, ctx->opt->jobs);
+
+	for(i = 0; i < csr->nrule; i++) {
+		rule = csr->rule[i];
 
-		iter = target_iter(rule->gens);
-		while((target = target_next(&iter)) != NULL) {
-			for(i = 0; builds[i] != NULL; i++) {
-				if(strcmp(target->path, builds[i]) == 0)
+		for(k = csr->off[2 * i]; k < csr->off[2 * i + 1]; k++) {
+			uint32_t j;
+
+			target = csr->target[csr->adj[k]];
+			for(j = 0; j < n; j++) {
+				if(target->path == paths[j])
 					queue_recur(queue, rule);
 			}
 
@@ -65,34 +149,40 @@ void ctx_run(struct rt_ctx_t *ctx, const char **builds)
 		}
 	}
 
+	if(queue_sched(queue) > 0)
+		cli_err("Cannot build with dependency cycles.");
+
+	ctx_stat(ctx);
+
+	if(ctx->digest != NULL)
+		ctx_digest(ctx);
+
 	for(;;) {
-		while(!ctrl_avail(ctrl))
-			ctrl_wait(ctrl);
+		while(ctrl_wait(ctrl, false));
 
 		rule = queue_rem(queue);
 		if(rule == NULL) {
 			if(!ctrl_busy(ctrl))
 				break;
 
-			ctrl_wait(ctrl);
+			ctrl_wait(ctrl, true);
 			continue;
 		}
 
-		struct target_t *target;
-		struct target_iter_t iter;
+		bool spec = false, stale;
 		int64_t min = INT64_MAX - 1, max = INT64_MIN + 1;
 
-		iter = target_iter(rule->gens);
-		while((target = target_next(&iter)) != NULL) {
+		for(k = csr->off[2 * rule->idx]; k < csr->off[2 * rule->idx + 1]; k++) {
+			target = csr->target[csr->adj[k]];
 			if(target->flags & FLAG_SPEC)
-				min = INT64_MIN, max = INT64_MAX;
+				min = INT64_MIN, max = INT64_MAX, spec = true;
 
 			if(target_mtime(target) < min)
 				min = target_mtime(target);
 		}
 
-		iter = target_iter(rule->deps);
-		while((target = target_next(&iter)) != NULL) {
+		for(k = csr->off[2 * rule->idx + 1]; k < csr->off[2 * rule->idx + 2]; k++) {
+			target = csr->target[csr->adj[k]];
 			if(target->flags & FLAG_SPEC)
 				continue;
 
@@ -100,28 +190,39 @@ void ctx_run(struct rt_ctx_t *ctx, const char **builds)
 				max = target_mtime(target);
 		}
 
-		iter = target_iter(rule->gens);
-		if((max > min) || ctx->opt->force) {
-			iter = target_iter(rule->gens);
-			while((target = target_next(&iter)) != NULL) {
-				char *path, *iter;
+		stale = (max > min) || ctx->opt->force;
+
+		if((ctx->digest != NULL) && !spec) {
+			bool known, same;
+			const char *path = rule->gens->inst->target->path;
+
+			known = digest_known(ctx->digest, path);
+			same = digest_check(ctx->digest, path, digest_rule(ctx->digest, rule));
+			if(known && (min != INT64_MIN))
+				stale = !same || ctx->opt->force;
+		}
+
+		if(!stale && !spec && (rule->seq != NULL) && (rule->seq->head != NULL)) {
+			const struct log_rec_t *rec;
+
+			rec = log_find(ctx->log, rule->gens->inst->target->path);
+			if((rec == NULL) || (rec->stat != 0) || (rec->hash != seq_hash(rule->seq)))
+				stale = true;
+		}
 
+		if(stale) {
+			for(k = csr->off[2 * rule->idx]; k < csr->off[2 * rule->idx + 1]; k++) {
+				target = csr->target[csr->adj[k]];
 				if(target->flags & FLAG_SPEC)
 					continue;
 
 				//FIXME parent directory option
-				path = strdup(target->path);
-				iter = path;
-				while((iter = strchr(iter, '/')) != NULL) {
-					*iter = '\0';
-					os_mkdir(path);
-					*iter = '/';
-					iter++;
-				}
-
-				free(path);
+				os_mkdirs(target->path);
 			}
 
+			while(!ctrl_avail(ctrl))
+				ctrl_wait(ctrl, true);
+
 			ctrl_add(ctrl, rule);
 		}
 		else
@@ -129,15 +230,347 @@ void ctx_run(struct rt_ctx_t *ctx, const char **builds)
 	}
 
 	while(ctrl_busy(ctrl))
-		ctrl_wait(ctrl);
+		ctrl_wait(ctrl, true);
 
 	queue_delete(queue);
 	ctrl_delete(ctrl);
+	free(paths);
+}
+
+
+/**
+ * Compute the digests of all source files in the requested subgraph in
+ * parallel, before any rule runs.
+ *   @ctx: The context.
+ */
+void ctx_digest(struct rt_ctx_t *ctx)
+{
+	uint32_t i, k, n = 0, max = 64;
+	const char **paths;
+	struct target_t *target;
+	struct csr_t *csr = ctx->csr;
+
+	paths = malloc(max * sizeof(const char *));
+
+	for(i = 0; i < csr->nrule; i++) {
+		if(!csr->rule[i]->add)
+			continue;
+
+		for(k = csr->off[2 * i + 1]; k < csr->off[2 * i + 2]; k++) {
+			target = csr->target[csr->adj[k]];
+			if(target->flags & (FLAG_BUILD | FLAG_SPEC | FLAG_DIGEST))
+				continue;
+
+			if(n == max)
+				paths = realloc(paths, (max *= 2) * sizeof(const char *));
+
+			target->flags |= FLAG_DIGEST;
+			paths[n++] = target->path;
+		}
+	}
+
+	digest_files(ctx->digest, paths, n, NULL);
+	free(paths);
+}
+
+
+/**
+ * Retrieve the modification times of all targets in the requested subgraph
+ * as a batch, filling the cache before any rule is considered.
+ *   @ctx: The context.
+ */
+void ctx_stat(struct rt_ctx_t *ctx)
+{
+	uint32_t i, k, n = 0, max = 64;
+	int64_t *mtime;
+	const char **paths;
+	struct target_t **list;
+	struct target_t *target;
+	struct csr_t *csr = ctx->csr;
+
+	list = malloc(max * sizeof(struct target_t *));
+
+	for(i = 0; i < csr->nrule; i++) {
+		if(!csr->rule[i]->add)
+			continue;
+
+		for(k = csr->off[2 * i]; k < csr->off[2 * i + 2]; k++) {
+			target = csr->target[csr->adj[k]];
+			if((target->flags & (FLAG_SPEC | FLAG_STAT)) || (target->mtime != -1))
+				continue;
+
+			if(n == max)
+				list = realloc(list, (max *= 2) * sizeof(struct target_t *));
+
+			target->flags |= FLAG_STAT;
+			list[n++] = target;
+		}
+	}
+
+	paths = malloc(n * sizeof(const char *));
+	mtime = malloc(n * sizeof(int64_t));
+
+	for(i = 0; i < n; i++)
+		paths[i] = list[i]->path;
+
+	os_mtimes(paths, mtime, n);
+
+	for(i = 0; i < n; i++) {
+		list[i]->mtime = mtime[i];
+		list[i]->flags &= ~FLAG_STAT;
+	}
+
+	free(list);
+	free(paths);
+	free(mtime);
+}
+
+
+/**
+ * Record a file about to be read by evaluation, along with its size,
+ * modification time and digest.
+ *   @ctx: The context.
+ *   @path: The path.
+ */
+void ctx_source(struct rt_ctx_t *ctx, const char *path)
+{
+	struct source_t *src;
+
+	ctx->src = realloc(ctx->src, (ctx->nsrc + 1) * sizeof(struct source_t));
+	src = &ctx->src[ctx->nsrc++];
+	src->path = intern_path(path);
+
+	if(os_stat(src->path, &src->size, &src->mtime))
+		src->hash = digest_file(src->path);
+	else
+		src->size = -1, src->mtime = 0, src->hash = 0;
+}
+
+/**
+ * Print a value from evaluation, separating its strings by spaces. The
+ * output is also recorded for the graph cache.
+ *   @ctx: The context.
+ *   @val: The value.
+ */
+void ctx_print(struct rt_ctx_t *ctx, struct val_t *val)
+{
+	uint32_t i;
+	size_t len, off = ctx->nout;
+	const char *str;
+
+	for(i = 0; i < val_len(val); i++) {
+		str = val_get(val, i);
+		len = strlen(str);
+
+		ctx->out = realloc(ctx->out, ctx->nout + len + 2);
+		memcpy(ctx->out + ctx->nout, str, len);
+		ctx->nout += len;
+
+		if(i + 1 < val_len(val))
+			ctx->out[ctx->nout++] = ' ';
+
+		ctx->out[ctx->nout] = '\0';
+	}
+
+	if(ctx->nout > off)
+		print("%s", ctx->out + off);
 }
 
+/**
+ * Prefetch job structure.
+ *   @cache: Optional. The syntax tree cache.
+ *   @list: The files to read.
+ */
+struct fetch_job_t {
+	struct ast_cache_t *cache;
+	struct fetch_t **list;
+};
+
+/**
+ * Read and parse files in parallel ahead of evaluation. Files already loaded
+ * or waiting to be taken are skipped. Each file is taken by a later call to
+ * `ctx_load`, so evaluation still happens in order on the calling thread.
+ *   @ctx: The context.
+ *   @val: The paths.
+ */
+void ctx_fetch(struct rt_ctx_t *ctx, struct val_t *val)
+{
+	uint32_t i, cnt = 0;
+	const char *path;
+	struct fetch_t *fetch;
+	struct fetch_job_t job;
+
+	job.cache = ctx->cache;
+	job.list = malloc(val_len(val) * sizeof(struct fetch_t *));
+
+	for(i = 0; i < val_len(val); i++) {
+		path = intern_path(val_get(val, i));
+		for(fetch = ctx->fetch; fetch != NULL; fetch = fetch->next) {
+			if(fetch->path == path)
+				break;
+		}
+
+		if(fetch == NULL)
+			job.list[cnt++] = ctx_entry(ctx, intern_str(val_get(val, i)), path);
+	}
+
+	if(cnt > 0)
+		os_par(ctx_proc, &job, cnt);
+
+	free(job.list);
+}
 
 /**
- * Retrieve a target, creating it if required.
+ * Prefetch the files imported or included by the top level of a block whose
+ * paths are plain literals.
+ *   @ctx: The context.
+ *   @top: The block.
+ */
+void ctx_prefetch(struct rt_ctx_t *ctx, struct ast_block_t *top)
+{
+	struct raw_t *raw;
+	struct val_t *val = NULL;
+	struct ast_stmt_t *stmt;
+
+	for(stmt = top->stmt; stmt != NULL; stmt = stmt->next) {
+		if(stmt->tag != ast_inc_v)
+			continue;
+
+		for(raw = stmt->data.inc->imm->raw; raw != NULL; raw = raw->next) {
+			if(raw->lit)
+				val_add_ref(&val, false, intern_str(raw->str));
+		}
+	}
+
+	if(val_len(val) > 1)
+		ctx_fetch(ctx, val);
+
+	val_clear(val);
+}
+
+/**
+ * Load a file for evaluation. Each file is read and parsed once per run,
+ * keyed by its canonical path and identity, and the context keeps the tree
+ * until it is deleted. The first time a file is taken, it is registered as
+ * a source, its syntax error, if any, is reported so that errors appear in
+ * evaluation order, and its top level imports are prefetched.
+ *   @ctx: The context.
+ *   @path: The path.
+ *   &returns: The block, or null if the file could not be opened.
+ */
+struct ast_block_t *ctx_load(struct rt_ctx_t *ctx, const char *path)
+{
+	bool found;
+	const char *canon;
+	struct os_ident_t id;
+	struct fetch_t *fetch;
+	struct fetch_job_t job;
+
+	canon = intern_path(path);
+	found = os_ident(canon, &id);
+
+	for(fetch = ctx->fetch; fetch != NULL; fetch = fetch->next) {
+		if((fetch->path == canon) && (fetch->found == found) && (!found || (memcmp(&fetch->id, &id, sizeof(struct os_ident_t)) == 0)))
+			break;
+	}
+
+	if(fetch == NULL) {
+		fetch = ctx_entry(ctx, intern_str(path), canon);
+		job = (struct fetch_job_t){ ctx->cache, &fetch };
+		ctx_proc(&job, 0);
+	}
+
+	if(fetch->err != NULL) {
+		fprintf(stderr, "%s\n", fetch->err);
+		exit(1);
+	}
+
+	if(!fetch->used) {
+		fetch->used = true;
+
+		ctx->src = realloc(ctx->src, (ctx->nsrc + 1) * sizeof(struct source_t));
+		ctx->src[ctx->nsrc++] = fetch->src;
+
+		if(fetch->top != NULL)
+			ctx_prefetch(ctx, fetch->top);
+	}
+
+	return fetch->top;
+}
+
+/**
+ * Add a file to the loaded files of a context.
+ *   @ctx: The context.
+ *   @name: The interned path used to load the file.
+ *   @path: The interned canonical path.
+ *   &returns: The unread file.
+ */
+struct fetch_t *ctx_entry(struct rt_ctx_t *ctx, const char *name, const char *path)
+{
+	struct fetch_t *fetch;
+
+	fetch = malloc(sizeof(struct fetch_t));
+	*fetch = (struct fetch_t){ path, name, { 0, 0, 0, 0 }, false, false, false, NULL, NULL, { path, -1, 0, 0 }, ctx->fetch };
+	ctx->fetch = fetch;
+
+	return fetch;
+}
+
+/**
+ * Read, digest, and parse a single file, called in parallel. The tree is
+ * taken from the syntax tree cache when the file matches its record, and
+ * syntax errors are trapped and kept with the file.
+ *   @arg: The prefetch job.
+ *   @idx: The file index.
+ */
+void ctx_proc(void *arg, uint32_t idx)
+{
+	struct loc_trap_t trap;
+	struct fetch_job_t *job = arg;
+	struct fetch_t *fetch = job->list[idx];
+
+	fetch->found = os_ident(fetch->path, &fetch->id);
+	if(!fetch->found) {
+		memset(&fetch->id, 0, sizeof(struct os_ident_t));
+		return;
+	}
+
+	fetch->src = (struct source_t){ fetch->path, fetch->id.size, fetch->id.mtime, digest_file(fetch->path) };
+
+	if(job->cache != NULL)
+		fetch->top = ast_cache_get(job->cache, fetch);
+
+	if(fetch->top != NULL) {
+		fetch->cached = true;
+		return;
+	}
+
+	loc_trap = &trap;
+	if(setjmp(trap.env) == 0)
+		fetch->top = ham_load(fetch->name);
+	else
+		fetch->err = trap.msg;
+
+	loc_trap = NULL;
+}
+
+/**
+ * Register a makedep file, read once evaluation completes or when its
+ * owning rule is needed by a build.
+ *   @ctx: The context.
+ *   @path: The path.
+ */
+void ctx_mkdep(struct rt_ctx_t *ctx, const char *path)
+{
+	ctx->mk = realloc(ctx->mk, (ctx->nmk + 1) * sizeof(const char *));
+	ctx->mk[ctx->nmk++] = intern_path(path);
+}
+
+
+/**
+ * Retrieve a target, creating it if required. Targets are keyed by their
+ * canonical path, and a new target keeps the path as written so that recipe
+ * variables expand to it, such as `./gen.sh` instead of `gen.sh`.
  *   @ctx: The context.
  *   @spec: The special flag.
  *   @path: The path.
@@ -145,11 +578,13 @@ void ctx_run(struct rt_ctx_t *ctx, const char **builds)
  */
 struct target_t *ctx_target(struct rt_ctx_t *ctx, bool spec, const char *path)
 {
+	const char *key;
 	struct target_t *target;
 
-	target = map_get(ctx->map, spec, path);
+	key = spec ? intern_str(path) : intern_path(path);
+	target = map_get(ctx->map, spec, key);
 	if(target == NULL) {
-		target = rt_ref_new(spec, strdup(path));
+		target = rt_ref_new(ctx->arena, spec, key, spec ? key : intern_str(path));
 		map_add(ctx->map, target);
 	}
 
@@ -175,7 +610,6 @@ struct rule_t *ctx_rule(struct rt_ctx_t *ctx, const char *id, struct target_list
 	}
 	else {
 		struct target_t *target;
-		struct target_inst_t **inst;
 		struct target_iter_t iter;
 
 		iter = target_iter(gens);
@@ -192,27 +626,15 @@ struct rule_t *ctx_rule(struct rt_ctx_t *ctx, const char *id, struct target_list
 
 			iter = target_iter(gens);
 			while((target = target_next(&iter)) != NULL) {
-				if(!target_list_contains(rule->gens, target))
+				if(target->rule != rule)
 					fatal("Partial rules must have matching target lists.");
 			}
 
-			inst = &rule->deps->inst;
-			while(*inst != NULL)
-				inst = &(*inst)->next;
-
-			*inst = deps->inst;
-			deps->inst = NULL;
-
-			iter = target_iter(deps);
-			while((target = target_next(&iter)) != NULL)
-				target_conn(target, rule);
-
-			target_list_delete(gens);
-			target_list_delete(deps);
+			target_list_move(rule->deps, deps);
 		}
 		else {
-			rule = rule_new(id ? strdup(id) : NULL, gens, deps, NULL);
-			rule_list_add(ctx->rules, rule);
+			rule = rule_new(ctx->arena, id ? strdup(id) : NULL, gens, deps, NULL);
+			rule_list_add(ctx->arena, ctx->rules, rule);
 
 			iter = target_iter(gens);
 			while((target = target_next(&iter)) != NULL) {
@@ -221,12 +643,54 @@ struct rule_t *ctx_rule(struct rt_ctx_t *ctx, const char *id, struct target_list
 
 				target->rule = rule;
 			}
-
-			iter = target_iter(deps);
-			while((target = target_next(&iter)) != NULL)
-				target_conn(target, rule);
 		}
 	}
 
 	return rule;
 }
+
+/**
+ * Add dependencies to the rules of a set of targets, regardless of their
+ * commands. Targets without a rule are given a new rule without commands.
+ *   @ctx: The context.
+ *   @gens: Consumed. The set of targets.
+ *   @deps: Consumed. The set of dependency targets.
+ */
+void ctx_deps(struct rt_ctx_t *ctx, struct target_list_t *gens, struct target_list_t *deps)
+{
+	struct rule_t *rule;
+	struct target_t *target, *dep;
+	struct target_list_t *orphan, *copy;
+	struct target_inst_t *inst;
+	struct target_iter_t iter;
+
+	orphan = target_list_new(ctx->arena);
+
+	for(inst = gens->inst; inst != NULL; inst = inst->next) {
+		rule = inst->target->rule;
+		if(rule == NULL) {
+			target_list_add(ctx->arena, orphan, inst->target);
+			continue;
+		}
+
+		iter = target_iter(gens);
+		while(((target = target_next(&iter)) != inst->target) && (target->rule != rule));
+
+		if(target != inst->target)
+			continue;
+
+		iter = target_iter(deps);
+		while((dep = target_next(&iter)) != NULL)
+			target_list_add(ctx->arena, rule->deps, dep);
+	}
+
+	if(orphan->inst != NULL) {
+		copy = target_list_new(ctx->arena);
+
+		iter = target_iter(deps);
+		while((dep = target_next(&iter)) != NULL)
+			target_list_add(ctx->arena, copy, dep);
+
+		ctx_rule(ctx, NULL, orphan, copy);
+	}
+}
@@ -0,0 +1,464 @@
+#include "inc.h"
+
+
+/*
+ * digest definitions
+ */
+#define DIG_MAGIC "HAMDIG1"
+#define DIG_HDR   8
+#define DIG_RACY  2000000
+
+#define DIG_P1 0x9e3779b185ebca87
+#define DIG_P2 0xc2b2ae3d27d4eb4f
+#define DIG_P3 0x165667b19e3779f9
+#define DIG_P4 0x85ebca77c2b2ae63
+
+/**
+ * Digest record structure. Records are stored back-to-back in the database
+ * file, each followed by its null-terminated path padded to 8 bytes.
+ *   @hash: The digest.
+ *   @size, mtime: The file size and modification time.
+ *   @rule: Rule flag, set for rule input digests.
+ *   @len: The path length.
+ */
+struct dig_rec_t {
+	uint64_t hash;
+	int64_t size, mtime;
+	uint32_t rule, len;
+};
+
+/**
+ * Digest job structure.
+ *   @path: The file path.
+ *   @size, mtime: The size and modification time, updated if changed.
+ *   @hash: The digest, updated if changed.
+ */
+struct dig_job_t {
+	const char *path;
+	int64_t size, mtime;
+	uint64_t hash;
+};
+
+/*
+ * digest declarations
+ */
+struct dig_ent_t *digest_get(struct digest_t *db, const char *path, bool rule);
+void digest_put(struct digest_t *db, const char *path, bool rule, int64_t size, int64_t mtime, uint64_t hash);
+void digest_save(struct digest_t *db);
+void digest_proc(void *arg, uint32_t idx);
+
+uint64_t digest_read(const uint8_t *ptr);
+uint64_t digest_round(uint64_t acc, uint64_t val);
+uint64_t digest_mix(uint64_t hash, uint64_t val);
+
+
+/**
+ * Open a digest database. Missing or invalid databases are treated as empty.
+ *   @path: The database path.
+ *   &returns: The database.
+ */
+struct digest_t *digest_open(const char *path)
+{
+	void *map;
+	size_t off, len, size;
+	struct digest_t *db;
+	const struct dig_rec_t *rec;
+
+	db = malloc(sizeof(struct digest_t));
+	db->path = path;
+	db->ent = malloc(64 * sizeof(struct dig_ent_t));
+	db->cnt = 0;
+	db->max = 64;
+	db->idx = calloc(128, sizeof(uint32_t));
+	db->mask = 127;
+
+	map = os_map(path, &size);
+	if((map != NULL) && (size >= DIG_HDR) && (memcmp(map, DIG_MAGIC, DIG_HDR) == 0)) {
+		off = DIG_HDR;
+		while((off + sizeof(struct dig_rec_t)) <= size) {
+			rec = (const struct dig_rec_t *)((const char *)map + off);
+			if(rec->len >= (size - off - sizeof(struct dig_rec_t)))
+				break;
+
+			len = sizeof(struct dig_rec_t) + (((size_t)rec->len + 8) & ~(size_t)7);
+			if((off + len) > size)
+				break;
+			else if(((const char *)(rec + 1))[rec->len] != '\0')
+				break;
+
+			digest_put(db, intern_str((const char *)(rec + 1)), rec->rule, rec->size, rec->mtime, rec->hash);
+			off += len;
+		}
+	}
+
+	if(map != NULL)
+		os_unmap(map, size);
+
+	db->dirty = false;
+
+	return db;
+}
+
+/**
+ * Close a digest database, saving it if modified.
+ *   @db: The database.
+ */
+void digest_close(struct digest_t *db)
+{
+	if(db->dirty)
+		digest_save(db);
+
+	free(db->ent);
+	free(db->idx);
+	free(db);
+}
+
+
+/**
+ * Lookup an entry in the database.
+ *   @db: The database.
+ *   @path: The interned path.
+ *   @rule: The rule flag.
+ *   &returns: The entry or null. Valid until the next insertion.
+ */
+struct dig_ent_t *digest_get(struct digest_t *db, const char *path, bool rule)
+{
+	uint32_t i;
+
+	for(i = hash64(rule, path) & db->mask; db->idx[i] != 0; i = (i + 1) & db->mask) {
+		if((db->ent[db->idx[i] - 1].path == path) && (db->ent[db->idx[i] - 1].rule == rule))
+			return &db->ent[db->idx[i] - 1];
+	}
+
+	return NULL;
+}
+
+/**
+ * Insert or update an entry in the database.
+ *   @db: The database.
+ *   @path: The interned path.
+ *   @rule: The rule flag.
+ *   @size, mtime: The size and modification time.
+ *   @hash: The digest.
+ */
+void digest_put(struct digest_t *db, const char *path, bool rule, int64_t size, int64_t mtime, uint64_t hash)
+{
+	uint32_t i, k;
+	struct dig_ent_t *ent;
+
+	ent = digest_get(db, path, rule);
+	if(ent != NULL) {
+		if((ent->size != size) || (ent->mtime != mtime) || (ent->hash != hash))
+			db->dirty = true;
+
+		*ent = (struct dig_ent_t){ path, rule, size, mtime, hash };
+		return;
+	}
+
+	if(db->cnt == db->max) {
+		db->max *= 2;
+		db->ent = realloc(db->ent, db->max * sizeof(struct dig_ent_t));
+	}
+
+	db->ent[db->cnt++] = (struct dig_ent_t){ path, rule, size, mtime, hash };
+	db->dirty = true;
+
+	if((2 * db->cnt) > (db->mask + 1)) {
+		db->mask = 2 * db->mask + 1;
+		free(db->idx);
+		db->idx = calloc(db->mask + 1, sizeof(uint32_t));
+
+		for(k = 0; k < db->cnt; k++) {
+			i = hash64(db->ent[k].rule, db->ent[k].path) & db->mask;
+			while(db->idx[i] != 0)
+				i = (i + 1) & db->mask;
+
+			db->idx[i] = k + 1;
+		}
+	}
+	else {
+		i = hash64(rule, path) & db->mask;
+		while(db->idx[i] != 0)
+			i = (i + 1) & db->mask;
+
+		db->idx[i] = db->cnt;
+	}
+}
+
+/**
+ * Save the database, replacing the previous file.
+ *   @db: The database.
+ */
+void digest_save(struct digest_t *db)
+{
+	FILE *file;
+	char *tmp;
+	uint32_t i;
+	struct dig_rec_t rec;
+	char pad[8] = { 0 };
+
+	tmp = str_fmt("%s.tmp", db->path);
+	file = fopen(tmp, "wb");
+	if(file == NULL) {
+		free(tmp);
+		return;
+	}
+
+	fwrite(DIG_MAGIC, 1, DIG_HDR, file);
+
+	for(i = 0; i < db->cnt; i++) {
+		rec = (struct dig_rec_t){ db->ent[i].hash, db->ent[i].size, db->ent[i].mtime, db->ent[i].rule, strlen(db->ent[i].path) };
+		fwrite(&rec, sizeof(rec), 1, file);
+		fwrite(db->ent[i].path, 1, rec.len, file);
+		fwrite(pad, 1, ((rec.len + 8) & ~7) - rec.len, file);
+	}
+
+	if((fclose(file) != 0) || (rename(tmp, db->path) != 0))
+		remove(tmp);
+
+	free(tmp);
+}
+
+
+/**
+ * Compute the digests of a set of files in parallel. Stored digests are
+ * reused for files whose size and modification time have not changed.
+ *   @db: The database.
+ *   @paths: The interned file paths.
+ *   @n: The number of files.
+ *   @out: Optional. Out. The digests.
+ */
+void digest_files(struct digest_t *db, const char **paths, uint32_t n, uint64_t *out)
+{
+	uint32_t i;
+	struct dig_ent_t *ent;
+	struct dig_job_t *job;
+
+	job = malloc(n * sizeof(struct dig_job_t));
+
+	for(i = 0; i < n; i++) {
+		ent = digest_get(db, paths[i], false);
+		if(ent != NULL)
+			job[i] = (struct dig_job_t){ paths[i], ent->size, ent->mtime, ent->hash };
+		else
+			job[i] = (struct dig_job_t){ paths[i], -1, INT64_MIN, 0 };
+	}
+
+	os_par(digest_proc, job, n);
+
+	for(i = 0; i < n; i++) {
+		digest_put(db, paths[i], false, job[i].size, job[i].mtime, job[i].hash);
+		if(out != NULL)
+			out[i] = job[i].hash;
+	}
+
+	free(job);
+}
+
+/**
+ * Process a single digest job, called in parallel. Files modified too
+ * recently to be distinguished by their modification time are stored with
+ * an invalid size so that they are hashed again on the next use.
+ *   @arg: The job array.
+ *   @idx: The job index.
+ */
+void digest_proc(void *arg, uint32_t idx)
+{
+	int64_t size, mtime;
+	struct dig_job_t *job = (struct dig_job_t *)arg + idx;
+
+	if(!os_stat(job->path, &size, &mtime)) {
+		job->size = -1;
+		job->mtime = INT64_MIN;
+		job->hash = 0;
+	}
+	else if((size != job->size) || (mtime != job->mtime)) {
+		job->size = size;
+		job->mtime = mtime;
+		job->hash = digest_file(job->path);
+
+		if(digest_racy(mtime))
+			job->size = -1;
+	}
+}
+
+/**
+ * Compute the input digest of a rule from the paths and contents of its
+ * non-special dependencies, in order.
+ *   @db: The database.
+ *   @rule: The rule.
+ *   &returns: The digest.
+ */
+uint64_t digest_rule(struct digest_t *db, struct rule_t *rule)
+{
+	uint32_t i, n = 0;
+	uint64_t hash = DIG_P1, *sum;
+	const char **paths;
+	struct target_t *target;
+	struct target_iter_t iter;
+
+	iter = target_iter(rule->deps);
+	while((target = target_next(&iter)) != NULL)
+		n++;
+
+	paths = malloc(n * sizeof(const char *));
+	sum = malloc(n * sizeof(uint64_t));
+
+	n = 0;
+	iter = target_iter(rule->deps);
+	while((target = target_next(&iter)) != NULL) {
+		if(!(target->flags & FLAG_SPEC))
+			paths[n++] = target->path;
+	}
+
+	digest_files(db, paths, n, sum);
+
+	for(i = 0; i < n; i++)
+		hash = digest_mix(hash64(hash, paths[i]), sum[i]);
+
+	free(paths);
+	free(sum);
+
+	return hash;
+}
+
+/**
+ * Check and update the stored input digest of a rule.
+ *   @db: The database.
+ *   @path: The interned path of the primary target.
+ *   @hash: The current input digest.
+ *   &returns: True if the digest matches the stored digest.
+ */
+bool digest_check(struct digest_t *db, const char *path, uint64_t hash)
+{
+	struct dig_ent_t *ent;
+
+	ent = digest_get(db, path, true);
+	if((ent != NULL) && (ent->hash == hash))
+		return true;
+
+	digest_put(db, path, true, 0, 0, hash);
+
+	return false;
+}
+
+/**
+ * Determine if a rule has a stored input digest.
+ *   @db: The database.
+ *   @path: The interned path of the primary target.
+ *   &returns: True if a digest is stored.
+ */
+bool digest_known(struct digest_t *db, const char *path)
+{
+	return digest_get(db, path, true) != NULL;
+}
+
+
+/**
+ * Compute the digest of a file's contents.
+ *   @path: The file path.
+ *   &returns: The digest. Missing and empty files have the same digest.
+ */
+uint64_t digest_file(const char *path)
+{
+	void *map;
+	size_t len;
+	uint64_t hash;
+
+	map = os_map(path, &len);
+	hash = digest_buf(map, len);
+
+	if(map != NULL)
+		os_unmap(map, len);
+
+	return hash;
+}
+
+/**
+ * Determine if a modification time is too recent to reliably detect a
+ * later change to the file.
+ *   @mtime: The modification time.
+ *   &returns: True if too recent.
+ */
+bool digest_racy(int64_t mtime)
+{
+	return (os_time() - mtime) < DIG_RACY;
+}
+
+/**
+ * Compute the digest of a buffer. The buffer is consumed in 32-byte stripes
+ * across four independent lanes so that the main loop can be vectorized.
+ *   @buf: Optional. The buffer.
+ *   @len: The length.
+ *   &returns: The digest.
+ */
+uint64_t digest_buf(const void *buf, size_t len)
+{
+	size_t i;
+	uint64_t hash, acc[4] = { DIG_P1 + DIG_P2, DIG_P2, 0, -DIG_P1 };
+	const uint8_t *ptr = buf;
+
+	for(; len >= 32; len -= 32, ptr += 32) {
+		for(i = 0; i < 4; i++)
+			acc[i] = digest_round(acc[i], digest_read(ptr + 8 * i));
+	}
+
+	hash = ((acc[0] << 1) | (acc[0] >> 63)) + ((acc[1] << 7) | (acc[1] >> 57)) + ((acc[2] << 12) | (acc[2] >> 52)) + ((acc[3] << 18) | (acc[3] >> 46));
+	for(i = 0; i < 4; i++)
+		hash = (hash ^ digest_round(0, acc[i])) * DIG_P1 + DIG_P4;
+
+	for(; len >= 8; len -= 8, ptr += 8)
+		hash = digest_mix(hash, digest_read(ptr));
+
+	for(; len > 0; len--, ptr++)
+		hash = digest_mix(hash, *ptr);
+
+	return digest_mix(hash, (uint64_t)(ptr - (const uint8_t *)buf));
+}
+
+/**
+ * Read an unaligned 64-bit little-endian value.
+ *   @ptr: The pointer.
+ *   &returns: The value.
+ */
+uint64_t digest_read(const uint8_t *ptr)
+{
+	uint32_t i;
+	uint64_t val = 0;
+
+	for(i = 0; i < 8; i++)
+		val |= (uint64_t)ptr[i] << (8 * i);
+
+	return val;
+}
+
+/**
+ * Accumulate a value into a lane.
+ *   @acc: The lane accumulator.
+ *   @val: The value.
+ *   &returns: The new accumulator.
+ */
+uint64_t digest_round(uint64_t acc, uint64_t val)
+{
+	acc += val * DIG_P2;
+	acc = (acc << 31) | (acc >> 33);
+
+	return acc * DIG_P1;
+}
+
+/**
+ * Mix a value into a hash.
+ *   @hash: The hash.
+ *   @val: The value.
+ *   &returns: The new hash.
+ */
+uint64_t digest_mix(uint64_t hash, uint64_t val)
+{
+	hash ^= digest_round(0, val);
+	hash = (hash << 27) | (hash >> 37);
+	hash = hash * DIG_P1 + DIG_P4;
+	hash ^= hash >> 29;
+	hash *= DIG_P3;
+
+	return hash ^ (hash >> 32);
+}
@@ -19,6 +19,7 @@ void eval_top(struct ast_block_t *block, struct rt_ctx_t *ctx)
 		eval_stmt(stmt, ctx, env);
 
 	rt_env_delete(env);
+	mk_assign(ctx);
 }
 
 /**
@@ -44,12 +45,13 @@ void eval_stmt(struct ast_stmt_t *stmt, struct rt_ctx_t *ctx, struct env_t *env)
 {
 	switch(stmt->tag) {
 	case ast_bind_v: {
-		char *id;
+		char *id = NULL;
 		struct bind_t *get = NULL;
 		struct rt_obj_t obj;
 		struct ast_bind_t *bind = stmt->data.bind;
 
-		id = rt_eval_str(bind->id, ctx, env, stmt->loc);
+		if((bind->id->hash == 0) || (bind->id->str[0] == '$'))
+			id = rt_eval_str(bind->id, ctx, env, stmt->loc);
 
 		switch(bind->tag) {
 		case ast_val_v:
@@ -70,37 +72,38 @@ void eval_stmt(struct ast_stmt_t *stmt, struct rt_ctx_t *ctx, struct env_t *env)
 		} break;
 		}
 
-		get = rt_env_lookup(env, id);
+		get = id ? rt_env_lookup(env, id) : env_probe(env, bind->id->str, bind->id->hash);
 		if(get != NULL) {
 			if(bind->add)
-				rt_obj_add(get->obj, obj, stmt->loc);
+				rt_obj_add(&get->obj, obj, stmt->loc);
 			else
 				rt_obj_set(&get->obj, obj);
 
 			free(id);
 		}
 		else
-			env_put(env, bind_new(id, obj, stmt->loc));
+			env_put(env, bind_new(id ? id : strdup(bind->id->str), obj, stmt->loc));
 	} break;
 
 	case syn_v: {
 		struct ast_rule_t *syn = stmt->data.syn;
 		struct target_list_t *gens, *deps;
-		struct val_t *gen, *dep, *iter;
+		uint32_t i;
+		struct val_t *gen, *dep;
 		struct link_t *link;
 		struct ast_cmd_t *proc;
 		struct rule_t *rule;
 
-		gens = target_list_new();
-		deps = target_list_new();
+		gens = target_list_new(ctx->arena);
+		deps = target_list_new(ctx->arena);
 
 		gen = rt_eval_val(syn->gen, ctx, env, stmt->loc);
-		for(iter = gen; iter != NULL; iter = iter->next)
-			target_list_add(gens, ctx_target(ctx, iter->spec, iter->str));
+		for(i = 0; i < val_len(gen); i++)
+			target_list_add(ctx->arena, gens, ctx_target(ctx, val_spec(gen, i), val_get(gen, i)));
 
 		dep = rt_eval_val(syn->dep, ctx, env, stmt->loc);
-		for(iter = dep; iter != NULL; iter = iter->next)
-			target_list_add(deps, ctx_target(ctx, iter->spec, iter->str));
+		for(i = 0; i < val_len(dep); i++)
+			target_list_add(ctx->arena, deps, ctx_target(ctx, val_spec(dep, i), val_get(dep, i)));
 
 		rule = ctx_rule(ctx, NULL, gens, deps);
 		val_clear(gen);
@@ -138,11 +141,14 @@ void eval_stmt(struct ast_stmt_t *stmt, struct rt_ctx_t *ctx, struct env_t *env)
 
 		switch(obj.tag) {
 		case rt_val_v: {
-			struct val_t *iter;
+			uint32_t i;
+			struct val_t *val;
 
-			for(iter = obj.data.val; iter != NULL; iter = iter->next) {
+			for(i = 0; i < val_len(obj.data.val); i++) {
 				nest = rt_env_new(env);
-				env_put(nest, bind_new(strdup(loop->id), rt_obj_val(val_new(iter->spec, strdup(iter->str))), stmt->loc));
+				val = NULL;
+				val_add_copy(&val, obj.data.val, i);
+				env_put(nest, bind_new(strdup(loop->id), rt_obj_val(val), stmt->loc));
 				eval_stmt(loop->body, ctx, nest);
 				rt_env_delete(nest);
 			}
@@ -167,13 +173,10 @@ void eval_stmt(struct ast_stmt_t *stmt, struct rt_ctx_t *ctx, struct env_t *env)
 	} break;
 
 	case print_v: {
-		struct val_t *val, *iter;
+		struct val_t *val;
 
 		val = rt_eval_val(stmt->data.print->imm, ctx, env, stmt->loc);
-
-		for(iter = val; iter != NULL; iter = iter->next)
-			print("%s%s", iter->str, iter->next ? " " : "");
-
+		ctx_print(ctx, val);
 		val_clear(val);
 	} break;
 
@@ -213,7 +216,7 @@ struct rt_obj_t eval_imm(struct imm_t *imm, struct rt_ctx_t *ctx, struct env_t *
 
 	obj = eval_raw(imm->raw, ctx, env);
 	for(raw = imm->raw->next; raw != NULL; raw = raw->next)
-		rt_obj_add(obj, eval_raw(raw, ctx, env), loc);
+		rt_obj_add(&obj, eval_raw(raw, ctx, env), loc);
 
 	return obj;
 }
@@ -577,23 +580,22 @@ struct rt_obj_t exp_var(struct exp_t *exp)
  */
 void exp_flat(struct exp_t *exp, struct rt_obj_t obj)
 {
-	struct val_t *val, *orig;
+	uint32_t i;
+	struct val_t *val;
 
 	if(obj.tag != rt_val_v)
 		exp_err(exp, "Cannot convert non-value to a string.");
 
-	val = orig = obj.data.val;
-
-	while(val != NULL) {
-		buf_str(&exp->buf, val->str);
+	val = obj.data.val;
 
-		if(val->next != NULL)
+	for(i = 0; i < val_len(val); i++) {
+		if(i > 0)
 			buf_ch(&exp->buf, ' ');
 
-		val = val->next;
+		buf_str(&exp->buf, val_get(val, i));
 	}
 
-	val_clear(orig);
+	val_clear(val);
 }
 
 /**
@@ -612,14 +614,13 @@ struct rt_obj_t exp_bind(struct exp_t *exp)
 
 	if(*str == '@') {
 		struct target_inst_t *inst;
-		struct val_t *val = NULL, **iter = &val;
+		struct val_t *val = NULL;
 
 		if(exp->ctx->cur == NULL)
 			exp_err(exp, "Variable '$@' can only be used in recipes.");
 
 		for(inst = exp->ctx->cur->gens->inst; inst != NULL; inst = inst->next) {
-			*iter = val_new(false, strdup(inst->target->path));
-			iter = &(*iter)->next;
+			val_add_ref(&val, false, inst->target->name);
 		}
 
 		exp_adv(exp);
@@ -627,14 +628,13 @@ struct rt_obj_t exp_bind(struct exp_t *exp)
 	}
 	else if(*str == '^') {
 		struct target_inst_t *inst;
-		struct val_t *val = NULL, **iter = &val;
+		struct val_t *val = NULL;
 
 		if(exp->ctx->cur == NULL)
 			exp_err(exp, "Variable '$^' can only be used in recipes.");
 
 		for(inst = exp->ctx->cur->deps->inst; inst != NULL; inst = inst->next) {
-			*iter = val_new(false, strdup(inst->target->path));
-			iter = &(*iter)->next;
+			val_add_ref(&val, false, inst->target->name);
 		}
 
 		exp_adv(exp);
@@ -651,14 +651,13 @@ struct rt_obj_t exp_bind(struct exp_t *exp)
 			return rt_obj_null();
 
 		exp_adv(exp);
-		return rt_obj_val(val_new(inst->target->flags & FLAG_SPEC, strdup(inst->target->path)));
+		return rt_obj_val(val_ref(inst->target->flags & FLAG_SPEC, inst->target->name));
 	}
 	else if(*str == '*') {
-		struct val_t *val, **iter;
+		struct val_t *val;
 		struct rule_inst_t *inst;
 
 		val = NULL;
-		iter = &val;
 		for(inst = exp->ctx->rules->inst; inst != NULL; inst = inst->next) {
 			struct target_inst_t *ref;
 
@@ -666,12 +665,10 @@ struct rt_obj_t exp_bind(struct exp_t *exp)
 				if(ref->target->flags & FLAG_SPEC)
 					continue;
 
-				*iter = val_new(false, strdup(ref->target->path));
-				iter = &(*iter)->next;
+				val_add_ref(&val, false, ref->target->name);
 			}
 		}
 
-		*iter = NULL;
 		exp_adv(exp);
 		return rt_obj_val(val);
 	}
@@ -734,6 +731,23 @@ void exp_err(struct exp_t *exp, const char *fmt, ...)
 struct rt_obj_t eval_raw(struct raw_t *raw, struct rt_ctx_t *ctx, struct env_t *env)
 {
 	struct exp_t exp;
+	struct bind_t *bind;
+
+	if((raw->hash != 0) && (raw->str[0] == '$')) {
+		bind = env_find(env, raw->str + 1, raw->hash);
+		if(bind == NULL)
+			loc_err(loc_off(raw->loc, 1), "Unknown variable '%s'.", raw->str + 1);
+
+		return rt_obj_dup(bind->obj);
+	}
+
+	if(raw->lit)
+		return rt_obj_val(val_new(false, strdup(raw->str)));
+	else if(raw->tpl == NULL)
+		raw->tpl = tpl_new(raw->str, raw->loc);
+
+	if(raw->tpl != NULL)
+		return tpl_eval(raw->tpl, ctx, env);
 
 	exp.orig = exp.str = raw->str;
 	exp.loc = raw->loc;
@@ -775,7 +789,6 @@ struct val_t *rt_eval_val(struct imm_t *imm, struct rt_ctx_t *ctx, struct env_t
  */
 char *rt_eval_str(struct raw_t *raw, struct rt_ctx_t *ctx, struct env_t *env, struct loc_t loc)
 {
-	char *str;
 	struct val_t *val;
 	struct rt_obj_t obj;
 
@@ -784,13 +797,10 @@ char *rt_eval_str(struct raw_t *raw, struct rt_ctx_t *ctx, struct env_t *env, st
 		loc_err(loc, "String required.");
 
 	val = obj.data.val;
-	if((val == NULL) || (val->next != NULL))
+	if(val_len(val) != 1)
 		loc_err(loc, "String required.");
 
-	str = val->str;
-	free(val);
-
-	return str;
+	return val_take(val);
 }
 
 
@@ -843,7 +853,8 @@ void args_delete(struct rt_obj_t *args, uint32_t cnt)
 struct rt_obj_t fn_sub(struct rt_obj_t *args, uint32_t cnt, struct loc_t loc)
 {
 	struct buf_t buf;
-	struct val_t *val, *ret, **iter;
+	uint32_t i;
+	struct val_t *val, *ret;
 	const char *get, *put, *str, *find;
 
 	if(cnt != 3)
@@ -853,13 +864,14 @@ struct rt_obj_t fn_sub(struct rt_obj_t *args, uint32_t cnt, struct loc_t loc)
 	else if((val_len(args[1].data.val) != 1) || (val_len(args[2].data.val) != 1))
 		loc_err(loc, "Function `.sub` requires string values as arguments.");
 
-	iter = &ret;
-	get = args[1].data.val->str;
-	put = args[2].data.val->str;
+	ret = NULL;
+	val = args[0].data.val;
+	get = val_get(args[1].data.val, 0);
+	put = val_get(args[2].data.val, 0);
 
-	for(val = args[0].data.val; val != NULL; val = val->next) {
-		str = val->str;
-		buf = buf_new(strlen(val->str) + 1);
+	for(i = 0; i < val_len(val); i++) {
+		str = val_get(val, i);
+		buf = buf_new(strlen(str) + 1);
 
 		find = strstr(str, get);
 		while(find != NULL) {
@@ -871,12 +883,9 @@ struct rt_obj_t fn_sub(struct rt_obj_t *args, uint32_t cnt, struct loc_t loc)
 		}
 		buf_str(&buf, str);
 
-		*iter = val_new(val->spec, buf_done(&buf));
-		iter = &(*iter)->next;
+		val_add(&ret, val_spec(val, i), buf_done(&buf));
 	}
 
-	*iter = NULL;
-
 	return rt_obj_val(ret);
 }
 
@@ -902,10 +911,10 @@ bool pat_len(const char *str, uint32_t *pre, uint32_t *post)
 
 struct rt_obj_t fn_pat(struct rt_obj_t *args, uint32_t cnt, struct loc_t loc)
 {
-	uint32_t len, min, spre, spost, slen, rpre, rpost, rlen;
+	uint32_t i, len, min, spre, spost, slen, rpre, rpost, rlen;
 	struct buf_t buf;
-	struct val_t *val, *ret, **iter;
-	char *pat, *repl;
+	struct val_t *val, *ret;
+	const char *pat, *repl, *str;
 
 	if(cnt != 3)
 		loc_err(loc, "Function `.pat` requires 2 arguments.");
@@ -914,34 +923,32 @@ struct rt_obj_t fn_pat(struct rt_obj_t *args, uint32_t cnt, struct loc_t loc)
 	else if((val_len(args[1].data.val) != 1) || (val_len(args[2].data.val) != 1))
 		loc_err(loc, "Function `.sub` requires string values as arguments.");
 
-	pat = args[1].data.val->str;
-	repl = args[2].data.val->str;
+	pat = val_get(args[1].data.val, 0);
+	repl = val_get(args[2].data.val, 0);
 	slen = strlen(pat);
 	rlen = strlen(repl);
 
 	if(!pat_len(pat, &spre, &spost) || !pat_len(repl, &rpre, &rpost))
 		loc_err(loc, "Function `.pat` requires patterns as arguments (must contain a single '%').");
 
-	iter = &ret;
+	ret = NULL;
+	val = args[0].data.val;
 	min = spre + spost;
 
-	for(val = args[0].data.val; val != NULL; val = val->next) {
-		len = strlen(val->str);
-		if((len > min) && (memcmp(val->str, pat, spre) == 0) && (strcmp(val->str + len - spost, pat + slen - spost) == 0)) {
+	for(i = 0; i < val_len(val); i++) {
+		str = val_get(val, i);
+		len = strlen(str);
+		if((len > min) && (memcmp(str, pat, spre) == 0) && (strcmp(str + len - spost, pat + slen - spost) == 0)) {
 			buf = buf_new(32);
 			buf_mem(&buf, repl, rpre);
-			buf_mem(&buf, val->str + spre, len - spost - spre);
+			buf_mem(&buf, str + spre, len - spost - spre);
 			buf_str(&buf, repl + rlen - rpost);
 
-			*iter = val_new(val->spec, buf_done(&buf));
+			val_add(&ret, val_spec(val, i), buf_done(&buf));
 		}
 		else
-			*iter = val_new(val->spec, strdup(val->str));
-
-		iter = &(*iter)->next;
+			val_add_copy(&ret, val, i);
 	}
 
-	*iter = NULL;
-
 	return rt_obj_val(ret);
 }
@@ -0,0 +1,670 @@
+#include "inc.h"
+
+
+/*
+ * graph definitions
+ */
+#define GRAPH_MAGIC "HAMGRF4"
+#define GRAPH_NONE  UINT32_MAX
+
+/**
+ * Graph cache header structure. The header is followed by the source
+ * records, the word stream padded to 8 bytes, the string table padded to 8
+ * bytes, and the makedep cache section.
+ *   @magic: The magic string.
+ *   @nsrc, ntarget, nrule: The source, target and rule counts.
+ *   @nword: The number of words in the word stream.
+ *   @out: The printed output string offset, `GRAPH_NONE` if nothing was
+ *     printed.
+ *   @pad: Padding.
+ *   @nstr: The string table size.
+ *   @hash: The digest of everything following the header up to the makedep
+ *     cache section.
+ */
+struct graph_hdr_t {
+	char magic[8];
+	uint32_t nsrc, ntarget, nrule, nword, out, pad;
+	uint64_t nstr, hash;
+};
+
+/**
+ * Graph source record structure.
+ *   @hash: The content digest.
+ *   @size, mtime: The size and modification time, mtime minimum if the
+ *     digest must always be checked.
+ *   @path: The path string offset.
+ *   @pad: Padding.
+ */
+struct graph_src_t {
+	uint64_t hash;
+	int64_t size, mtime;
+	uint32_t path, pad;
+};
+
+/*
+ * graph declarations
+ */
+bool graph_fresh(struct source_t *src, bool *stale);
+void graph_rules(struct graph_rd_t *rd, struct rt_ctx_t *ctx, struct target_t **tgt, uint32_t ntarget, bool *own, uint32_t nrule);
+const char *graph_opt(struct graph_rd_t *rd);
+uint64_t graph_len(const struct graph_hdr_t *hdr);
+void graph_write(struct rt_ctx_t *ctx, const char *path, const void *body, size_t len);
+
+void graph_index(struct graph_wr_t *wr, struct target_t *target, uint32_t idx);
+uint32_t graph_lookup(struct graph_wr_t *wr, struct target_t *target);
+uint32_t graph_ptr(const void *ptr, uint32_t mask);
+
+
+/**
+ * Load an evaluated graph from the cache. The cache is only used if every
+ * file read by the evaluation that produced it is unchanged, as checked by
+ * size and modification time, falling back to the content digest. Command
+ * strings reference the mapped cache directly, and the output printed by
+ * the evaluation is restored for the caller to replay. The makedep records
+ * are loaded even if the graph is stale, since they only depend on the
+ * makedep files.
+ *   @ctx: The empty context.
+ *   @path: The cache path.
+ *   &returns: True if loaded, false if the cache is missing or stale.
+ */
+bool graph_load(struct rt_ctx_t *ctx, const char *path)
+{
+	void *map;
+	size_t size;
+	uint64_t len;
+	bool stale = false, keep, *own;
+	uint32_t i, spec;
+	const char *str;
+	struct graph_rd_t rd;
+	struct target_t **tgt;
+	struct source_t *src;
+	const struct graph_src_t *rec;
+	const struct graph_hdr_t *hdr;
+
+	map = os_map(path, &size);
+	if(map == NULL)
+		return false;
+
+	hdr = map;
+	if((size < sizeof(struct graph_hdr_t)) || (memcmp(hdr->magic, GRAPH_MAGIC, 8) != 0)) {
+		os_unmap(map, size);
+		return false;
+	}
+
+	len = graph_len(hdr);
+	if(len > size) {
+		os_unmap(map, size);
+		return false;
+	}
+
+	keep = mk_cache_load(ctx->mkc, (const char *)map + len, size - len);
+
+	rec = (const struct graph_src_t *)(hdr + 1);
+	rd.word = (const uint32_t *)(rec + hdr->nsrc);
+	rd.idx = 0;
+	rd.cnt = hdr->nword;
+	rd.str = (const char *)rd.word + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7);
+	rd.nstr = hdr->nstr;
+	rd.err = false;
+
+	if((hdr->nstr == 0) || ((hdr->nstr % 8) != 0) || (rd.str[hdr->nstr - 1] != '\0'))
+		goto fail;
+	else if((hdr->out != GRAPH_NONE) && (hdr->out >= hdr->nstr))
+		goto fail;
+	else if(digest_buf(hdr + 1, len - sizeof(struct graph_hdr_t)) != hdr->hash)
+		goto fail;
+
+	src = malloc(hdr->nsrc * sizeof(struct source_t));
+
+	for(i = 0; i < hdr->nsrc; i++) {
+		if(rec[i].path >= hdr->nstr)
+			break;
+
+		src[i] = (struct source_t){ rd.str + rec[i].path, rec[i].size, rec[i].mtime, rec[i].hash };
+		if(!graph_fresh(&src[i], &stale))
+			break;
+	}
+
+	if(i < hdr->nsrc) {
+		free(src);
+		goto fail;
+	}
+
+	own = calloc(hdr->ntarget, sizeof(bool));
+	rd.idx = 2 * hdr->ntarget;
+	graph_rules(&rd, NULL, NULL, hdr->ntarget, own, hdr->nrule);
+	free(own);
+
+	if(rd.err || (rd.idx != rd.cnt)) {
+		free(src);
+		goto fail;
+	}
+
+	tgt = malloc(hdr->ntarget * sizeof(struct target_t *));
+
+	rd.idx = 0;
+	for(i = 0; i < hdr->ntarget; i++) {
+		str = graph_str(&rd);
+		spec = graph_get(&rd);
+		str = intern_str(str);
+		tgt[i] = rt_ref_new(ctx->arena, spec, str, str);
+		map_add(ctx->map, tgt[i]);
+	}
+
+	graph_rules(&rd, ctx, tgt, hdr->ntarget, NULL, hdr->nrule);
+	free(tgt);
+
+	for(i = 0; i < hdr->nsrc; i++)
+		src[i].path = intern_str(src[i].path);
+
+	ctx->src = src;
+	ctx->nsrc = hdr->nsrc;
+
+	if(hdr->out != GRAPH_NONE) {
+		ctx->out = strdup(rd.str + hdr->out);
+		ctx->nout = strlen(ctx->out);
+	}
+
+	ctx->graph = map;
+	ctx->ngraph = size;
+
+	if(stale)
+		graph_save(ctx, path);
+
+	return true;
+
+fail:
+	if(keep) {
+		ctx->graph = map;
+		ctx->ngraph = size;
+	}
+	else
+		os_unmap(map, size);
+
+	return false;
+}
+
+/**
+ * Compute the length of the graph cache before the makedep cache section.
+ *   @hdr: The header.
+ *   &returns: The length.
+ */
+uint64_t graph_len(const struct graph_hdr_t *hdr)
+{
+	return sizeof(struct graph_hdr_t) + (uint64_t)hdr->nsrc * sizeof(struct graph_src_t) + (((uint64_t)hdr->nword * sizeof(uint32_t) + 7) & ~7) + hdr->nstr;
+}
+
+/**
+ * Check if a source file is unchanged, updating its record if only the
+ * size or modification time changed.
+ *   @src: The source record.
+ *   @stale: Out. Set if the record was updated.
+ *   &returns: True if unchanged.
+ */
+bool graph_fresh(struct source_t *src, bool *stale)
+{
+	int64_t size, mtime;
+
+	if(!os_stat(src->path, &size, &mtime))
+		return src->size < 0;
+	else if(src->size < 0)
+		return false;
+	else if((src->size == size) && (src->mtime == mtime))
+		return true;
+	else if(digest_file(src->path) != src->hash)
+		return false;
+
+	src->size = size;
+	src->mtime = mtime;
+	*stale = true;
+
+	return true;
+}
+
+/**
+ * Process the rules of the word stream, either validating them or adding
+ * them to the context.
+ *   @rd: The reader.
+ *   @ctx: Optional. The context, null to only validate.
+ *   @tgt: The targets, only used when adding.
+ *   @ntarget: The number of targets.
+ *   @own: The target ownership flags, only used when validating.
+ *   @nrule: The number of rules.
+ */
+void graph_rules(struct graph_rd_t *rd, struct rt_ctx_t *ctx, struct target_t **tgt, uint32_t ntarget, bool *own, uint32_t nrule)
+{
+	uint32_t i, k, j, n, m, idx;
+	bool append, spec;
+	const char *str, *in, *out;
+	struct rule_t *rule;
+	struct val_t *val;
+	struct rt_pipe_t *pipe, **ipipe;
+	struct target_list_t *list[2] = { NULL, NULL };
+
+	for(i = 0; (i < nrule) && !rd->err; i++) {
+		for(k = 0; k < 2; k++) {
+			n = graph_get(rd);
+			if((k == 0) && (n == 0))
+				rd->err = true;
+
+			if(ctx != NULL)
+				list[k] = target_list_new(ctx->arena);
+
+			for(j = 0; (j < n) && !rd->err; j++) {
+				idx = graph_get(rd);
+				if(idx >= ntarget)
+					rd->err = true;
+				else if(ctx != NULL)
+					target_list_add(ctx->arena, list[k], tgt[idx]);
+				else if(k == 0) {
+					if(own[idx])
+						rd->err = true;
+
+					own[idx] = true;
+				}
+			}
+		}
+
+		rule = (ctx != NULL) ? ctx_rule(ctx, NULL, list[0], list[1]) : NULL;
+
+		n = graph_get(rd);
+		for(k = 0; (k < n) && !rd->err; k++) {
+			str = graph_str(rd);
+			if(rule != NULL)
+				rule_mkdep(rule, intern_str(str));
+		}
+
+		n = graph_get(rd);
+		if(n == GRAPH_NONE)
+			continue;
+
+		if(rule != NULL)
+			rule->seq = seq_new();
+
+		for(k = 0; (k < n) && !rd->err; k++) {
+			pipe = NULL;
+			ipipe = &pipe;
+
+			m = graph_get(rd);
+			for(j = 0; (j < m) && !rd->err; j++) {
+				val = NULL;
+
+				idx = graph_get(rd);
+				while((idx-- > 0) && !rd->err) {
+					str = graph_str(rd);
+					spec = graph_get(rd);
+					if(ctx != NULL)
+						val_add_ref(&val, spec, str);
+				}
+
+				if(ctx != NULL) {
+					*ipipe = rt_pipe_new(val);
+					ipipe = &(*ipipe)->next;
+				}
+			}
+
+			in = graph_opt(rd);
+			out = graph_opt(rd);
+			append = graph_get(rd);
+
+			if(rule != NULL)
+				seq_add(rule->seq, pipe, in ? strdup(in) : NULL, out ? strdup(out) : NULL, append);
+		}
+	}
+}
+
+/**
+ * Read a word from the stream.
+ *   @rd: The reader.
+ *   &returns: The word, zero on error.
+ */
+uint32_t graph_get(struct graph_rd_t *rd)
+{
+	if(rd->idx >= rd->cnt) {
+		rd->err = true;
+		return 0;
+	}
+
+	return rd->word[rd->idx++];
+}
+
+/**
+ * Read a string from the stream.
+ *   @rd: The reader.
+ *   &returns: The string, empty on error.
+ */
+const char *graph_str(struct graph_rd_t *rd)
+{
+	uint32_t off;
+
+	off = graph_get(rd);
+	if(off >= rd->nstr) {
+		rd->err = true;
+		return "";
+	}
+
+	return rd->str + off;
+}
+
+/**
+ * Read an optional string from the stream.
+ *   @rd: The reader.
+ *   &returns: The string or null.
+ */
+const char *graph_opt(struct graph_rd_t *rd)
+{
+	uint32_t off;
+
+	off = graph_get(rd);
+	if(off == GRAPH_NONE)
+		return NULL;
+	else if(off >= rd->nstr) {
+		rd->err = true;
+		return "";
+	}
+
+	return rd->str + off;
+}
+
+
+/**
+ * Save an evaluated graph to the cache along with the makedep records. The
+ * serialized graph is kept on the context for `graph_update`. Failures are
+ * ignored, leaving no cache behind.
+ *   @ctx: The context.
+ *   @path: The cache path.
+ */
+void graph_save(struct rt_ctx_t *ctx, const char *path)
+{
+	char *body;
+	size_t len;
+	uint32_t i, k, n, ntarget = 0, nrule = 0;
+	struct graph_hdr_t hdr;
+	struct graph_src_t *rec;
+	struct graph_wr_t wr;
+	struct ent_t *ent;
+	struct cmd_t *cmd;
+	struct rt_pipe_t *pipe;
+	struct rule_t **rules;
+	struct rule_iter_t iter;
+	struct target_t *target, **targets;
+	struct target_iter_t titer;
+	struct target_list_t *list[2];
+
+	for(ent = ctx->map->ent; ent != NULL; ent = ent->next)
+		ntarget++;
+
+	iter = rule_iter(ctx->rules);
+	while(rule_next(&iter) != NULL)
+		nrule++;
+
+	wr.word = malloc(1024 * sizeof(uint32_t));
+	wr.nword = 0;
+	wr.maxword = 1024;
+	wr.str = malloc(4096);
+	wr.nstr = 0;
+	wr.maxstr = 4096;
+	wr.smask = 1023;
+	wr.scnt = 0;
+	wr.stab = calloc(wr.smask + 1, sizeof(uint32_t));
+	for(wr.tmask = 15; wr.tmask < 2 * ntarget; wr.tmask = 2 * wr.tmask + 1);
+	wr.ttab = malloc((wr.tmask + 1) * sizeof(struct target_t *));
+	wr.tidx = calloc(wr.tmask + 1, sizeof(uint32_t));
+
+	/* targets and rules are prepended on load, so store them oldest first */
+	targets = malloc(ntarget * sizeof(struct target_t *));
+	for(i = ntarget, ent = ctx->map->ent; ent != NULL; ent = ent->next)
+		targets[--i] = ent->target;
+
+	for(i = 0; i < ntarget; i++) {
+		graph_index(&wr, targets[i], i);
+		graph_word(&wr, graph_intern(&wr, targets[i]->path));
+		graph_word(&wr, (targets[i]->flags & FLAG_SPEC) != 0);
+	}
+
+	rules = malloc(nrule * sizeof(struct rule_t *));
+	iter = rule_iter(ctx->rules);
+	for(i = nrule; i > 0; )
+		rules[--i] = rule_next(&iter);
+
+	for(i = 0; i < nrule; i++) {
+		list[0] = rules[i]->gens;
+		list[1] = rules[i]->deps;
+
+		for(n = 0; n < 2; n++) {
+			graph_word(&wr, target_list_len(list[n]));
+
+			titer = target_iter(list[n]);
+			while((target = target_next(&titer)) != NULL)
+				graph_word(&wr, graph_lookup(&wr, target));
+		}
+
+		graph_word(&wr, rules[i]->nmk);
+		for(n = 0; n < rules[i]->nmk; n++)
+			graph_word(&wr, graph_intern(&wr, rules[i]->mk[n]));
+
+		if(rules[i]->seq == NULL) {
+			graph_word(&wr, GRAPH_NONE);
+			continue;
+		}
+
+		for(n = 0, cmd = rules[i]->seq->head; cmd != NULL; cmd = cmd->next)
+			n++;
+
+		graph_word(&wr, n);
+
+		for(cmd = rules[i]->seq->head; cmd != NULL; cmd = cmd->next) {
+			for(n = 0, pipe = cmd->pipe; pipe != NULL; pipe = pipe->next)
+				n++;
+
+			graph_word(&wr, n);
+
+			for(pipe = cmd->pipe; pipe != NULL; pipe = pipe->next) {
+				graph_word(&wr, val_len(pipe->cmd));
+
+				for(k = 0; k < val_len(pipe->cmd); k++) {
+					graph_word(&wr, graph_intern(&wr, val_get(pipe->cmd, k)));
+					graph_word(&wr, val_spec(pipe->cmd, k));
+				}
+			}
+
+			graph_word(&wr, cmd->in ? graph_intern(&wr, cmd->in) : GRAPH_NONE);
+			graph_word(&wr, cmd->out ? graph_intern(&wr, cmd->out) : GRAPH_NONE);
+			graph_word(&wr, cmd->append);
+		}
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, GRAPH_MAGIC, 8);
+	hdr.nsrc = ctx->nsrc;
+	hdr.ntarget = ntarget;
+	hdr.nrule = nrule;
+	hdr.out = (ctx->out != NULL) ? graph_intern(&wr, ctx->out) : GRAPH_NONE;
+
+	hdr.nword = wr.nword;
+	if(wr.nword % 2)
+		graph_word(&wr, 0);
+
+	rec = malloc(ctx->nsrc * sizeof(struct graph_src_t));
+	for(i = 0; i < ctx->nsrc; i++) {
+		rec[i].hash = ctx->src[i].hash;
+		rec[i].size = ctx->src[i].size;
+		rec[i].mtime = digest_racy(ctx->src[i].mtime) ? INT64_MIN : ctx->src[i].mtime;
+		rec[i].path = graph_intern(&wr, ctx->src[i].path);
+		rec[i].pad = 0;
+	}
+
+	if((wr.nstr + 8) > wr.maxstr)
+		wr.str = realloc(wr.str, wr.maxstr *= 2);
+
+	while(wr.nstr % 8)
+		wr.str[wr.nstr++] = '\0';
+
+	hdr.nstr = wr.nstr;
+
+	len = sizeof(struct graph_hdr_t) + ctx->nsrc * sizeof(struct graph_src_t) + wr.nword * sizeof(uint32_t) + wr.nstr;
+	body = malloc(len);
+	memcpy(body + sizeof(struct graph_hdr_t), rec, ctx->nsrc * sizeof(struct graph_src_t));
+	memcpy(body + sizeof(struct graph_hdr_t) + ctx->nsrc * sizeof(struct graph_src_t), wr.word, wr.nword * sizeof(uint32_t));
+	memcpy(body + len - wr.nstr, wr.str, wr.nstr);
+	hdr.hash = digest_buf(body + sizeof(struct graph_hdr_t), len - sizeof(struct graph_hdr_t));
+	memcpy(body, &hdr, sizeof(struct graph_hdr_t));
+
+	free(ctx->body);
+	ctx->body = body;
+	ctx->nbody = len;
+
+	graph_write(ctx, path, body, len);
+
+	free(rec);
+	free(targets);
+	free(rules);
+	free(wr.word);
+	free(wr.str);
+	free(wr.stab);
+	free(wr.ttab);
+	free(wr.tidx);
+}
+
+/**
+ * Rewrite the graph cache with the current makedep records, keeping the
+ * graph that was saved or loaded.
+ *   @ctx: The context.
+ *   @path: The cache path.
+ */
+void graph_update(struct rt_ctx_t *ctx, const char *path)
+{
+	if(ctx->body != NULL)
+		graph_write(ctx, path, ctx->body, ctx->nbody);
+	else if(ctx->graph != NULL)
+		graph_write(ctx, path, ctx->graph, graph_len(ctx->graph));
+}
+
+/**
+ * Write a serialized graph and the makedep records to the cache, replacing
+ * it atomically. Failures are ignored.
+ *   @ctx: The context.
+ *   @path: The cache path.
+ *   @body: The serialized graph, including its header.
+ *   @len: The length.
+ */
+void graph_write(struct rt_ctx_t *ctx, const char *path, const void *body, size_t len)
+{
+	FILE *file;
+	char *tmp;
+
+	tmp = str_fmt("%s.tmp", path);
+	file = fopen(tmp, "wb");
+	if(file != NULL) {
+		fwrite(body, 1, len, file);
+		mk_cache_write(ctx->mkc, file);
+
+		if((fclose(file) != 0) || (rename(tmp, path) != 0))
+			remove(tmp);
+	}
+
+	free(tmp);
+}
+
+/**
+ * Append a word to the stream.
+ *   @wr: The writer.
+ *   @word: The word.
+ */
+void graph_word(struct graph_wr_t *wr, uint32_t word)
+{
+	if(wr->nword == wr->maxword)
+		wr->word = realloc(wr->word, (wr->maxword *= 2) * sizeof(uint32_t));
+
+	wr->word[wr->nword++] = word;
+}
+
+/**
+ * Add a string to the string table, reusing identical strings.
+ *   @wr: The writer.
+ *   @str: The string.
+ *   &returns: The string offset.
+ */
+uint32_t graph_intern(struct graph_wr_t *wr, const char *str)
+{
+	size_t len;
+	uint32_t i, k, off;
+
+	for(i = hash64(0, str) & wr->smask; wr->stab[i] != 0; i = (i + 1) & wr->smask) {
+		if(strcmp(wr->str + wr->stab[i] - 1, str) == 0)
+			return wr->stab[i] - 1;
+	}
+
+	len = strlen(str) + 1;
+	while((wr->nstr + len) > wr->maxstr)
+		wr->str = realloc(wr->str, wr->maxstr *= 2);
+
+	off = wr->nstr;
+	memcpy(wr->str + off, str, len);
+	wr->nstr += len;
+	wr->stab[i] = off + 1;
+
+	if((2 * ++wr->scnt) > (wr->smask + 1)) {
+		uint32_t *old = wr->stab, omask = wr->smask;
+
+		wr->smask = 2 * wr->smask + 1;
+		wr->stab = calloc(wr->smask + 1, sizeof(uint32_t));
+
+		for(k = 0; k <= omask; k++) {
+			if(old[k] == 0)
+				continue;
+
+			for(i = hash64(0, wr->str + old[k] - 1) & wr->smask; wr->stab[i] != 0; i = (i + 1) & wr->smask);
+			wr->stab[i] = old[k];
+		}
+
+		free(old);
+	}
+
+	return off;
+}
+
+/**
+ * Record the index of a target.
+ *   @wr: The writer.
+ *   @target: The target.
+ *   @idx: The index.
+ */
+void graph_index(struct graph_wr_t *wr, struct target_t *target, uint32_t idx)
+{
+	uint32_t i;
+
+	for(i = graph_ptr(target, wr->tmask); wr->tidx[i] != 0; i = (i + 1) & wr->tmask);
+
+	wr->ttab[i] = target;
+	wr->tidx[i] = idx + 1;
+}
+
+/**
+ * Lookup the index of a target.
+ *   @wr: The writer.
+ *   @target: The target.
+ *   &returns: The index.
+ */
+uint32_t graph_lookup(struct graph_wr_t *wr, struct target_t *target)
+{
+	uint32_t i;
+
+	for(i = graph_ptr(target, wr->tmask); wr->tidx[i] != 0; i = (i + 1) & wr->tmask) {
+		if(wr->ttab[i] == target)
+			return wr->tidx[i] - 1;
+	}
+
+	fatal("Target missing from the target map.");
+}
+
+/**
+ * Compute the table slot of a pointer.
+ *   @ptr: The pointer.
+ *   @mask: The table mask.
+ *   &returns: The slot.
+ */
+uint32_t graph_ptr(const void *ptr, uint32_t mask)
+{
+	return (((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ull >> 32) & mask;
+}
@@ -3,8 +3,10 @@
 /*
  * required headers
  */
+#define _GNU_SOURCE
 #include <assert.h>
 #include <errno.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -17,8 +19,13 @@
  * structure prototypes
  */
 struct ast_cmd_t;
+struct ast_cache_t;
+struct mk_cache_t;
 struct ast_pipe_t;
+struct buf_t;
 struct cmd_t;
+struct csr_t;
+struct log_t;
 struct rt_ctx_t;
 struct env_t;
 struct imm_t;
@@ -34,6 +41,7 @@ struct seq_t;
 struct set_t;
 struct target_t;
 struct target_list_t;
+struct tpl_t;
 struct val_t;
 
 struct loc_t;
@@ -52,11 +60,31 @@ uint64_t hash64(uint64_t hash, const char *str);
 
 void memswap(void *lhs, void *rhs, size_t len);
 
+/*
+ * intern declarations
+ */
+const char *intern_str(const char *str);
+const char *intern_path(const char *path);
+const char *intern_find(const char *str);
+void intern_clear(void);
+
+void path_canon(char *path);
+
 /*
  * base declarations
  */
 struct ast_block_t *ham_load(const char *path);
 
+/**
+ * File identity structure.
+ *   @dev, ino: The device and inode numbers.
+ *   @size, mtime: The size and modification time.
+ */
+struct os_ident_t {
+	uint64_t dev, ino;
+	int64_t size, mtime;
+};
+
 /*
  * backend declarations
  */
@@ -69,18 +97,48 @@ void unreachable() __attribute__((noreturn));
 #define fatal(...) _fatal(__FILE__, __LINE__, __VA_ARGS__)
 
 void os_init(void);
-int os_exec(struct cmd_t *cmd);
-int os_wait(void);
+void os_exec(struct cmd_t *cmd, uint32_t id);
+bool os_wait(bool block, uint32_t *id, int *stat);
 int64_t os_mtime(const char *path);
 void os_mkdir(const char *path);
+void os_mkdirs(const char *path);
+void os_mtimes(const char **path, int64_t *mtime, uint32_t n);
+void os_open(const char **path, const int *flags, int *fd, uint32_t n);
+
+int os_server(const char *path);
+bool os_client(const char *path, char **args, int *stat);
+int os_request(int sock, int *conn, char ***args);
+void os_respond(int conn, int pid);
+bool os_ready(int fd, int sock);
+int os_notify(void);
+int os_notify_add(int fd, const char *dir);
+void os_notify_read(int fd, void (*func)(void *arg, int wd, const char *name), void *arg);
+void os_close(int fd);
+uint32_t os_ncpu(void);
+void os_par(void (*func)(void *arg, uint32_t idx), void *arg, uint32_t n);
+bool os_stat(const char *path, int64_t *size, int64_t *mtime);
+bool os_ident(const char *path, struct os_ident_t *id);
+int64_t os_time(void);
+void *os_map(const char *path, size_t *len);
+void os_unmap(void *ptr, size_t len);
 
 /*
  * makedep declarations
  */
 void mk_eval(struct rt_ctx_t *ctx, const char *path, bool strict);
+void mk_load(struct rt_ctx_t *ctx, const char **paths, uint32_t n, bool strict);
+void mk_assign(struct rt_ctx_t *ctx);
+void mk_reach(struct rt_ctx_t *ctx, const char **paths, uint32_t n);
+void mk_proc(void *arg, uint32_t idx);
 
-void mk_trim(FILE *file, int *ch);
-char *mk_str(FILE *file, int *ch);
+struct mk_cache_t *mk_cache_new(void);
+void mk_cache_delete(struct mk_cache_t *cache);
+bool mk_cache_dirty(const struct mk_cache_t *cache);
+bool mk_cache_load(struct mk_cache_t *cache, const void *ptr, size_t len);
+void mk_cache_write(struct mk_cache_t *cache, FILE *file);
+
+void mk_trim(const char **ptr, const char *end);
+bool mk_str(const char **ptr, const char *end, struct buf_t *buf);
 
 bool mk_space(int ch);
 bool mk_ident(int ch);
@@ -122,15 +180,38 @@ void list_delete(struct list_t *list);
 void list_add(struct list_t *list, void *val);
 
 
+/**
+ * Arena structure.
+ *   @chunk: The chunk list.
+ */
+struct arena_t {
+	struct chunk_t *chunk;
+};
+
+/*
+ * arena declarations
+ */
+struct arena_t *arena_new(void);
+void arena_delete(struct arena_t *arena);
+
+void *arena_alloc(struct arena_t *arena, size_t len);
+char *arena_strdup(struct arena_t *arena, const char *str, size_t len);
+
+
 /**
  * Options structure.
  *   @force: Force rebuild.
- *   @jobs: The number of jobs.
+ *   @digest: Use content digests to determine up-to-date rules.
+ *   @server: Run as a resident build server.
+ *   @ast: Keep parsed files in the syntax tree cache across runs.
+ *   @jobs: The number of jobs, or negative if not given.
+ *   @slowest: The number of slowest rules to list, zero if not given.
  *   @dir: The selected directory.
  */
 struct opt_t {
-	bool force;
+	bool force, digest, server, ast;
 	int jobs;
+	uint32_t slowest;
 	const char *dir;
 };
 
@@ -142,6 +223,10 @@ struct opt_t {
  *   @seq: The command sequence.
  *   @add: Flag indicated it has been added.
  *   @edges: The unresolved edge count.
+ *   @prio: The scheduling priority, negative if not yet computed.
+ *   @mk, nmk: The makedep files owned by the rule, loaded once the rule is
+ *     reachable from a requested target.
+ *   @idx: The index in the compressed graph.
  */
 struct rule_t {
 	char *id;
@@ -150,6 +235,12 @@ struct rule_t {
 
 	bool add;
 	uint32_t edges;
+	int64_t prio;
+
+	const char **mk;
+	uint32_t nmk;
+
+	uint32_t idx;
 };
 
 /**
@@ -181,8 +272,12 @@ struct rule_iter_t {
 /*
  * rule declarations
  */
-struct rule_t *rule_new(char *id, struct target_list_t *gens, struct target_list_t *deps, struct seq_t *seq);
-void rule_delete(struct rule_t *rule);
+struct rule_t *rule_new(struct arena_t *arena, char *id, struct target_list_t *gens, struct target_list_t *deps, struct seq_t *seq);
+void rule_clear(struct rule_t *rule);
+void rule_mkdep(struct rule_t *rule, const char *path);
+
+int64_t rule_cost(struct rule_t *rule, struct log_t *log);
+int64_t rule_prio(struct csr_t *csr, struct rule_t *rule, struct log_t *log);
 
 /*
  * rule iterator declarations
@@ -193,45 +288,145 @@ struct rule_t *rule_next(struct rule_iter_t *iter);
 /*
  * rule list declarations
  */
-struct rule_list_t *rule_list_new(void);
-void rule_list_delete(struct rule_list_t *list);
+struct rule_list_t *rule_list_new(struct arena_t *arena);
+void rule_list_clear(struct rule_list_t *list);
 
-void rule_list_add(struct rule_list_t *list, struct rule_t *rule);
+void rule_list_add(struct arena_t *arena, struct rule_list_t *list, struct rule_t *rule);
 
 /*
  * queue declarations
  */
-struct queue_t *queue_new(void);
+struct queue_t *queue_new(struct csr_t *csr, struct log_t *log);
 void queue_delete(struct queue_t *queue);
 
 void queue_recur(struct queue_t *queue, struct rule_t *rule);
+uint32_t queue_sched(struct queue_t *queue);
 void queue_add(struct queue_t *queue, struct rule_t *rule);
+void queue_done(struct queue_t *queue, struct rule_t *rule);
 struct rule_t *queue_rem(struct queue_t *queue);
 
 
+/**
+ * Log record structure. Records are stored back-to-back in the log file,
+ * each followed by its null-terminated target path padded to 8 bytes.
+ *   @hash: The command hash.
+ *   @start, end: The start and end times in microseconds.
+ *   @stat: The exit status.
+ *   @len: The path length.
+ */
+struct log_rec_t {
+	uint64_t hash;
+	int64_t start, end;
+	int32_t stat;
+	uint32_t len;
+};
+
+/**
+ * Build log structure.
+ *   @path: The log path.
+ *   @map, size: The mapped log file and its size.
+ *   @file: The append stream, opened on first use.
+ *   @tab, cnt, mask: The latest record of each target.
+ *   @nrec: The number of records in the file.
+ *   @avg: The average duration of successful records.
+ */
+struct log_t {
+	const char *path;
+
+	void *map;
+	size_t size;
+	FILE *file;
+
+	const struct log_rec_t **tab;
+	uint32_t cnt, mask, nrec;
+	int64_t avg;
+};
+
+/*
+ * build log declarations
+ */
+struct log_t *log_open(const char *path);
+void log_close(struct log_t *log);
+
+const struct log_rec_t *log_find(struct log_t *log, const char *path);
+void log_add(struct log_t *log, struct rule_t *rule, int64_t start, int64_t end, int stat);
+void log_slow(struct log_t *log, uint32_t n);
+
+const char *log_path(const struct log_rec_t *rec);
+
+
+/**
+ * Digest entry structure.
+ *   @path: The interned path.
+ *   @rule: Rule flag, set for rule input digests.
+ *   @size, mtime: The file size and modification time.
+ *   @hash: The digest.
+ */
+struct dig_ent_t {
+	const char *path;
+	bool rule;
+	int64_t size, mtime;
+	uint64_t hash;
+};
+
+/**
+ * Digest database structure.
+ *   @path: The database path.
+ *   @ent, cnt, max: The entry array.
+ *   @idx, mask: The index table, storing entry indices plus one.
+ *   @dirty: Modified flag.
+ */
+struct digest_t {
+	const char *path;
+
+	struct dig_ent_t *ent;
+	uint32_t cnt, max;
+
+	uint32_t *idx, mask;
+	bool dirty;
+};
+
+/*
+ * digest declarations
+ */
+struct digest_t *digest_open(const char *path);
+void digest_close(struct digest_t *db);
+
+void digest_files(struct digest_t *db, const char **paths, uint32_t n, uint64_t *out);
+uint64_t digest_rule(struct digest_t *db, struct rule_t *rule);
+bool digest_check(struct digest_t *db, const char *path, uint64_t hash);
+bool digest_known(struct digest_t *db, const char *path);
+
+uint64_t digest_file(const char *path);
+bool digest_racy(int64_t mtime);
+uint64_t digest_buf(const void *buf, size_t len);
+
+
 /**
  * Target structure.
- *   @path: The path.
+ *   @path: The interned path, canonical unless special.
+ *   @name: The interned path as first written, used by recipe variables.
  *   @flags: The flags.
  *   @mtime: The modification time.
  *   @rule: The associated rule.
- *   @edge: The forward edges.
+ *   @idx: The index in the compressed graph.
  */
 struct target_t {
-	char *path;
+	const char *path, *name;
 	uint32_t flags;
 	int64_t mtime;
 
 	struct rule_t *rule;
-	struct edge_t *edge;
+	uint32_t idx;
 };
 
 /**
  * Target list structure.
  *   @inst: The head instance.
+ *   @tail: The tail reference.
  */
 struct target_list_t {
-	struct target_inst_t *inst;
+	struct target_inst_t *inst, **tail;
 };
 
 /**
@@ -252,34 +447,27 @@ struct target_iter_t {
 	struct target_inst_t *inst;
 };
 
-/**
- * Edge instance stucture.
- *   @rule: The target rule.
- *   @next: The next instance.
- */
-struct edge_t {
-	struct rule_t *rule;
-	struct edge_t *next;
-};
-
 /**
  * Flag definitions
  *   @FLAG_BUILD: Built target (not source).
  *   @FLAG_SPEC: Special rule.
+ *   @FLAG_DIGEST: Digest pending in the pre-pass.
+ *   @FLAG_STAT: Stat pending in the pre-pass.
+ *   @FLAG_MKDEP: Makedep file, set while assigning makedep owners.
  */
-#define FLAG_BUILD (1 << 0)
-#define FLAG_SPEC  (1 << 1)
+#define FLAG_BUILD  (1 << 0)
+#define FLAG_SPEC   (1 << 1)
+#define FLAG_DIGEST (1 << 2)
+#define FLAG_STAT   (1 << 3)
+#define FLAG_MKDEP  (1 << 4)
 
 /*
  * reference declarations
  */
-struct target_t *rt_ref_new(bool spec, char *path);
-void rt_ref_delete(struct target_t *ref);
+struct target_t *rt_ref_new(struct arena_t *arena, bool spec, const char *path, const char *name);
 
 int64_t target_mtime(struct target_t *target);
 
-void target_conn(struct target_t *target, struct rule_t *rule);
-
 bool target_equal(const struct target_t *lhs, const struct target_t *rhs);
 
 /*
@@ -291,29 +479,40 @@ struct target_t *target_next(struct target_iter_t *iter);
 /*
  * target list declarations
  */
-struct target_list_t *target_list_new(void);
-void target_list_delete(struct target_list_t *list);
+struct target_list_t *target_list_new(struct arena_t *arena);
 
 uint32_t target_list_len(struct target_list_t *list);
 bool target_list_contains(struct target_list_t *list, struct target_t *target);
-void target_list_add(struct target_list_t *list, struct target_t *target);
+void target_list_add(struct arena_t *arena, struct target_list_t *list, struct target_t *target);
+void target_list_move(struct target_list_t *dst, struct target_list_t *src);
 struct target_t *target_list_find(struct target_list_t *list, bool spec, const char *path);
 
 
 /**
  * Target map structure.
+ *   @arena: The graph arena holding the entries.
  *   @ent: The head entry.
+ *   @tab, old: The current and migrating probe tables.
+ *   @cnt: The number of entries.
+ *   @mask, omask: The current and migrating table masks.
+ *   @mig: The migration position in the old table.
  */
 struct map_t {
+	struct arena_t *arena;
 	struct ent_t *ent;
+
+	struct ent_t **tab, **old;
+	uint32_t cnt, mask, omask, mig;
 };
 
 /**
  * Entry structure.
+ *   @hash: The path hash.
  *   @target: The target.
  *   @next: The next entry.
  */
 struct ent_t {
+	uint64_t hash;
 	struct target_t *target;
 	struct ent_t *next;
 };
@@ -321,13 +520,41 @@ struct ent_t {
 /*
  * map declarations
  */
-struct map_t *map_new(void);
+struct map_t *map_new(struct arena_t *arena);
 void map_delete(struct map_t *map);
 
 struct target_t *map_get(struct map_t *map, bool spec, const char *path);
 void map_add(struct map_t *map, struct target_t *target);
 
 
+/**
+ * Compressed graph structure, the deduplicated adjacency of every rule and
+ * target frozen into compressed sparse rows once the graph is complete.
+ *   @rule, nrule: The rules by index.
+ *   @target, ntarget: The targets by index.
+ *   @off, adj: The target rows of the rules. The generated targets of rule
+ *     `i` span `off[2i]` to `off[2i+1]` in `adj`, and its dependencies span
+ *     `off[2i+1]` to `off[2i+2]`.
+ *   @eoff, edge: The rule rows of the targets. The rules depending on target
+ *     `i` span `eoff[i]` to `eoff[i+1]` in `edge`.
+ */
+struct csr_t {
+	struct rule_t **rule;
+	struct target_t **target;
+	uint32_t nrule, ntarget;
+
+	uint32_t *off, *adj;
+	uint32_t *eoff, *edge;
+};
+
+/*
+ * compressed graph declarations
+ */
+struct csr_t *csr_new(struct rt_ctx_t *ctx);
+uint32_t csr_scc(struct csr_t *csr, uint32_t *comp, uint32_t *ord);
+uint32_t csr_cycle(struct csr_t *csr, const uint32_t *comp, uint32_t root, uint32_t *tmp, uint32_t *path);
+
+
 /**
  * Sequence structure.
  *   @head, tail: The head and tail commands.
@@ -357,6 +584,8 @@ struct cmd_t {
 struct seq_t *seq_new(void);
 void seq_delete(struct seq_t *seq);
 
+uint64_t seq_hash(struct seq_t *seq);
+
 void seq_add(struct seq_t *seq, struct rt_pipe_t *pipe, char *in, char *out, bool append);
 
 
@@ -373,17 +602,77 @@ struct rt_obj_t {
 };
 
 
+/**
+ * Source file structure.
+ *   @path: The interned path.
+ *   @size, mtime: The size and modification time, size negative if missing.
+ *   @hash: The content digest.
+ */
+struct source_t {
+	const char *path;
+	int64_t size, mtime;
+	uint64_t hash;
+};
+
+/**
+ * Loaded file structure, a file read and parsed once per run, possibly
+ * ahead of evaluation.
+ *   @path: The interned canonical path.
+ *   @name: The interned path the file was first loaded by.
+ *   @id: The identity of the file when it was read.
+ *   @found: Found flag, set if the file could be opened.
+ *   @cached: Cached flag, set if the tree came from the syntax tree cache.
+ *   @used: Used flag, set once the file has been taken by evaluation.
+ *   @top: The parsed block, null if the file could not be opened.
+ *   @err: Optional. The syntax error, reported when the file is taken.
+ *   @src: The source record.
+ *   @next: The next loaded file.
+ */
+struct fetch_t {
+	const char *path, *name;
+	struct os_ident_t id;
+	bool found, cached, used;
+
+	struct ast_block_t *top;
+	char *err;
+
+	struct source_t src;
+
+	struct fetch_t *next;
+};
+
 /**
  * Context structure.
  *   @opt: The options.
+ *   @log: The build log.
+ *   @digest: Optional. The digest database.
  *   @map: The target map.
  *   @rules: The set of rules.
  *   @gen, dep: The generator and depedency values.
  *   @cur: The current rule.
  *   @gen, deps: The generated and dependency targets.
+ *   @src, nsrc: The files read by evaluation.
+ *   @out, nout: The output printed by evaluation, null-terminated and kept
+ *     with the graph cache so that it is replayed when the cache is used.
+ *   @mk, nmk: The makedep files registered during evaluation, assigned to
+ *     rules by `mk_assign`.
+ *   @mkc: The parsed makedep files, kept with the graph cache.
+ *   @graph, ngraph: Optional. The mapped graph cache the context was loaded
+ *     from, referenced by command strings and makedep records.
+ *   @body, nbody: Optional. The graph written by `graph_save`, kept so that
+ *     the cache can be rewritten with new makedep records.
+ *   @arena: The graph arena, holding every target, rule, edge and instance
+ *     until the context is deleted.
+ *   @csr: Optional. The compressed graph, built by `ctx_run` once the graph
+ *     is complete.
+ *   @fetch: The files loaded or prefetched for evaluation, each owning its
+ *     syntax tree until the context is deleted.
+ *   @cache: Optional. The syntax tree cache.
  */
 struct rt_ctx_t {
 	const struct opt_t *opt;
+	struct log_t *log;
+	struct digest_t *digest;
 
 	struct map_t *map;
 	struct rule_list_t *rules;
@@ -391,6 +680,28 @@ struct rt_ctx_t {
 	struct rule_t *cur;
 
 	struct target_list_t *gens, *deps;
+
+	struct source_t *src;
+	uint32_t nsrc;
+
+	char *out;
+	size_t nout;
+
+	const char **mk;
+	uint32_t nmk;
+	struct mk_cache_t *mkc;
+
+	void *graph;
+	size_t ngraph;
+
+	char *body;
+	size_t nbody;
+
+	struct arena_t *arena;
+	struct csr_t *csr;
+
+	struct fetch_t *fetch;
+	struct ast_cache_t *cache;
 };
 
 /*
@@ -398,11 +709,73 @@ struct rt_ctx_t {
  */
 struct rt_ctx_t *ctx_new(const struct opt_t *opt);
 void ctx_delete(struct rt_ctx_t *ctx);
+void ctx_close(struct rt_ctx_t *ctx);
 
 void ctx_run(struct rt_ctx_t *ctx, const char **builds);
+void ctx_digest(struct rt_ctx_t *ctx);
+void ctx_stat(struct rt_ctx_t *ctx);
+void ctx_source(struct rt_ctx_t *ctx, const char *path);
+void ctx_print(struct rt_ctx_t *ctx, struct val_t *val);
+void ctx_fetch(struct rt_ctx_t *ctx, struct val_t *val);
+void ctx_prefetch(struct rt_ctx_t *ctx, struct ast_block_t *top);
+struct ast_block_t *ctx_load(struct rt_ctx_t *ctx, const char *path);
+void ctx_mkdep(struct rt_ctx_t *ctx, const char *path);
 
 struct target_t *ctx_target(struct rt_ctx_t *ctx, bool spec, const char *path);
 struct rule_t *ctx_rule(struct rt_ctx_t *ctx, const char *id, struct target_list_t *gens, struct target_list_t *deps);
+void ctx_deps(struct rt_ctx_t *ctx, struct target_list_t *gens, struct target_list_t *deps);
+
+
+/**
+ * Graph writer structure.
+ *   @word, nword, maxword: The word stream.
+ *   @str, nstr, maxstr: The string table.
+ *   @stab, smask, scnt: The string table index, storing offsets plus one.
+ *   @ttab, tidx, tmask: The target index table, storing targets and their
+ *     indices plus one.
+ */
+struct graph_wr_t {
+	uint32_t *word, nword, maxword;
+	char *str;
+	uint32_t nstr, maxstr;
+
+	uint32_t *stab, smask, scnt;
+
+	struct target_t **ttab;
+	uint32_t *tidx, tmask;
+};
+
+/**
+ * Graph reader structure.
+ *   @word, idx, cnt: The word stream and position.
+ *   @str, nstr: The string table.
+ *   @err: Error flag, set on any malformed data.
+ */
+struct graph_rd_t {
+	const uint32_t *word;
+	uint32_t idx, cnt;
+	const char *str;
+	uint64_t nstr;
+	bool err;
+};
+
+/*
+ * graph cache declarations
+ */
+bool graph_load(struct rt_ctx_t *ctx, const char *path);
+void graph_save(struct rt_ctx_t *ctx, const char *path);
+void graph_update(struct rt_ctx_t *ctx, const char *path);
+
+uint32_t graph_get(struct graph_rd_t *rd);
+const char *graph_str(struct graph_rd_t *rd);
+void graph_word(struct graph_wr_t *wr, uint32_t word);
+uint32_t graph_intern(struct graph_wr_t *wr, const char *str);
+
+
+/*
+ * server declarations
+ */
+void serve_run(struct rt_ctx_t *ctx, int sock);
 
 
 /*
@@ -425,7 +798,7 @@ struct rt_obj_t rt_obj_val(struct val_t *val);
 struct rt_obj_t rt_obj_env(struct env_t *env);
 struct rt_obj_t rt_obj_func(func_t *func);
 
-void rt_obj_add(struct rt_obj_t dst, struct rt_obj_t src, struct loc_t loc);
+void rt_obj_add(struct rt_obj_t *dst, struct rt_obj_t src, struct loc_t loc);
 
 
 /**
@@ -494,9 +867,27 @@ struct loc_t {
 extern char *cli_app;
 
 void cli_proc(char **args);
+void cli_opts(char **args, struct opt_t *opt, const char ***arr, uint32_t *cnt);
+void cli_load(struct rt_ctx_t *ctx);
 void cli_err(const char *fmt, ...) __attribute__((noreturn));
 
 
+/**
+ * Location error trap structure, catching the errors of a worker thread
+ * instead of exiting.
+ *   @env: The jump buffer.
+ *   @msg: The formatted message.
+ */
+struct loc_trap_t {
+	jmp_buf env;
+	char *msg;
+};
+
+/*
+ * location variables
+ */
+extern __thread struct loc_trap_t *loc_trap;
+
 /*
  * location declarations
  */
@@ -505,41 +896,74 @@ void loc_err(struct loc_t loc, const char *fmt, ...) __attribute__((noreturn));
 
 
 /**
- * Value structure.
- *   @spec: Special flag.
- *   @str: The string.
- *   @next: The next value.
+ * Value string union. Strings shorter than `VAL_INLINE` bytes are stored
+ * inline, with the last byte zero and doubling as the terminator. Longer
+ * strings are stored by pointer, with the last byte holding the tag.
+ *   @buf: The inline string.
+ *   @ptr: The string pointer.
+ *   @tag: The tag, `VAL_OWN` for owned strings and `VAL_REF` for interned
+ *     strings.
+ */
+#define VAL_INLINE 16
+#define VAL_OWN    1
+#define VAL_REF    2
+
+union val_str_u {
+	char buf[VAL_INLINE];
+	struct {
+		char *ptr;
+		char pad[VAL_INLINE - sizeof(char *) - 1];
+		uint8_t tag;
+	} ext;
+};
+
+/**
+ * Value structure, a contiguous list of strings.
+ *   @nrefs: The reference count. Lists are immutable once shared, so they
+ *     are shared instead of copied and only copied when appended to.
+ *   @len, max: The length and capacity.
+ *   @spec: Optional. The bitset of special strings, null if none are.
+ *   @arr: The strings.
  */
 struct val_t {
-	bool spec;
-	char *str;
+	uint32_t nrefs, len, max;
+	uint32_t *spec;
 
-	struct val_t *next;
+	union val_str_u arr[];
 };
 
 /*
  * value declarations
  */
 struct val_t *val_new(bool spec, char *str);
-struct val_t *val_dup(const struct val_t *val);
-void val_delete(struct val_t *val);
+struct val_t *val_ref(bool spec, const char *str);
+struct val_t *val_dup(struct val_t *val);
 void val_clear(struct val_t *val);
 
+void val_add(struct val_t **val, bool spec, char *str);
+void val_add_ref(struct val_t **val, bool spec, const char *str);
+void val_add_copy(struct val_t **val, const struct val_t *src, uint32_t idx);
+void val_reserve(struct val_t **val, uint32_t cnt);
+
+const char *val_get(const struct val_t *val, uint32_t idx);
+bool val_spec(const struct val_t *val, uint32_t idx);
+char *val_take(struct val_t *val);
 char *val_id(struct val_t *val, struct loc_t loc);
 char *val_str(struct val_t *val, struct loc_t loc);
-uint32_t val_len(struct val_t *val);
-struct val_t **val_tail(struct val_t **val);
+uint32_t val_len(const struct val_t *val);
+void val_append(struct val_t **dst, struct val_t *src);
 
 
 /**
  * Binding structure.
- *   @id: The identifier.
+ *   @id, hash: The identifier and its hash.
  *   @obj: The object.
  *   @loc: The location.
  *   @next: The next binding.
  */
 struct bind_t {
 	char *id;
+	uint32_t hash;
 	struct rt_obj_t obj;
 
 	struct loc_t loc;
@@ -604,6 +1028,10 @@ bool ch_var(int ch);
 bool ch_str(int ch);
 bool ch_id(int ch);
 
+const char *str_space(const char *ptr, const char *end);
+const char *str_plain(const char *ptr, const char *end);
+const char *str_stop(const char *ptr, const char *end, const char *set);
+
 
 /**
  * Namespace structure.
@@ -715,6 +1143,14 @@ struct ast_block_t {
 struct ast_block_t *ast_block_new(void);
 void ast_block_delete(struct ast_block_t *block);
 
+/*
+ * syntax tree cache declarations
+ */
+struct ast_cache_t *ast_cache_open(const char *path);
+void ast_cache_close(struct ast_cache_t *cache);
+struct ast_block_t *ast_cache_get(struct ast_cache_t *cache, const struct fetch_t *fetch);
+void ast_cache_save(struct rt_ctx_t *ctx, const char *path);
+
 
 /**
  * Processing statement structure.
@@ -860,15 +1296,21 @@ uint32_t imm_len(struct imm_t *imm);
 /**
  * Raw string structure.
  *   @spec, var: Special and variable flags.
+ *   @lit: Literal flag, set if the string expands to itself.
+ *   @hash: The identifier hash if the string is a plain identifier or a
+ *     plain variable reference, zero otherwise.
  *   @str: The string.
  *   @loc: The location.
+ *   @tpl: The expansion template, parsed on first evaluation.
  *   @next: The next raw string.
  */
 struct raw_t {
-	bool spec, var;
+	bool spec, var, lit;
+	uint32_t hash;
 
 	char *str;
 	struct loc_t loc;
+	struct tpl_t *tpl;
 
 	struct raw_t *next;
 };
@@ -880,17 +1322,109 @@ struct raw_t *raw_new(bool spec, bool var, char *str, struct loc_t loc);
 struct raw_t *raw_dup(const struct raw_t *raw);
 void raw_delete(struct raw_t *raw);
 void raw_clear(struct raw_t *raw);
+uint32_t raw_hash(const char *str);
+bool raw_lit(const char *str);
+
 
+/**
+ * Template selector structure.
+ *   @call: Call flag, set for function calls instead of members.
+ *   @id: The identifier, including the leading '.'.
+ *   @hash, mhash: The hashes of the function and member identifiers.
+ *   @after, pos: The locations after the identifier and after the
+ *     whitespace following it.
+ *   @arg, narg: The call arguments.
+ *   @next: The next selector.
+ */
+struct tpl_sel_t {
+	bool call;
+	char *id;
+	uint32_t hash, mhash;
+	struct loc_t after, pos;
+
+	struct tpl_t **arg;
+	uint32_t narg;
+
+	struct tpl_sel_t *next;
+};
+
+/**
+ * Template node structure.
+ *   @tag: The tag.
+ *   @str, hash: The literal text or variable identifier, and the hash of
+ *     the identifier.
+ *   @brace: Brace flag, set if the variable is within braces.
+ *   @loc, flat: The locations of the variable and after the expansion.
+ *   @sel: The selector list.
+ *   @next: The next node.
+ */
+enum tpl_e { tpl_chars_v, tpl_var_v, tpl_at_v, tpl_hat_v, tpl_lt_v, tpl_star_v };
+struct tpl_node_t {
+	enum tpl_e tag;
+	char *str;
+	uint32_t hash;
+	bool brace;
+	struct loc_t loc, flat;
+
+	struct tpl_sel_t *sel;
+	struct tpl_node_t *next;
+};
+
+/**
+ * Template structure.
+ *   @obj: Object flag, set if the template is a single expansion that
+ *     evaluates to its object.
+ *   @spec: Special flag, set if the template is a special string.
+ *   @node: The node list, concatenated into a string.
+ */
+struct tpl_t {
+	bool obj, spec;
+	struct tpl_node_t *node;
+};
+
+/*
+ * template declarations
+ */
+struct tpl_t *tpl_new(const char *str, struct loc_t loc);
+void tpl_delete(struct tpl_t *tpl);
+
+struct rt_obj_t tpl_eval(struct tpl_t *tpl, struct rt_ctx_t *ctx, struct env_t *env);
+
+
+/**
+ * Environment cache entry structure, remembering a binding found in a
+ * parent environment.
+ *   @hash: The identifier hash.
+ *   @epoch: The epoch the entry was stored in, only valid if current.
+ *   @bind: The binding.
+ */
+struct env_cache_t {
+	uint32_t hash, epoch;
+	struct bind_t *bind;
+};
+
+/*
+ * environment definitions
+ */
+#define ENV_CACHE 4
 
 /**
  * Environment structure.
  *   @nrefs: THe number of references.
- *   @map: The variable mapping.
+ *   @look, held: Flags set once a lookup has passed through the
+ *     environment, and once one of its bindings has been cached.
+ *   @tab, mask, cnt: The binding hash table, mask and count.
+ *   @cache: The cache of bindings found in parent environments.
  *   @next: The next/parent environment.
  */
 struct env_t {
 	uint32_t nrefs;
-	struct map0_t *map;
+	bool look, held;
+
+	struct bind_t **tab;
+	uint32_t mask, cnt;
+
+	struct env_cache_t cache[ENV_CACHE];
 
 	struct env_t *next;
 };
@@ -913,8 +1447,11 @@ struct env_t *rt_env_dup(struct env_t *env);
 void rt_env_delete(struct env_t *env);
 void rt_env_clear(struct env_t *env);
 
+uint32_t env_hash(const char *id);
 struct bind_t *rt_env_lookup(struct env_t *env, const char *id);
+struct bind_t *env_probe(struct env_t *env, const char *id, uint32_t hash);
 struct bind_t *env_get(struct env_t *env, const char *id);
+struct bind_t *env_find(struct env_t *env, const char *id, uint32_t hash);
 void env_put(struct env_t *env, struct bind_t *bind);
 struct env_t **rt_env_tail(struct env_t **env);
 
@@ -922,42 +1459,47 @@ struct env_t **rt_env_tail(struct env_t **env);
 
 /**
  * Job structure.
- *   @pid: The pid.
  *   @rule: The rule.
- *   @cmd: The current command.
+ *   @cmd: The next command.
+ *   @start: The start time in microseconds.
  */
 struct job_t {
-	int pid;
 	struct rule_t *rule;
 	struct cmd_t *cmd;
+	int64_t start;
 };
 
 /**
  * Job control structure.
  *   @queue: The rule queue.
+ *   @log: Optional. The build log.
  *   @job: The job array.
  *   @cnt: The number of jobs.
+ *   @avail, navail: The stack of available job slots.
  */
 struct ctrl_t {
 	struct queue_t *queue;
+	struct log_t *log;
 
 	struct job_t *job;
 	uint32_t cnt;
+
+	uint32_t *avail, navail;
 };
 
 /*
  * job control declarations
  */
-struct ctrl_t *ctrl_new(struct queue_t *queue, uint32_t n);
+struct ctrl_t *ctrl_new(struct queue_t *queue, struct log_t *log, uint32_t n);
 void ctrl_delete(struct ctrl_t *ctrl);
 
 void ctrl_add(struct ctrl_t *ctrl, struct rule_t *rule);
 bool ctrl_avail(struct ctrl_t *ctrl);
 bool ctrl_busy(struct ctrl_t *ctrl);
-void ctrl_wait(struct ctrl_t *ctrl);
+bool ctrl_wait(struct ctrl_t *ctrl, bool block);
 void ctrl_done(struct ctrl_t *ctrl, struct rule_t *rule);
 
-int ctrl_exec(struct cmd_t *cmd);
+void ctrl_exec(struct cmd_t *cmd, uint32_t id);
 
 
 /*
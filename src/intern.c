@@ -0,0 +1,202 @@
+#include "inc.h"
+
+
+/**
+ * Interned string entry.
+ *   @hash: The string hash.
+ *   @str: The string.
+ */
+struct istr_t {
+	uint64_t hash;
+	const char *str;
+};
+
+/*
+ * intern table variables
+ */
+struct arena_t *intern_arena = NULL;
+struct istr_t *intern_tab = NULL;
+uint32_t intern_cnt = 0, intern_mask = 0;
+
+/*
+ * intern table declarations
+ */
+void intern_grow(void);
+
+
+/**
+ * Intern a string. The returned string lives until `intern_clear` and may be
+ * compared by pointer against any other interned string.
+ *   @str: The string.
+ *   &returns: The interned string.
+ */
+const char *intern_str(const char *str)
+{
+	uint32_t i;
+	uint64_t hash;
+
+	if(4 * (intern_cnt + 1) > 3 * (intern_mask + 1))
+		intern_grow();
+
+	hash = hash64(0, str);
+	for(i = hash & intern_mask; intern_tab[i].str != NULL; i = (i + 1) & intern_mask) {
+		if((intern_tab[i].hash == hash) && (strcmp(intern_tab[i].str, str) == 0))
+			return intern_tab[i].str;
+	}
+
+	intern_tab[i].hash = hash;
+	intern_tab[i].str = arena_strdup(intern_arena, str, strlen(str));
+	intern_cnt++;
+
+	return intern_tab[i].str;
+}
+
+/**
+ * Canonicalize and intern a path.
+ *   @path: The path.
+ *   &returns: The interned path.
+ */
+const char *intern_path(const char *path)
+{
+	char *tmp;
+	const char *ret;
+
+	tmp = strdup(path);
+	path_canon(tmp);
+	ret = intern_str(tmp);
+	free(tmp);
+
+	return ret;
+}
+
+/**
+ * Find an interned string without interning it.
+ *   @str: The string.
+ *   &returns: The interned string, or null if not interned.
+ */
+const char *intern_find(const char *str)
+{
+	uint32_t i;
+	uint64_t hash;
+
+	if(intern_tab == NULL)
+		return NULL;
+
+	hash = hash64(0, str);
+	for(i = hash & intern_mask; intern_tab[i].str != NULL; i = (i + 1) & intern_mask) {
+		if((intern_tab[i].hash == hash) && (strcmp(intern_tab[i].str, str) == 0))
+			return intern_tab[i].str;
+	}
+
+	return NULL;
+}
+
+/**
+ * Release all interned strings.
+ */
+void intern_clear(void)
+{
+	if(intern_arena == NULL)
+		return;
+
+	arena_delete(intern_arena);
+	free(intern_tab);
+
+	intern_arena = NULL;
+	intern_tab = NULL;
+	intern_cnt = intern_mask = 0;
+}
+
+
+/**
+ * Grow the intern table, creating it if needed.
+ */
+void intern_grow(void)
+{
+	uint32_t i, k, mask;
+	struct istr_t *tab;
+
+	if(intern_arena == NULL)
+		intern_arena = arena_new();
+
+	mask = intern_mask ? (2 * intern_mask + 1) : 1023;
+	tab = calloc(mask + 1, sizeof(struct istr_t));
+
+	for(i = 0; (intern_tab != NULL) && (i <= intern_mask); i++) {
+		if(intern_tab[i].str == NULL)
+			continue;
+
+		k = intern_tab[i].hash & mask;
+		while(tab[k].str != NULL)
+			k = (k + 1) & mask;
+
+		tab[k] = intern_tab[i];
+	}
+
+	free(intern_tab);
+	intern_tab = tab;
+	intern_mask = mask;
+}
+
+
+/**
+ * Lexically canonicalize a path in place. Empty and `.` components are
+ * removed and `..` components consume their parent where one exists.
+ *   @path: The path.
+ */
+void path_canon(char *path)
+{
+	size_t len;
+	char *rd, *wr, *floor, *end;
+
+	rd = wr = path;
+	if(*rd == '/')
+		*wr++ = *rd++;
+
+	floor = wr;
+
+	for(;;) {
+		while(*rd == '/')
+			rd++;
+
+		if(*rd == '\0')
+			break;
+
+		end = strchr(rd, '/');
+		len = (end != NULL) ? (size_t)(end - rd) : strlen(rd);
+
+		if((len == 1) && (rd[0] == '.'))
+			;
+		else if((len == 2) && (rd[0] == '.') && (rd[1] == '.')) {
+			if(wr > floor) {
+				while((wr > floor) && (wr[-1] != '/'))
+					wr--;
+
+				if(wr > floor)
+					wr--;
+			}
+			else if(path[0] != '/') {
+				if(wr > path)
+					*wr++ = '/';
+
+				*wr++ = '.';
+				*wr++ = '.';
+				floor = wr;
+			}
+		}
+		else {
+			if((wr > path) && (wr[-1] != '/'))
+				*wr++ = '/';
+
+			memmove(wr, rd, len);
+			wr += len;
+		}
+
+		rd += len;
+	}
+
+	if(wr == path)
+		*wr++ = '.';
+
+	*wr = '\0';
+}
@@ -4,21 +4,25 @@
 /**
  * Create a job controller.
  *   @queue: The rule queue.
+ *   @log: Optional. The build log.
  *   @n: The maximum number of concurrent jobs.
  *   &returns: The controller.
  */
-struct ctrl_t *ctrl_new(struct queue_t *queue, uint32_t n)
+struct ctrl_t *ctrl_new(struct queue_t *queue, struct log_t *log, uint32_t n)
 {
 	uint32_t i;
 	struct ctrl_t *ctrl;
 
 	ctrl = malloc(sizeof(struct ctrl_t));
 	ctrl->queue = queue;
+	ctrl->log = log;
 	ctrl->cnt = n;
 	ctrl->job = malloc(n * sizeof(struct job_t));
+	ctrl->avail = malloc(n * sizeof(uint32_t));
+	ctrl->navail = n;
 
 	for(i = 0; i < n; i++)
-		ctrl->job[i].pid = -1;
+		ctrl->avail[i] = n - i - 1;
 
 	return ctrl;
 }
@@ -29,6 +33,7 @@ struct ctrl_t *ctrl_new(struct queue_t *queue, uint32_t n)
  */
 void ctrl_delete(struct ctrl_t *ctrl)
 {
+	free(ctrl->avail);
 	free(ctrl->job);
 	free(ctrl);
 }
@@ -46,17 +51,14 @@ void ctrl_add(struct ctrl_t *ctrl, struct rule_t *rule)
 	if((rule->seq == NULL) || (rule->seq->head == NULL))
 		return ctrl_done(ctrl, rule);
 
-	for(i = 0; i < ctrl->cnt; i++) {
-		if(ctrl->job[i].pid < 0)
-			break;
-	}
-
-	if(i >= ctrl->cnt)
+	if(ctrl->navail == 0)
 		fatal("Failed to start job.");
 
-	ctrl->job[i].pid = ctrl_exec(rule->seq->head);
+	i = ctrl->avail[--ctrl->navail];
 	ctrl->job[i].rule = rule;
 	ctrl->job[i].cmd = rule->seq->head->next;
+	ctrl->job[i].start = os_time();
+	ctrl_exec(rule->seq->head, i);
 }
 
 /**
@@ -66,14 +68,7 @@ void ctrl_add(struct ctrl_t *ctrl, struct rule_t *rule)
  */
 bool ctrl_avail(struct ctrl_t *ctrl)
 {
-	uint32_t i;
-
-	for(i = 0; i < ctrl->cnt; i++) {
-		if(ctrl->job[i].pid < 0)
-			return true;
-	}
-
-	return false;
+	return ctrl->navail > 0;
 }
 
 /**
@@ -83,43 +78,46 @@ bool ctrl_avail(struct ctrl_t *ctrl)
  */
 bool ctrl_busy(struct ctrl_t *ctrl)
 {
-	uint32_t i;
-
-	for(i = 0; i < ctrl->cnt; i++) {
-		if(ctrl->job[i].pid >= 0)
-			return true;
-	}
-
-	return false;
+	return ctrl->navail < ctrl->cnt;
 }
 
 /**
- * Wait for a job to complete.
+ * Wait for a command to complete, starting the next command of its job.
  *   @ctrl: The controller.
+ *   @block: Block until a command completes.
+ *   &returns: True if a command completed.
  */
-void ctrl_wait(struct ctrl_t *ctrl)
+bool ctrl_wait(struct ctrl_t *ctrl, bool block)
 {
-	uint32_t i;
-	int pid;
+	int stat;
+	uint32_t id;
+	struct job_t *job;
 
-	pid = os_wait();
+	if(!os_wait(block, &id, &stat))
+		return false;
 
-	for(i = 0; i < ctrl->cnt; i++) {
-		if(ctrl->job[i].pid == pid)
-			break;
-	}
+	job = &ctrl->job[id];
+	if((stat != 0) && (ctrl->log != NULL))
+		log_add(ctrl->log, job->rule, job->start, os_time(), stat);
 
-	if(i >= ctrl->cnt)
-		return;
+	if(stat < 0)
+		fatal("Command failed with signal '%d'.", -stat);
+	else if(stat > 0)
+		fatal("Command terminated with status %d.", stat);
 
-	if(ctrl->job[i].cmd != NULL) {
-		ctrl->job[i].pid = ctrl_exec(ctrl->job[i].cmd);
-		ctrl->job[i].cmd = ctrl->job[i].cmd->next;
+	if(job->cmd != NULL) {
+		ctrl_exec(job->cmd, id);
+		job->cmd = job->cmd->next;
 	}
 	else {
-		ctrl->job[i].pid = -1;
-		ctrl_done(ctrl, ctrl->job[i].rule);
+		if(ctrl->log != NULL)
+			log_add(ctrl->log, job->rule, job->start, os_time(), 0);
+
+		ctrl->avail[ctrl->navail++] = id;
+		ctrl_done(ctrl, job->rule);
 	}
+
+	return true;
 }
 
 /**
@@ -129,36 +127,24 @@ void ctrl_wait(struct ctrl_t *ctrl)
  */
 void ctrl_done(struct ctrl_t *ctrl, struct rule_t *rule)
 {
-	struct edge_t *edge;
-	struct target_t *target;
-	struct target_iter_t iter;
-
-	iter = target_iter(rule->gens);
-	while((target = target_next(&iter)) != NULL) {
-		target->mtime = -1;
-
-		for(edge = target->edge; edge != NULL; edge = edge->next) {
-			edge->rule->edges--;
-			if(edge->rule->edges == 0)
-				queue_add(ctrl->queue, edge->rule);
-		}
-	}
+	queue_done(ctrl->queue, rule);
 }
 
 
 /**
  * Execute a command.
  *   @cmd: The command.
- *   &returns: The PID.
+ *   @id: The job slot identifier.
  */
-int ctrl_exec(struct cmd_t *cmd)
+void ctrl_exec(struct cmd_t *cmd, uint32_t id)
 {
-	struct val_t *val;
+	uint32_t i, n;
 	struct rt_pipe_t *pipe;
 
 	for(pipe = cmd->pipe; pipe != NULL; pipe = pipe->next) {
-		for(val = pipe->cmd; val != NULL; val = val->next)
-			print("%s%s", val->str, (val->next != NULL) ? " " : "");
+		n = val_len(pipe->cmd);
+		for(i = 0; i < n; i++)
+			print("%s%s", val_get(pipe->cmd, i), (i + 1 < n) ? " " : "");
 
 		if(pipe->next != NULL)
 			print(" | ");
@@ -172,5 +158,5 @@ int ctrl_exec(struct cmd_t *cmd)
 
 	print("\n");
 
-	return os_exec(cmd);
+	os_exec(cmd, id);
 }
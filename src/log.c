@@ -0,0 +1,299 @@
+#include "inc.h"
+
+
+/*
+ * log definitions
+ */
+#define LOG_MAGIC "HAMLOG1"
+#define LOG_HDR   8
+#define LOG_SLACK 1024
+
+/*
+ * log declarations
+ */
+size_t log_size(const struct log_rec_t *rec);
+const struct log_rec_t *log_rec(const struct log_t *log, size_t off);
+void log_index(struct log_t *log, const struct log_rec_t *rec);
+void log_compact(struct log_t *log);
+int log_cmp(const void *lhs, const void *rhs);
+
+
+/**
+ * Open a build log, loading its records. Missing or invalid logs are treated
+ * as empty. The log is compacted if it has grown well beyond the number of
+ * distinct targets it records.
+ *   @path: The log path.
+ *   &returns: The log.
+ */
+struct log_t *log_open(const char *path)
+{
+	size_t off;
+	uint32_t i, n;
+	int64_t sum;
+	struct log_t *log;
+	const struct log_rec_t *rec;
+
+	log = malloc(sizeof(struct log_t));
+	log->path = path;
+	log->file = NULL;
+	log->map = os_map(path, &log->size);
+	log->tab = calloc(64, sizeof(void *));
+	log->cnt = log->nrec = 0;
+	log->mask = 63;
+	log->avg = 0;
+
+	if((log->map == NULL) || (log->size < LOG_HDR) || (memcmp(log->map, LOG_MAGIC, LOG_HDR) != 0))
+		return log;
+
+	off = LOG_HDR;
+	while((rec = log_rec(log, off)) != NULL) {
+		log_index(log, rec);
+		log->nrec++;
+		off += log_size(rec);
+	}
+
+	if((off < log->size) || (log->nrec > (2 * log->cnt + LOG_SLACK)))
+		log_compact(log);
+
+	sum = n = 0;
+	for(i = 0; i <= log->mask; i++) {
+		if((log->tab[i] != NULL) && (log->tab[i]->stat == 0)) {
+			sum += log->tab[i]->end - log->tab[i]->start;
+			n++;
+		}
+	}
+
+	log->avg = (n > 0) ? (sum / n) : 0;
+
+	return log;
+}
+
+/**
+ * Close a build log.
+ *   @log: The log.
+ */
+void log_close(struct log_t *log)
+{
+	if(log->file != NULL)
+		fclose(log->file);
+
+	if(log->map != NULL)
+		os_unmap(log->map, log->size);
+
+	free(log->tab);
+	free(log);
+}
+
+
+/**
+ * Find the latest record for a target.
+ *   @log: The log.
+ *   @path: The target path.
+ *   &returns: The record or null.
+ */
+const struct log_rec_t *log_find(struct log_t *log, const char *path)
+{
+	uint32_t i;
+
+	for(i = hash64(0, path) & log->mask; log->tab[i] != NULL; i = (i + 1) & log->mask) {
+		if(strcmp(log_path(log->tab[i]), path) == 0)
+			return log->tab[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Append a record for a rule to the log.
+ *   @log: The log.
+ *   @rule: The rule, recorded under its primary target.
+ *   @start, end: The start and end times in microseconds.
+ *   @stat: The exit status.
+ */
+void log_add(struct log_t *log, struct rule_t *rule, int64_t start, int64_t end, int stat)
+{
+	const char *path;
+	struct log_rec_t rec;
+	char pad[8] = { 0 };
+
+	if(log->file == NULL) {
+		log->file = fopen(log->path, "ab");
+		if(log->file == NULL)
+			return;
+
+		if(ftell(log->file) == 0)
+			fwrite(LOG_MAGIC, 1, LOG_HDR, log->file);
+	}
+
+	path = rule->gens->inst->target->path;
+	rec = (struct log_rec_t){ seq_hash(rule->seq), start, end, stat, strlen(path) };
+
+	fwrite(&rec, sizeof(rec), 1, log->file);
+	fwrite(path, 1, rec.len, log->file);
+	fwrite(pad, 1, log_size(&rec) - sizeof(rec) - rec.len, log->file);
+	fflush(log->file);
+}
+
+
+/**
+ * Print the slowest rules from the log.
+ *   @log: The log.
+ *   @n: The maximum number of rules.
+ */
+void log_slow(struct log_t *log, uint32_t n)
+{
+	uint32_t i, k;
+	const struct log_rec_t **arr;
+
+	arr = malloc((log->cnt + 1) * sizeof(void *));
+	for(i = k = 0; i <= log->mask; i++) {
+		if(log->tab[i] != NULL)
+			arr[k++] = log->tab[i];
+	}
+
+	qsort(arr, k, sizeof(void *), log_cmp);
+
+	for(i = 0; (i < k) && (i < n); i++) {
+		print("%10.3fs  %s", (arr[i]->end - arr[i]->start) / 1e6, log_path(arr[i]));
+		if(arr[i]->stat != 0)
+			print("  (failed, status %d)", arr[i]->stat);
+
+		print("\n");
+	}
+
+	free(arr);
+}
+
+
+/**
+ * Retrieve the path of a record.
+ *   @rec: The record.
+ *   &returns: The path.
+ */
+const char *log_path(const struct log_rec_t *rec)
+{
+	return (const char *)(rec + 1);
+}
+
+/**
+ * Compute the size of a record including its padded path.
+ *   @rec: The record.
+ *   &returns: The size in bytes.
+ */
+size_t log_size(const struct log_rec_t *rec)
+{
+	return sizeof(struct log_rec_t) + (((size_t)rec->len + 8) & ~(size_t)7);
+}
+
+/**
+ * Retrieve a record from the mapped log, checking that it lies within the
+ * mapping and that its path is terminated.
+ *   @log: The log.
+ *   @off: The record offset.
+ *   &returns: The record, or null if incomplete or invalid.
+ */
+const struct log_rec_t *log_rec(const struct log_t *log, size_t off)
+{
+	const struct log_rec_t *rec;
+
+	if((off + sizeof(struct log_rec_t)) > log->size)
+		return NULL;
+
+	rec = (const struct log_rec_t *)((const char *)log->map + off);
+	if((rec->len >= (log->size - off - sizeof(struct log_rec_t))) || ((off + log_size(rec)) > log->size))
+		return NULL;
+	else if(log_path(rec)[rec->len] != '\0')
+		return NULL;
+
+	return rec;
+}
+
+/**
+ * Index a record, replacing any older record for the same target.
+ *   @log: The log.
+ *   @rec: The record.
+ */
+void log_index(struct log_t *log, const struct log_rec_t *rec)
+{
+	uint32_t i, k, mask;
+	const struct log_rec_t **tab;
+
+	for(i = hash64(0, log_path(rec)) & log->mask; log->tab[i] != NULL; i = (i + 1) & log->mask) {
+		if(strcmp(log_path(log->tab[i]), log_path(rec)) == 0) {
+			log->tab[i] = rec;
+			return;
+		}
+	}
+
+	log->tab[i] = rec;
+	log->cnt++;
+
+	if((4 * log->cnt) <= (3 * (log->mask + 1)))
+		return;
+
+	mask = 2 * log->mask + 1;
+	tab = calloc(mask + 1, sizeof(void *));
+
+	for(i = 0; i <= log->mask; i++) {
+		if(log->tab[i] == NULL)
+			continue;
+
+		k = hash64(0, log_path(log->tab[i])) & mask;
+		while(tab[k] != NULL)
+			k = (k + 1) & mask;
+
+		tab[k] = log->tab[i];
+	}
+
+	free(log->tab);
+	log->tab = tab;
+	log->mask = mask;
+}
+
+/**
+ * Compact the log file, keeping only the latest record for each target. The
+ * records remain mapped from the original file.
+ *   @log: The log.
+ */
+void log_compact(struct log_t *log)
+{
+	FILE *file;
+	char *tmp;
+	size_t off;
+	const struct log_rec_t *rec;
+
+	tmp = str_fmt("%s.tmp", log->path);
+	file = fopen(tmp, "wb");
+	if(file == NULL) {
+		free(tmp);
+		return;
+	}
+
+	fwrite(LOG_MAGIC, 1, LOG_HDR, file);
+
+	for(off = LOG_HDR; (rec = log_rec(log, off)) != NULL; off += log_size(rec)) {
+		if(log_find(log, log_path(rec)) == rec)
+			fwrite(rec, 1, log_size(rec), file);
+	}
+
+	if((fclose(file) == 0) && (rename(tmp, log->path) == 0))
+		log->nrec = log->cnt;
+	else
+		remove(tmp);
+
+	free(tmp);
+}
+
+/**
+ * Compare two records by decreasing duration.
+ *   @lhs: The left-hand record reference.
+ *   @rhs: The right-hand record reference.
+ *   &returns: The comparison result.
+ */
+int log_cmp(const void *lhs, const void *rhs)
+{
+	const struct log_rec_t *x = *(const struct log_rec_t **)lhs, *y = *(const struct log_rec_t **)rhs;
+	int64_t dx = x->end - x->start, dy = y->end - y->start;
+
+	return (dx < dy) - (dx > dy);
+}
@@ -61,6 +61,11 @@ void memswap(void *lhs, void *rhs, size_t len)
 }
 
 
+/*
+ * location variables
+ */
+__thread struct loc_trap_t *loc_trap = NULL;
+
 /**
  * Compute an offset from a location.
  *   @loc: The location.
@@ -73,7 +78,8 @@ struct loc_t loc_off(struct loc_t loc, uint32_t off)
 }
 
 /**
- * Generate an error at a specific location.
+ * Generate an error at a specific location. If the thread has set a trap,
+ * the message is stored in the trap and control returns to it.
  *   @loc: The location.
  *   @fmt: The printf-style format string.
  *   @...: The printf-style arguments.
@@ -81,9 +87,25 @@ struct loc_t loc_off(struct loc_t loc, uint32_t off)
  */
 void loc_err(struct loc_t loc, const char *fmt, ...)
 {
-	va_list args;
+	char *msg;
+	va_list args, copy;
 
 	va_start(args, fmt);
+
+	if(loc_trap != NULL) {
+		va_copy(copy, args);
+		msg = malloc(vsnprintf(NULL, 0, fmt, copy) + 1);
+		va_end(copy);
+
+		vsprintf(msg, fmt, args);
+		va_end(args);
+
+		loc_trap->msg = str_fmt("%s:%u:%u: %s", loc.path, loc.lin, loc.col, msg);
+		free(msg);
+
+		longjmp(loc_trap->env, 1);
+	}
+
 	fprintf(stderr, "%s:%u:%u: ", loc.path, loc.lin, loc.col);
 	vfprintf(stderr, fmt, args);
 	fprintf(stderr, "\n");
@@ -3,34 +3,18 @@
 
 /**
  * Create a reference.
+ *   @arena: The graph arena.
  *   @spec: The special flag.
- *   @path: Consumed. The file path.
+ *   @path: The interned file path.
+ *   @name: The interned path as written.
  *   &returns: The reference.
  */
-struct target_t *rt_ref_new(bool spec, char *path)
+struct target_t *rt_ref_new(struct arena_t *arena, bool spec, const char *path, const char *name)
 {
 	struct target_t *ref;
 
-	ref = malloc(sizeof(struct target_t));
-	*ref = (struct target_t){ path, spec ? FLAG_SPEC : 0, -1, NULL, NULL };
+	ref = arena_alloc(arena, sizeof(struct target_t));
+	*ref = (struct target_t){ path, name, spec ? FLAG_SPEC : 0, -1, NULL, 0 };
 
 	return ref;
 }
-
-/**
- * Delete a reference.
- *   @ref: The reference.
- */
-void rt_ref_delete(struct target_t *ref)
-{
-	struct edge_t *edge, *tmp;
-
-	edge = ref->edge;
-	while(edge != NULL) {
-		edge = (tmp = edge)->next;
-		free(tmp);
-	}
-
-	free(ref->path);
-	free(ref);
-}
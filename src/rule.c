@@ -3,34 +3,53 @@
 
 /**
  * Create a rule.
+ *   @arena: The graph arena.
  *   @id: Consumed. Optional. The identifier.
  *   @gens: Consumed. The targets.
  *   @deps: Consumed. The dependencies.
  *   @cmds: Consumed. The commands.
  *   &returns: The rule.
  */
-struct rule_t *rule_new(char *id, struct target_list_t *gens, struct target_list_t *deps, struct seq_t *seq)
+struct rule_t *rule_new(struct arena_t *arena, char *id, struct target_list_t *gens, struct target_list_t *deps, struct seq_t *seq)
 {
 	struct rule_t *rule;
 
-	rule = malloc(sizeof(struct rule_t));
-	*rule = (struct rule_t){ id, gens, deps, seq, false, 0 };
+	rule = arena_alloc(arena, sizeof(struct rule_t));
+	*rule = (struct rule_t){ id, gens, deps, seq, false, 0, -1, NULL, 0, 0 };
 
 	return rule;
 }
 
 /**
- * Delete a rule.
+ * Release the commands and makedep files of a rule. The rule itself and its
+ * target lists are held by the graph arena.
  *   @rule: The rule.
  */
-void rule_delete(struct rule_t *rule)
+void rule_clear(struct rule_t *rule)
 {
 	if(rule->seq != NULL)
 		seq_delete(rule->seq);
 
-	target_list_delete(rule->gens);
-	target_list_delete(rule->deps);
-	free(rule);
+	free(rule->id);
+	free(rule->mk);
+}
+
+/**
+ * Add a makedep file to a rule, ignoring duplicates.
+ *   @rule: The rule.
+ *   @path: The interned path.
+ */
+void rule_mkdep(struct rule_t *rule, const char *path)
+{
+	uint32_t i;
+
+	for(i = 0; i < rule->nmk; i++) {
+		if(rule->mk[i] == path)
+			return;
+	}
+
+	rule->mk = realloc(rule->mk, (rule->nmk + 1) * sizeof(const char *));
+	rule->mk[rule->nmk++] = path;
 }
 
 
@@ -64,47 +83,43 @@ struct rule_t *rule_next(struct rule_iter_t *iter)
 
 /**
  * Create a list of rules.
+ *   @arena: The graph arena.
  *   &returns: The list.
  */
-struct rule_list_t *rule_list_new(void)
+struct rule_list_t *rule_list_new(struct arena_t *arena)
 {
 	struct rule_list_t *list;
 
-	list = malloc(sizeof(struct rule_list_t));
+	list = arena_alloc(arena, sizeof(struct rule_list_t));
 	*list = (struct rule_list_t){ NULL };
 
 	return list;
 }
 
 /**
- * Delete a list of rules.
+ * Release the rules of a list.
  *   @list: The list.
  */
-void rule_list_delete(struct rule_list_t *list)
+void rule_list_clear(struct rule_list_t *list)
 {
-	struct rule_inst_t *inst, *tmp;
-
-	inst = list->inst;
-	while(inst != NULL) {
-		inst = (tmp = inst)->next;
-		rule_delete(tmp->rule);
-		free(tmp);
-	}
+	struct rule_inst_t *inst;
 
-	free(list);
+	for(inst = list->inst; inst != NULL; inst = inst->next)
+		rule_clear(inst->rule);
 }
 
 
 /**
  * Add a rule to the list.
+ *   @arena: The graph arena.
  *   @list: The list.
  *   @rule: The rule.
  */
-void rule_list_add(struct rule_list_t *list, struct rule_t *rule)
+void rule_list_add(struct arena_t *arena, struct rule_list_t *list, struct rule_t *rule)
 {
 	struct rule_inst_t *inst;
 
-	inst = malloc(sizeof(struct rule_inst_t));
+	inst = arena_alloc(arena, sizeof(struct rule_inst_t));
 	inst->rule = rule;
 
 	inst->next = list->inst;
@@ -114,33 +129,68 @@ void rule_list_add(struct rule_list_t *list, struct rule_t *rule)
 
 /**
  * Queue structure.
- *   @head, tail: The head and tail items.
+ *   @csr: The compressed graph.
+ *   @log: Optional. The build log for rule costs.
+ *   @item: The heap array.
+ *   @len, max: The heap length and capacity.
+ *   @seq: The insertion counter.
  */
 struct queue_t {
-	struct item_t *head, **tail;
+	struct csr_t *csr;
+	struct log_t *log;
+
+	struct item_t *item;
+	uint32_t len, max;
+	uint64_t seq;
+};
+
+/**
+ * Traversal frame structure.
+ *   @rule: The rule.
+ *   @k: The next dependency offset.
+ *   @cnt: The number of dependencies with rules.
+ */
+struct recur_t {
+	struct rule_t *rule;
+	uint32_t k, cnt;
 };
 
 /**
  * Item structure.
  *   @rule: The rule.
- *   @next: The next item.
+ *   @seq: The insertion order, breaking ties between equal priorities.
  */
 struct item_t {
 	struct rule_t *rule;
-	struct item_t *next;
+	uint64_t seq;
 };
 
+/*
+ * queue definitions
+ */
+#define RULE_COST 100000
+
+/*
+ * heap declarations
+ */
+bool queue_less(struct item_t *lhs, struct item_t *rhs);
+void queue_push(struct queue_t *queue, struct rule_t *rule);
+void queue_up(struct queue_t *queue, uint32_t i);
+void queue_down(struct queue_t *queue, uint32_t i);
+
 
 /**
  * Create a queue.
+ *   @csr: The compressed graph.
+ *   @log: Optional. The build log for rule costs.
  *   &returns: The queue.
  */
-struct queue_t *queue_new(void)
+struct queue_t *queue_new(struct csr_t *csr, struct log_t *log)
 {
 	struct queue_t *queue;
 
 	queue = malloc(sizeof(struct queue_t));
-	*queue = (struct queue_t){ NULL, &queue->head };
+	*queue = (struct queue_t){ csr, log, malloc(64 * sizeof(struct item_t)), 0, 64, 0 };
 
 	return queue;
 }
@@ -151,37 +201,116 @@ struct queue_t *queue_new(void)
  */
 void queue_delete(struct queue_t *queue)
 {
+	free(queue->item);
 	free(queue);
 }
 
 
 /**
- * Recursivly add rules to a queue.
+ * Recursivly add rules to a queue, counting the pending dependencies of each
+ * rule. The traversal uses an explicit stack, visiting rules in the same
+ * order as a depth-first recursion. Ready rules are held unordered until
+ * `queue_sched` is called once every root has been added.
  *   @queue: The queue.
  *   @rule: The root rule.
  */
 void queue_recur(struct queue_t *queue, struct rule_t *rule)
 {
-	uint32_t cnt = 0;
+	uint32_t n = 0, max = 64;
+	struct recur_t *top, *stack;
 	struct target_t *target;
-	struct target_iter_t iter;
+	struct csr_t *csr = queue->csr;
 
 	if(rule->add)
 		return;
 
+	stack = malloc(max * sizeof(struct recur_t));
+
 	rule->add = true;
-	iter = target_iter(rule->deps);
-	while((target = target_next(&iter)) != NULL) {
-		if(target->rule != NULL) {
-			cnt++;
-			queue_recur(queue, target->rule);
+	stack[n++] = (struct recur_t){ rule, csr->off[2 * rule->idx + 1], 0 };
+
+	while(n > 0) {
+		top = &stack[n - 1];
+
+		if(top->k < csr->off[2 * top->rule->idx + 2]) {
+			target = csr->target[csr->adj[top->k++]];
+			if(target->rule == NULL)
+				continue;
+
+			top->cnt++;
+			if(target->rule->add)
+				continue;
+
+			if(n == max)
+				stack = realloc(stack, (max *= 2) * sizeof(struct recur_t));
+
+			target->rule->add = true;
+			stack[n++] = (struct recur_t){ target->rule, csr->off[2 * target->rule->idx + 1], 0 };
+		}
+		else {
+			if(top->cnt == 0)
+				queue_push(queue, top->rule);
+			else
+				top->rule->edges = top->cnt;
+
+			n--;
 		}
 	}
 
-	if(cnt == 0)
-		queue_add(queue, rule);
-	else
-		rule->edges = cnt;
+	free(stack);
+}
+
+/**
+ * Schedule the ready rules held by the queue, ordering them by priority.
+ * Every dependency cycle among the added rules is reported with its target
+ * paths first, in which case nothing is scheduled.
+ *   @queue: The queue.
+ *   &returns: The number of cycles.
+ */
+uint32_t queue_sched(struct queue_t *queue)
+{
+	uint32_t i, k, n, len, cyc = 0;
+	uint32_t *comp, *ord, *tmp, *path;
+	struct csr_t *csr = queue->csr;
+
+	comp = malloc(csr->nrule * sizeof(uint32_t));
+	ord = malloc(csr->nrule * sizeof(uint32_t));
+	tmp = malloc(3 * csr->nrule * sizeof(uint32_t));
+	path = malloc((csr->nrule + 1) * sizeof(uint32_t));
+	memset(tmp, 0xff, csr->nrule * sizeof(uint32_t));
+
+	n = csr_scc(csr, comp, ord);
+
+	for(i = 0; i < n; i++) {
+		if((i > 0) && (comp[ord[i]] == comp[ord[i - 1]]))
+			continue;
+
+		len = csr_cycle(csr, comp, ord[i], tmp, path);
+		if(len == 0)
+			continue;
+
+		fprintf(stderr, "%s: Dependency cycle: ", cli_app);
+		for(k = 0; k < len; k++)
+			fprintf(stderr, "%s%s", (k > 0) ? " -> " : "", csr->target[path[k]]->path);
+
+		fprintf(stderr, "\n");
+		cyc++;
+	}
+
+	if(cyc == 0) {
+		for(i = n; i-- > 0; )
+			rule_prio(csr, csr->rule[ord[i]], queue->log);
+
+		for(i = queue->len / 2; i-- > 0; )
+			queue_down(queue, i);
+	}
+
+	free(comp);
+	free(ord);
+	free(tmp);
+	free(path);
+
+	return cyc;
 }
 
 /**
@@ -191,36 +320,177 @@ void queue_recur(struct queue_t *queue, struct rule_t *rule)
  */
 void queue_add(struct queue_t *queue, struct rule_t *rule)
 {
-	struct item_t *item;
-
-	item = malloc(sizeof(struct item_t));
-	item->rule = rule;
-	item->next = NULL;
+	rule_prio(queue->csr, rule, queue->log);
+	queue_push(queue, rule);
+	queue_up(queue, queue->len - 1);
+}
 
-	*queue->tail = item;
-	queue->tail = &item->next;
+/**
+ * Finish a rule, adding the dependent rules that become ready.
+ *   @queue: The queue.
+ *   @rule: The finished rule.
+ */
+void queue_done(struct queue_t *queue, struct rule_t *rule)
+{
+	uint32_t i, k, t;
+	struct rule_t *dep;
+	struct csr_t *csr = queue->csr;
+
+	for(i = csr->off[2 * rule->idx]; i < csr->off[2 * rule->idx + 1]; i++) {
+		t = csr->adj[i];
+		csr->target[t]->mtime = -1;
+
+		for(k = csr->eoff[t]; k < csr->eoff[t + 1]; k++) {
+			dep = csr->rule[csr->edge[k]];
+			if(dep->add && (--dep->edges == 0))
+				queue_add(queue, dep);
+		}
+	}
 }
 
 /**
- * Remove a rule from the queue.
+ * Remove the highest priority rule from the queue.
  *   @queue: The queue.
  *   &returnss: The rule or null if no rules are available.
  */
 struct rule_t *queue_rem(struct queue_t *queue)
 {
-	struct item_t *item;
 	struct rule_t *rule;
 
-	item = queue->head;
-	if(item == NULL)
+	if(queue->len == 0)
 		return NULL;
 
-	queue->head = item->next;
-	if(queue->head == NULL)
-		queue->tail = &queue->head;
-
-	rule = item->rule;
-	free(item);
+	rule = queue->item[0].rule;
+	queue->item[0] = queue->item[--queue->len];
+	queue_down(queue, 0);
 
 	return rule;
 }
+
+
+/**
+ * Compare two heap items.
+ *   @lhs: The left-hand side.
+ *   @rhs: The right-hand side.
+ *   &returns: True if the left-hand side should run first.
+ */
+bool queue_less(struct item_t *lhs, struct item_t *rhs)
+{
+	if(lhs->rule->prio != rhs->rule->prio)
+		return lhs->rule->prio > rhs->rule->prio;
+	else
+		return lhs->seq < rhs->seq;
+}
+
+/**
+ * Append a rule to the heap array without ordering it.
+ *   @queue: The queue.
+ *   @rule: The rule.
+ */
+void queue_push(struct queue_t *queue, struct rule_t *rule)
+{
+	if(queue->len >= queue->max)
+		queue->item = realloc(queue->item, (queue->max *= 2) * sizeof(struct item_t));
+
+	queue->item[queue->len++] = (struct item_t){ rule, queue->seq++ };
+}
+
+/**
+ * Sift a heap item up.
+ *   @queue: The queue.
+ *   @i: The item index.
+ */
+void queue_up(struct queue_t *queue, uint32_t i)
+{
+	while((i > 0) && queue_less(&queue->item[i], &queue->item[(i - 1) / 2])) {
+		memswap(&queue->item[i], &queue->item[(i - 1) / 2], sizeof(struct item_t));
+		i = (i - 1) / 2;
+	}
+}
+
+/**
+ * Sift a heap item down.
+ *   @queue: The queue.
+ *   @i: The item index.
+ */
+void queue_down(struct queue_t *queue, uint32_t i)
+{
+	uint32_t k;
+
+	for(;;) {
+		k = 2 * i + 1;
+		if(k >= queue->len)
+			break;
+
+		if(((k + 1) < queue->len) && queue_less(&queue->item[k + 1], &queue->item[k]))
+			k++;
+
+		if(!queue_less(&queue->item[k], &queue->item[i]))
+			break;
+
+		memswap(&queue->item[i], &queue->item[k], sizeof(struct item_t));
+		i = k;
+	}
+}
+
+
+/**
+ * Estimate the cost of running a rule. The last successful duration from the
+ * build log is used when available, otherwise the average logged duration,
+ * otherwise a fixed cost per command.
+ *   @rule: The rule.
+ *   @log: Optional. The build log.
+ *   &returns: The cost in microseconds.
+ */
+int64_t rule_cost(struct rule_t *rule, struct log_t *log)
+{
+	int64_t cost = 0;
+	struct cmd_t *cmd;
+	const struct log_rec_t *rec;
+
+	if((rule->seq == NULL) || (rule->seq->head == NULL))
+		return 0;
+
+	if(log != NULL) {
+		rec = log_find(log, rule->gens->inst->target->path);
+		if((rec != NULL) && (rec->stat == 0))
+			return rec->end - rec->start;
+		else if(log->avg > 0)
+			return log->avg;
+	}
+
+	for(cmd = rule->seq->head; cmd != NULL; cmd = cmd->next)
+		cost += RULE_COST;
+
+	return cost;
+}
+
+/**
+ * Compute the priority of a rule, the cost of the longest path from the rule
+ * to any goal. Only rules that have been added to the queue are followed,
+ * and their priorities must already be computed.
+ *   @csr: The compressed graph.
+ *   @rule: The rule.
+ *   @log: Optional. The build log.
+ *   &returns: The priority.
+ */
+int64_t rule_prio(struct csr_t *csr, struct rule_t *rule, struct log_t *log)
+{
+	uint32_t i, k, t;
+	int64_t max = 0;
+	struct rule_t *dep;
+
+	if(rule->prio >= 0)
+		return rule->prio;
+
+	for(i = csr->off[2 * rule->idx]; i < csr->off[2 * rule->idx + 1]; i++) {
+		t = csr->adj[i];
+		for(k = csr->eoff[t]; k < csr->eoff[t + 1]; k++) {
+			dep = csr->rule[csr->edge[k]];
+			if(dep->add && (dep->prio > max))
+				max = dep->prio;
+		}
+	}
+
+	return rule->prio = max + rule_cost(rule, log);
+}
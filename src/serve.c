@@ -0,0 +1,345 @@
+#include "inc.h"
+
+
+/**
+ * Watched directory structure.
+ *   @dir: The interned directory path.
+ *   @wd: The watch descriptor, negative if not watched.
+ */
+struct watch_t {
+	const char *dir;
+	int wd;
+};
+
+/**
+ * Watched file structure.
+ *   @target: The target.
+ *   @watch: The directory watch index.
+ */
+struct wfile_t {
+	struct target_t *target;
+	uint32_t watch;
+};
+
+/**
+ * Server structure.
+ *   @ctx: The context.
+ *   @notify: The file change notifier.
+ *   @reload: Reload flag, set when a file read by evaluation changed.
+ *   @watch, nwatch: The watched directories.
+ *   @tab, mask: The directory table, storing watch indices plus one.
+ *   @wd, nwd: The watch index of each watch descriptor, plus one.
+ *   @file, nfile: The watched files.
+ */
+struct serve_t {
+	struct rt_ctx_t *ctx;
+	int notify;
+	bool reload;
+
+	struct watch_t *watch;
+	uint32_t nwatch;
+
+	uint32_t *tab, mask;
+	uint32_t *wd, nwd;
+
+	struct wfile_t *file;
+	uint32_t nfile;
+};
+
+/*
+ * server declarations
+ */
+uint32_t serve_dir(struct serve_t *serve, const char *path);
+void serve_watch(struct serve_t *serve);
+void serve_refresh(struct serve_t *serve);
+void serve_inval(struct serve_t *serve, uint32_t watch);
+void serve_event(void *arg, int wd, const char *name);
+void serve_child(struct rt_ctx_t *ctx, char **args) __attribute__((noreturn));
+
+
+/**
+ * Run a build server on an evaluated context until a file read by the
+ * evaluation changes. Modification times are cached for files in watched
+ * directories and invalidated by change notifications, and every build runs
+ * in a forked process so that the rule state starts fresh each time.
+ *   @ctx: The context.
+ *   @sock: The listening socket.
+ */
+void serve_run(struct rt_ctx_t *ctx, int sock)
+{
+	int pid, conn;
+	bool ready;
+	char **args;
+	uint32_t i, n;
+	struct ent_t *ent;
+	struct serve_t serve;
+
+	serve.ctx = ctx;
+	serve.notify = os_notify();
+	serve.reload = false;
+	serve.watch = NULL;
+	serve.nwatch = 0;
+	serve.mask = 255;
+	serve.tab = calloc(serve.mask + 1, sizeof(uint32_t));
+	serve.wd = NULL;
+	serve.nwd = 0;
+
+	for(n = 0, ent = ctx->map->ent; ent != NULL; ent = ent->next)
+		n++;
+
+	serve.file = malloc(n * sizeof(struct wfile_t));
+	serve.nfile = 0;
+
+	for(ent = ctx->map->ent; ent != NULL; ent = ent->next) {
+		if(ent->target->flags & FLAG_SPEC)
+			continue;
+
+		serve.file[serve.nfile++] = (struct wfile_t){ ent->target, serve_dir(&serve, ent->target->path) };
+	}
+
+	for(i = 0; i < ctx->nsrc; i++)
+		serve_dir(&serve, ctx->src[i].path);
+
+	serve_watch(&serve);
+	serve_refresh(&serve);
+
+	for(;;) {
+		ready = os_ready(serve.notify, sock);
+
+		os_notify_read(serve.notify, serve_event, &serve);
+		if(serve.reload)
+			break;
+		else if(!ready)
+			continue;
+
+		serve_watch(&serve);
+		serve_refresh(&serve);
+
+		pid = os_request(sock, &conn, &args);
+		if(pid == 0)
+			serve_child(ctx, args);
+		else if(pid > 0)
+			os_respond(conn, pid);
+	}
+
+	os_close(serve.notify);
+	free(serve.watch);
+	free(serve.tab);
+	free(serve.wd);
+	free(serve.file);
+}
+
+
+/**
+ * Retrieve the directory watch of a path, adding it if needed.
+ *   @serve: The server.
+ *   @path: The path.
+ *   &returns: The watch index.
+ */
+uint32_t serve_dir(struct serve_t *serve, const char *path)
+{
+	char *tmp;
+	uint32_t i, k;
+	const char *dir, *end;
+
+	end = strrchr(path, '/');
+	if(end == NULL)
+		dir = intern_str(".");
+	else if(end == path)
+		dir = intern_str("/");
+	else {
+		tmp = strndup(path, end - path);
+		dir = intern_str(tmp);
+		free(tmp);
+	}
+
+	for(i = hash64(0, dir) & serve->mask; serve->tab[i] != 0; i = (i + 1) & serve->mask) {
+		if(serve->watch[serve->tab[i] - 1].dir == dir)
+			return serve->tab[i] - 1;
+	}
+
+	serve->watch = realloc(serve->watch, (serve->nwatch + 1) * sizeof(struct watch_t));
+	serve->watch[serve->nwatch] = (struct watch_t){ dir, -1 };
+	serve->tab[i] = ++serve->nwatch;
+
+	if((2 * serve->nwatch) > (serve->mask + 1)) {
+		serve->mask = 2 * serve->mask + 1;
+		free(serve->tab);
+		serve->tab = calloc(serve->mask + 1, sizeof(uint32_t));
+
+		for(k = 0; k < serve->nwatch; k++) {
+			i = hash64(0, serve->watch[k].dir) & serve->mask;
+			while(serve->tab[i] != 0)
+				i = (i + 1) & serve->mask;
+
+			serve->tab[i] = k + 1;
+		}
+	}
+
+	return serve->nwatch - 1;
+}
+
+/**
+ * Watch every directory that is not yet watched. Directories that do not
+ * exist yet are retried on the next request, and their files are never
+ * cached until then.
+ *   @serve: The server.
+ */
+void serve_watch(struct serve_t *serve)
+{
+	int wd;
+	uint32_t i;
+
+	for(i = 0; i < serve->nwatch; i++) {
+		if(serve->watch[i].wd >= 0)
+			continue;
+
+		wd = os_notify_add(serve->notify, serve->watch[i].dir);
+		if(wd < 0)
+			continue;
+
+		if((uint32_t)wd >= serve->nwd) {
+			serve->wd = realloc(serve->wd, (wd + 1) * sizeof(uint32_t));
+			memset(serve->wd + serve->nwd, 0, (wd + 1 - serve->nwd) * sizeof(uint32_t));
+			serve->nwd = wd + 1;
+		}
+
+		serve->wd[wd] = i + 1;
+		serve->watch[i].wd = wd;
+		serve_inval(serve, i);
+	}
+}
+
+/**
+ * Retrieve the modification time of every uncached file in a watched
+ * directory.
+ *   @serve: The server.
+ */
+void serve_refresh(struct serve_t *serve)
+{
+	uint32_t i, n = 0;
+	int64_t *mtime;
+	const char **paths;
+	struct wfile_t **list;
+
+	list = malloc(serve->nfile * sizeof(struct wfile_t *));
+
+	for(i = 0; i < serve->nfile; i++) {
+		if((serve->file[i].target->mtime == -1) && (serve->watch[serve->file[i].watch].wd >= 0))
+			list[n++] = &serve->file[i];
+	}
+
+	paths = malloc(n * sizeof(const char *));
+	mtime = malloc(n * sizeof(int64_t));
+
+	for(i = 0; i < n; i++)
+		paths[i] = list[i]->target->path;
+
+	os_mtimes(paths, mtime, n);
+
+	for(i = 0; i < n; i++)
+		list[i]->target->mtime = mtime[i];
+
+	free(list);
+	free(paths);
+	free(mtime);
+}
+
+/**
+ * Invalidate the cached modification times of files in a directory.
+ *   @serve: The server.
+ *   @watch: The watch index.
+ */
+void serve_inval(struct serve_t *serve, uint32_t watch)
+{
+	uint32_t i;
+
+	for(i = 0; i < serve->nfile; i++) {
+		if(serve->file[i].watch == watch)
+			serve->file[i].target->mtime = -1;
+	}
+}
+
+/**
+ * Handle a change notification.
+ *   @arg: The server.
+ *   @wd: The watch descriptor, negative if notifications were lost.
+ *   @name: Optional. The entry name, null if the directory went away.
+ */
+void serve_event(void *arg, int wd, const char *name)
+{
+	char *tmp;
+	uint32_t i, k;
+	const char *dir, *path;
+	struct target_t *target;
+	struct serve_t *serve = arg;
+
+	if(wd < 0) {
+		for(i = 0; i < serve->nfile; i++)
+			serve->file[i].target->mtime = -1;
+
+		serve->reload = true;
+		return;
+	}
+	else if(((uint32_t)wd >= serve->nwd) || (serve->wd[wd] == 0))
+		return;
+
+	k = serve->wd[wd] - 1;
+	if(name == NULL) {
+		serve->wd[wd] = 0;
+		serve->watch[k].wd = -1;
+		serve_inval(serve, k);
+		return;
+	}
+
+	dir = serve->watch[k].dir;
+	if(strcmp(dir, ".") == 0)
+		tmp = strdup(name);
+	else if(strcmp(dir, "/") == 0)
+		tmp = str_fmt("/%s", name);
+	else
+		tmp = str_fmt("%s/%s", dir, name);
+
+	path = intern_find(tmp);
+	free(tmp);
+
+	if(path == NULL)
+		return;
+
+	for(i = 0; i < serve->ctx->nsrc; i++) {
+		if(serve->ctx->src[i].path == path)
+			serve->reload = true;
+	}
+
+	target = map_get(serve->ctx->map, false, path);
+	if(target != NULL)
+		target->mtime = -1;
+}
+
+/**
+ * Run a build request in the forked request process.
+ *   @ctx: The context.
+ *   @args: The null-terminated arguments.
+ *   &noreturn
+ */
+void serve_child(struct rt_ctx_t *ctx, char **args)
+{
+	uint32_t cnt;
+	const char **arr;
+	struct opt_t opt;
+
+	cli_opts(args, &opt, &arr, &cnt);
+
+	ctx->opt = &opt;
+	ctx->digest = opt.digest ? digest_open(".hammer.db") : NULL;
+	log_close(ctx->log);
+	ctx->log = log_open(".hammer.log");
+
+	ctx_run(ctx, arr);
+
+	if(ctx->digest != NULL)
+		digest_close(ctx->digest);
+
+	log_close(ctx->log);
+	exit(0);
+}
@@ -1,4 +1,7 @@
 #include "inc.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 /**
@@ -190,8 +193,11 @@ void buf_ch(struct buf_t *buf, char ch)
  */
 void buf_mem(struct buf_t *buf, const char *mem, uint32_t len)
 {
-	while(len-- > 0)
-		buf_ch(buf, *mem++);
+	while((buf->len + len) > buf->max)
+		buf->str = realloc(buf->str, buf->max *= 2);
+
+	memcpy(buf->str + buf->len, mem, len);
+	buf->len += len;
 }
 
 /**
@@ -275,3 +281,114 @@ bool ch_id(int ch)
 {
 	return !ch_space(ch) && (ch != '{') && (ch != '}') && (ch != ':') && (ch != ';') && (ch != '=');
 }
+
+
+/**
+ * Skip over whitespace, sixteen bytes at a time where supported.
+ *   @ptr: The start of the memory.
+ *   @end: The end of the memory.
+ *   &returns: The first non-space character or the end.
+ */
+const char *str_space(const char *ptr, const char *end)
+{
+#ifdef __SSE2__
+	__m128i v, m;
+	uint32_t bits;
+
+	while((end - ptr) >= 16) {
+		v = _mm_loadu_si128((const __m128i *)ptr);
+		m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8('\t')), _mm_min_epu8(v, _mm_set1_epi8('\v'))));
+
+		bits = ~_mm_movemask_epi8(m) & 0xFFFF;
+		if(bits != 0)
+			return ptr + __builtin_ctz(bits);
+
+		ptr += 16;
+	}
+#endif
+
+	while((ptr < end) && ch_space((unsigned char)*ptr))
+		ptr++;
+
+	return ptr;
+}
+
+/**
+ * Skip over plain string characters, sixteen bytes at a time where
+ * supported.
+ *   @ptr: The start of the memory.
+ *   @end: The end of the memory.
+ *   &returns: The first character that is not a plain string character,
+ *     or the end.
+ */
+const char *str_plain(const char *ptr, const char *end)
+{
+#ifdef __SSE2__
+	__m128i v, m, t;
+	uint32_t bits;
+
+	while((end - ptr) >= 16) {
+		v = _mm_loadu_si128((const __m128i *)ptr);
+
+		t = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		m = _mm_cmpeq_epi8(_mm_max_epu8(t, _mm_set1_epi8('a')), _mm_min_epu8(t, _mm_set1_epi8('z')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8('0')), _mm_min_epu8(v, _mm_set1_epi8('9'))));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8('-')), _mm_min_epu8(v, _mm_set1_epi8('/'))));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('~')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('+')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('=')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('%')));
+
+		bits = ~_mm_movemask_epi8(m) & 0xFFFF;
+		if(bits != 0)
+			return ptr + __builtin_ctz(bits);
+
+		ptr += 16;
+	}
+#endif
+
+	while((ptr < end) && ch_str((unsigned char)*ptr))
+		ptr++;
+
+	return ptr;
+}
+
+/**
+ * Find the first character from a set, sixteen bytes at a time where
+ * supported. The null character always belongs to the set.
+ *   @ptr: The start of the memory.
+ *   @end: The end of the memory.
+ *   @set: The set of up to eight characters.
+ *   &returns: The first character in the set or the end.
+ */
+const char *str_stop(const char *ptr, const char *end, const char *set)
+{
+#ifdef __SSE2__
+	__m128i v, m;
+	uint32_t i, n, bits;
+	__m128i c[8];
+
+	for(n = 0; (n < 8) && (set[n] != '\0'); n++)
+		c[n] = _mm_set1_epi8(set[n]);
+
+	while((end - ptr) >= 16) {
+		v = _mm_loadu_si128((const __m128i *)ptr);
+		m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+		for(i = 0; i < n; i++)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(v, c[i]));
+
+		bits = _mm_movemask_epi8(m);
+		if(bits != 0)
+			return ptr + __builtin_ctz(bits);
+
+		ptr += 16;
+	}
+#endif
+
+	while((ptr < end) && (*ptr != '\0') && (strchr(set, *ptr) == NULL))
+		ptr++;
+
+	return ptr;
+}
@@ -1,35 +1,20 @@
 #include "inc.h"
 
 /**
- * Retrieve the target modification time, caching it as needed.
+ * Retrieve the target modification time, caching it as needed. Missing files
+ * are cached as well, until the target is invalidated by its rule.
  *   @target: The target.
  *   &returns: The modification time.
  */
 int64_t target_mtime(struct target_t *target)
 {
-	if(target->mtime < 0)
+	if(target->mtime == -1)
 		target->mtime = os_mtime(target->path);
 
 	return target->mtime;
 }
 
 
-/**
- * Connect a target to a rule.
- *   @target: The target.
- *   @rule: The rule.
- */
-void target_conn(struct target_t *target, struct rule_t *rule)
-{
-	struct edge_t *edge;
-
-	edge = malloc(sizeof(struct edge_t));
-	edge->rule = rule;
-	edge->next = target->edge;
-	target->edge = edge;
-}
-
-
 /**
  * Retrieve an iterator to the target list.
  *   @list: The list.
@@ -59,36 +44,21 @@ struct target_t *target_next(struct target_iter_t *iter)
 
 
 /**
- * Create a target list.
+ * Create a target list. Lists are released along with the graph arena.
+ *   @arena: The graph arena.
  *   &returns: The list.
  */
-struct target_list_t *target_list_new(void)
+struct target_list_t *target_list_new(struct arena_t *arena)
 {
 	struct target_list_t *list;
 
-	list = malloc(sizeof(struct target_list_t));
-	*list = (struct target_list_t){ NULL };
+	list = arena_alloc(arena, sizeof(struct target_list_t));
+	list->inst = NULL;
+	list->tail = &list->inst;
 
 	return list;
 }
 
-/**
- * Destroy a target list.
- *   @list: The list.
- */
-void target_list_delete(struct target_list_t *list)
-{
-	struct target_inst_t *inst, *tmp;
-
-	inst = list->inst;
-	while(inst != NULL) {
-		inst = (tmp = inst)->next;
-		free(tmp);
-	}
-
-	free(list);
-}
-
 
 /**
  * Retrieve the list length.
@@ -126,20 +96,32 @@ bool target_list_contains(struct target_list_t *list, struct target_t *target)
 
 /**
  * Add a target to the list.
+ *   @arena: The graph arena.
  *   @list: The list.
  *   @target: The target.
  */
-void target_list_add(struct target_list_t *list, struct target_t *target)
+void target_list_add(struct arena_t *arena, struct target_list_t *list, struct target_t *target)
 {
-	struct target_inst_t **inst;
+	*list->tail = arena_alloc(arena, sizeof(struct target_inst_t));
+	(*list->tail)->target = target;
+	(*list->tail)->next = NULL;
+	list->tail = &(*list->tail)->next;
+}
 
-	inst = &list->inst;
-	while(*inst != NULL)
-		inst = &(*inst)->next;
+/**
+ * Move the targets of a list to the end of another list.
+ *   @dst: The destination list.
+ *   @src: The source list, left empty.
+ */
+void target_list_move(struct target_list_t *dst, struct target_list_t *src)
+{
+	if(src->inst == NULL)
+		return;
 
-	*inst = malloc(sizeof(struct target_inst_t));
-	(*inst)->target = target;
-	(*inst)->next = NULL;
+	*dst->tail = src->inst;
+	dst->tail = src->tail;
+	src->inst = NULL;
+	src->tail = &src->inst;
 }
 
 struct target_t *target_list_find(struct target_list_t *list, bool spec, const char *path)
@@ -155,35 +137,50 @@ struct target_t *target_list_find(struct target_list_t *list, bool spec, const c
 }
 
 
+/*
+ * map definitions
+ */
+#define MAP_INIT  64
+#define MAP_STEP  4
+
+/*
+ * probe table declarations
+ */
+void map_ins(struct ent_t **tab, uint32_t mask, struct ent_t *ent);
+struct ent_t *map_probe(struct ent_t **tab, uint32_t mask, uint64_t hash, const char *path);
+void map_migrate(struct map_t *map, uint32_t n);
+
+
 /**
  * Create a target map.
+ *   @arena: The graph arena.
  *   &returns: The map.
  */
-struct map_t *map_new(void)
+struct map_t *map_new(struct arena_t *arena)
 {
 	struct map_t *map;
 
 	map = malloc(sizeof(struct map_t));
+	map->arena = arena;
 	map->ent = NULL;
+	map->tab = calloc(MAP_INIT, sizeof(struct ent_t *));
+	map->old = NULL;
+	map->cnt = 0;
+	map->mask = MAP_INIT - 1;
+	map->omask = 0;
+	map->mig = 0;
 
 	return map;
 }
 
 /**
- * Delete a target map.
+ * Delete a target map. The entries and targets are held by the graph arena.
  *   @map: The map.
  */
 void map_delete(struct map_t *map)
 {
-	struct ent_t *ent, *tmp;
-
-	ent = map->ent;
-	while(ent != NULL) {
-		ent = (tmp = ent)->next;
-		rt_ref_delete(tmp->target);
-		free(tmp);
-	}
-
+	free(map->old);
+	free(map->tab);
 	free(map);
 }
 
@@ -192,19 +189,21 @@ void map_delete(struct map_t *map)
  * Retrieve a target from a map.
  *   @map: The map.
  *   @spec: The special flag.
- *   @path: The path.
+ *   @path: The interned path.
  *   &returns: The target or null if not found.
  */
 struct target_t *map_get(struct map_t *map, bool spec, const char *path)
 {
+	uint64_t hash;
 	struct ent_t *ent;
 
-	for(ent = map->ent; ent != NULL; ent = ent->next) {
-		if(strcmp(ent->target->path, path) == 0)
-			return ent->target;
-	}
+	hash = hash64(0, path);
 
-	return NULL;
+	ent = map_probe(map->tab, map->mask, hash, path);
+	if((ent == NULL) && (map->old != NULL))
+		ent = map_probe(map->old, map->omask, hash, path);
+
+	return ent ? ent->target : NULL;
 }
 
 /**
@@ -216,9 +215,86 @@ void map_add(struct map_t *map, struct target_t *target)
 {
 	struct ent_t *ent;
 
-	ent = malloc(sizeof(struct ent_t));
+	if(map->old != NULL)
+		map_migrate(map, MAP_STEP);
+
+	if(4 * (map->cnt + 1) > 3 * (map->mask + 1)) {
+		if(map->old != NULL)
+			map_migrate(map, map->omask + 1);
+
+		map->old = map->tab;
+		map->omask = map->mask;
+		map->mig = 0;
+		map->mask = 2 * map->mask + 1;
+		map->tab = calloc(map->mask + 1, sizeof(struct ent_t *));
+	}
+
+	ent = arena_alloc(map->arena, sizeof(struct ent_t));
+	ent->hash = hash64(0, target->path);
 	ent->target = target;
 
 	ent->next = map->ent;
 	map->ent = ent;
+
+	map_ins(map->tab, map->mask, ent);
+	map->cnt++;
+}
+
+
+/**
+ * Insert an entry into a probe table.
+ *   @tab: The table.
+ *   @mask: The table mask.
+ *   @ent: The entry.
+ */
+void map_ins(struct ent_t **tab, uint32_t mask, struct ent_t *ent)
+{
+	uint32_t i;
+
+	i = ent->hash & mask;
+	while(tab[i] != NULL)
+		i = (i + 1) & mask;
+
+	tab[i] = ent;
+}
+
+/**
+ * Probe a table for a path.
+ *   @tab: The table.
+ *   @mask: The table mask.
+ *   @hash: The path hash.
+ *   @path: The interned path.
+ *   &returns: The entry or null.
+ */
+struct ent_t *map_probe(struct ent_t **tab, uint32_t mask, uint64_t hash, const char *path)
+{
+	uint32_t i;
+
+	for(i = hash & mask; tab[i] != NULL; i = (i + 1) & mask) {
+		if(tab[i]->target->path == path)
+			return tab[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Migrate entries from the old table. The old table is left intact until
+ * fully migrated so that its probe sequences remain valid.
+ *   @map: The map.
+ *   @n: The maximum number of slots to migrate.
+ */
+void map_migrate(struct map_t *map, uint32_t n)
+{
+	while((n-- > 0) && (map->mig <= map->omask)) {
+		if(map->old[map->mig] != NULL)
+			map_ins(map->tab, map->mask, map->old[map->mig]);
+
+		map->mig++;
+	}
+
+	if(map->mig > map->omask) {
+		free(map->old);
+		map->old = NULL;
+	}
 }
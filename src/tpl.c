@@ -0,0 +1,623 @@
+#include "inc.h"
+
+
+/**
+ * Template reader structure.
+ *   @orig, str: The origin and current pointers.
+ *   @loc: The location of the origin.
+ */
+struct tpl_rd_t {
+	const char *orig, *str;
+	struct loc_t loc;
+};
+
+/*
+ * template parsing declarations
+ */
+struct tpl_t *tpl_get(struct tpl_rd_t *rd);
+bool tpl_str(struct tpl_rd_t *rd, struct tpl_node_t ***tail, struct buf_t *lit);
+bool tpl_escape(struct tpl_rd_t *rd, struct buf_t *lit);
+bool tpl_quote(struct tpl_rd_t *rd, struct tpl_node_t ***tail, struct buf_t *lit);
+struct tpl_node_t *tpl_var(struct tpl_rd_t *rd);
+struct tpl_node_t *tpl_bind(struct tpl_rd_t *rd, bool brace);
+void tpl_flush(struct tpl_node_t ***tail, struct buf_t *lit);
+void tpl_trim(struct tpl_rd_t *rd);
+struct loc_t tpl_pos(struct tpl_rd_t *rd);
+
+struct tpl_node_t *tpl_node_new(enum tpl_e tag, char *str, struct loc_t loc);
+void tpl_node_delete(struct tpl_node_t *node);
+void tpl_sel_delete(struct tpl_sel_t *sel);
+
+struct rt_obj_t tpl_obj(struct tpl_node_t *node, struct rt_ctx_t *ctx, struct env_t *env);
+struct rt_obj_t tpl_sel(struct tpl_sel_t *sel, struct rt_obj_t obj, struct rt_ctx_t *ctx, struct env_t *env);
+
+
+/**
+ * Parse a raw string into a template. Malformed strings are not parsed,
+ * leaving them to the expander to report the error in evaluation order.
+ *   @str: The string.
+ *   @loc: The string location.
+ *   &returns: The template, or null if malformed.
+ */
+struct tpl_t *tpl_new(const char *str, struct loc_t loc)
+{
+	struct tpl_rd_t rd = { str, str, loc };
+
+	return tpl_get(&rd);
+}
+
+/**
+ * Delete a template.
+ *   @tpl: The template.
+ */
+void tpl_delete(struct tpl_t *tpl)
+{
+	struct tpl_node_t *node;
+
+	while(tpl->node != NULL) {
+		tpl->node = (node = tpl->node)->next;
+		tpl_node_delete(node);
+	}
+
+	free(tpl);
+}
+
+
+/**
+ * Parse an expanded value, following `exp_get`.
+ *   @rd: The reader.
+ *   &returns: The template, or null if malformed.
+ */
+struct tpl_t *tpl_get(struct tpl_rd_t *rd)
+{
+	bool ret = true;
+	struct buf_t lit;
+	struct tpl_t *tpl;
+	struct tpl_node_t **tail;
+
+	tpl = malloc(sizeof(struct tpl_t));
+	tpl->obj = tpl->spec = false;
+	tpl->node = NULL;
+	tail = &tpl->node;
+	lit = buf_new(32);
+
+	if(*rd->str == '$') {
+		*tail = tpl_var(rd);
+		if(*tail == NULL)
+			ret = false;
+		else if(*rd->str == '\0')
+			tpl->obj = true;
+		else
+			tail = &(*tail)->next;
+	}
+	else if(*rd->str == '.') {
+		do
+			buf_ch(&lit, *rd->str++);
+		while(ch_var(*rd->str));
+
+		tpl->spec = (*rd->str == '\0');
+	}
+
+	if(ret && !tpl->obj && !tpl->spec)
+		ret = tpl_str(rd, &tail, &lit);
+
+	tpl_flush(&tail, &lit);
+	buf_delete(&lit);
+
+	if(!ret) {
+		tpl_delete(tpl);
+		return NULL;
+	}
+
+	return tpl;
+}
+
+/**
+ * Parse a string, following `exp_str`.
+ *   @rd: The reader.
+ *   @tail: The node list tail reference.
+ *   @lit: The pending literal text.
+ *   &returns: True on success, false if malformed.
+ */
+bool tpl_str(struct tpl_rd_t *rd, struct tpl_node_t ***tail, struct buf_t *lit)
+{
+	char ch;
+
+	for(;;) {
+		ch = *rd->str;
+		if(ch == '\0')
+			break;
+		else if(ch == '\\') {
+			if(!tpl_escape(rd, lit))
+				return false;
+		}
+		else if((ch == '\'') || (ch == '"')) {
+			if(!tpl_quote(rd, tail, lit))
+				return false;
+		}
+		else if(ch == '$') {
+			tpl_flush(tail, lit);
+			if((**tail = tpl_var(rd)) == NULL)
+				return false;
+
+			*tail = &(**tail)->next;
+		}
+		else if(ch_str(ch))
+			buf_ch(lit, *rd->str++);
+		else
+			break;
+	}
+
+	return true;
+}
+
+/**
+ * Parse an escape sequence, following `exp_escape`.
+ *   @rd: The reader.
+ *   @lit: The pending literal text.
+ *   &returns: True on success, false if malformed.
+ */
+bool tpl_escape(struct tpl_rd_t *rd, struct buf_t *lit)
+{
+	char ch;
+
+	switch(*++rd->str) {
+	case '\\': ch = '\\'; break;
+	case '\'': ch = '\''; break;
+	case '\"': ch = '\"'; break;
+	case 't': ch = '\t'; break;
+	case 'n': ch = '\n'; break;
+	case '$': ch = '$'; break;
+	case ' ': ch = ' '; break;
+	case ',': ch = ','; break;
+	default: return false;
+	}
+
+	buf_ch(lit, ch);
+	rd->str++;
+
+	return true;
+}
+
+/**
+ * Parse a single- or double-quoted string, following `exp_quote1` and
+ * `exp_quote2`.
+ *   @rd: The reader.
+ *   @tail: The node list tail reference.
+ *   @lit: The pending literal text.
+ *   &returns: True on success, false if malformed.
+ */
+bool tpl_quote(struct tpl_rd_t *rd, struct tpl_node_t ***tail, struct buf_t *lit)
+{
+	char ch, quote;
+
+	quote = *rd->str++;
+
+	for(;;) {
+		ch = *rd->str;
+		if(ch == quote)
+			break;
+		else if(ch == '\0')
+			return false;
+		else if(ch == '\\') {
+			if(!tpl_escape(rd, lit))
+				return false;
+		}
+		else if((ch == '$') && (quote == '"')) {
+			tpl_flush(tail, lit);
+			if((**tail = tpl_var(rd)) == NULL)
+				return false;
+
+			*tail = &(**tail)->next;
+		}
+		else
+			buf_ch(lit, *rd->str++);
+	}
+
+	rd->str++;
+
+	return true;
+}
+
+/**
+ * Parse a variable expansion, following `exp_var`.
+ *   @rd: The reader.
+ *   &returns: The node, or null if malformed.
+ */
+struct tpl_node_t *tpl_var(struct tpl_rd_t *rd)
+{
+	struct buf_t buf;
+	struct tpl_t *arg;
+	struct tpl_sel_t *sel, **isel;
+	struct tpl_node_t *node;
+
+	if(*++rd->str != '{') {
+		node = tpl_bind(rd, false);
+		if(node != NULL)
+			node->flat = tpl_pos(rd);
+
+		return node;
+	}
+
+	rd->str++;
+	node = tpl_bind(rd, true);
+	if(node == NULL)
+		return NULL;
+
+	isel = &node->sel;
+
+	for(;;) {
+		tpl_trim(rd);
+		if(*rd->str == '}')
+			break;
+		else if(*rd->str != '.')
+			goto fail;
+
+		rd->str++;
+		tpl_trim(rd);
+		if(!ch_var(*rd->str))
+			goto fail;
+
+		buf = buf_new(32);
+		buf_ch(&buf, '.');
+		while(ch_var(*rd->str))
+			buf_ch(&buf, *rd->str++);
+
+		sel = *isel = malloc(sizeof(struct tpl_sel_t));
+		sel->id = buf_done(&buf);
+		sel->hash = env_hash(sel->id);
+		sel->mhash = env_hash(sel->id + 1);
+		sel->after = tpl_pos(rd);
+		sel->arg = NULL;
+		sel->narg = 0;
+		sel->next = NULL;
+		isel = &sel->next;
+
+		tpl_trim(rd);
+		sel->pos = tpl_pos(rd);
+		sel->call = (*rd->str == '(');
+		if(!sel->call)
+			continue;
+
+		rd->str++;
+		tpl_trim(rd);
+
+		if(*rd->str != ')') {
+			for(;;) {
+				if((arg = tpl_get(rd)) == NULL)
+					goto fail;
+
+				sel->arg = realloc(sel->arg, (sel->narg + 1) * sizeof(struct tpl_t *));
+				sel->arg[sel->narg++] = arg;
+
+				tpl_trim(rd);
+				if(*rd->str == ')')
+					break;
+				else if(*rd->str != ',')
+					goto fail;
+
+				rd->str++;
+				tpl_trim(rd);
+			}
+		}
+
+		rd->str++;
+	}
+
+	rd->str++;
+	node->flat = tpl_pos(rd);
+
+	return node;
+
+fail:
+	tpl_node_delete(node);
+	return NULL;
+}
+
+/**
+ * Parse a variable binding, following `exp_bind`.
+ *   @rd: The reader.
+ *   @brace: Set within braces.
+ *   &returns: The node, or null if malformed.
+ */
+struct tpl_node_t *tpl_bind(struct tpl_rd_t *rd, bool brace)
+{
+	const char *id;
+	struct tpl_node_t *node;
+
+	switch(*rd->str) {
+	case '@': node = tpl_node_new(tpl_at_v, NULL, tpl_pos(rd)); break;
+	case '^': node = tpl_node_new(tpl_hat_v, NULL, tpl_pos(rd)); break;
+	case '<': node = tpl_node_new(tpl_lt_v, NULL, tpl_pos(rd)); break;
+	case '*': node = tpl_node_new(tpl_star_v, NULL, tpl_pos(rd)); break;
+
+	default:
+		if(!ch_var(*rd->str))
+			return NULL;
+
+		id = rd->str;
+		while(ch_var(*rd->str))
+			rd->str++;
+
+		node = tpl_node_new(tpl_var_v, strndup(id, rd->str - id), loc_off(rd->loc, id - rd->orig));
+		node->hash = env_hash(node->str);
+		return node;
+	}
+
+	node->brace = brace;
+	rd->str++;
+
+	return node;
+}
+
+/**
+ * Flush pending literal text into a node.
+ *   @tail: The node list tail reference.
+ *   @lit: The pending literal text.
+ */
+void tpl_flush(struct tpl_node_t ***tail, struct buf_t *lit)
+{
+	if(lit->len == 0)
+		return;
+
+	**tail = tpl_node_new(tpl_chars_v, strndup(lit->str, lit->len), (struct loc_t){ });
+	*tail = &(**tail)->next;
+	lit->len = 0;
+}
+
+/**
+ * Trim whitespace from the reader, following `exp_trim`.
+ *   @rd: The reader.
+ */
+void tpl_trim(struct tpl_rd_t *rd)
+{
+	while((*rd->str == ' ') || (*rd->str == '\t') || (*rd->str == '\n'))
+		rd->str++;
+}
+
+/**
+ * Retrieve the location of the reader position.
+ *   @rd: The reader.
+ *   &returns: The location.
+ */
+struct loc_t tpl_pos(struct tpl_rd_t *rd)
+{
+	return loc_off(rd->loc, rd->str - rd->orig);
+}
+
+
+/**
+ * Create a template node.
+ *   @tag: The tag.
+ *   @str: Consumed. Optional. The literal text or identifier.
+ *   @loc: The location.
+ *   &returns: The node.
+ */
+struct tpl_node_t *tpl_node_new(enum tpl_e tag, char *str, struct loc_t loc)
+{
+	struct tpl_node_t *node;
+
+	node = malloc(sizeof(struct tpl_node_t));
+	node->tag = tag;
+	node->str = str;
+	node->hash = 0;
+	node->brace = false;
+	node->loc = node->flat = loc;
+	node->sel = NULL;
+	node->next = NULL;
+
+	return node;
+}
+
+/**
+ * Delete a template node.
+ *   @node: The node.
+ */
+void tpl_node_delete(struct tpl_node_t *node)
+{
+	struct tpl_sel_t *sel;
+
+	while(node->sel != NULL) {
+		node->sel = (sel = node->sel)->next;
+		tpl_sel_delete(sel);
+	}
+
+	free(node->str);
+	free(node);
+}
+
+/**
+ * Delete a template selector.
+ *   @sel: The selector.
+ */
+void tpl_sel_delete(struct tpl_sel_t *sel)
+{
+	uint32_t i;
+
+	for(i = 0; i < sel->narg; i++)
+		tpl_delete(sel->arg[i]);
+
+	free(sel->arg);
+	free(sel->id);
+	free(sel);
+}
+
+
+/**
+ * Evaluate a template.
+ *   @tpl: The template.
+ *   @ctx: The context.
+ *   @env: The environment.
+ *   &returns: The object.
+ */
+struct rt_obj_t tpl_eval(struct tpl_t *tpl, struct rt_ctx_t *ctx, struct env_t *env)
+{
+	struct buf_t buf;
+	struct rt_obj_t obj;
+	struct tpl_node_t *node;
+
+	if(tpl->obj)
+		return tpl_obj(tpl->node, ctx, env);
+	else if(tpl->node == NULL)
+		return rt_obj_val(val_new(false, strdup("")));
+	else if((tpl->node->next == NULL) && (tpl->node->tag == tpl_chars_v))
+		return rt_obj_val(val_new(tpl->spec, strdup(tpl->node->str)));
+
+	buf = buf_new(32);
+
+	for(node = tpl->node; node != NULL; node = node->next) {
+		uint32_t i;
+		struct val_t *val;
+
+		if(node->tag == tpl_chars_v) {
+			buf_str(&buf, node->str);
+			continue;
+		}
+
+		obj = tpl_obj(node, ctx, env);
+		if(obj.tag != rt_val_v)
+			loc_err(node->flat, "Cannot convert non-value to a string.");
+
+		val = obj.data.val;
+		for(i = 0; i < val_len(val); i++) {
+			if(i > 0)
+				buf_ch(&buf, ' ');
+
+			buf_str(&buf, val_get(val, i));
+		}
+
+		val_clear(val);
+	}
+
+	return rt_obj_val(val_new(false, buf_done(&buf)));
+}
+
+/**
+ * Evaluate a template expansion to its object, following `exp_var`.
+ *   @node: The expansion node.
+ *   @ctx: The context.
+ *   @env: The environment.
+ *   &returns: The object.
+ */
+struct rt_obj_t tpl_obj(struct tpl_node_t *node, struct rt_ctx_t *ctx, struct env_t *env)
+{
+	struct bind_t *bind;
+	struct rt_obj_t obj;
+	struct tpl_sel_t *sel;
+	struct target_inst_t *inst;
+	struct val_t *val = NULL;
+
+	switch(node->tag) {
+	case tpl_var_v:
+		bind = env_find(env, node->str, node->hash);
+		if(bind == NULL)
+			loc_err(node->loc, "Unknown variable '%s'.", node->str);
+
+		obj = rt_obj_dup(bind->obj);
+		break;
+
+	case tpl_at_v:
+	case tpl_hat_v:
+		if(ctx->cur == NULL)
+			loc_err(node->loc, "Variable '$%c' can only be used in recipes.", (node->tag == tpl_at_v) ? '@' : '^');
+
+		inst = (node->tag == tpl_at_v) ? ctx->cur->gens->inst : ctx->cur->deps->inst;
+		for(; inst != NULL; inst = inst->next) {
+			val_add_ref(&val, false, inst->target->name);
+		}
+
+		obj = rt_obj_val(val);
+		break;
+
+	case tpl_lt_v:
+		if(ctx->cur == NULL)
+			loc_err(node->loc, "Variable '$<' can only be used in recipes.");
+
+		inst = ctx->cur->deps->inst;
+		if(inst == NULL)
+			loc_err(node->loc, node->brace ? "Expected '.' or '}'." : "Cannot convert non-value to a string.");
+
+		obj = rt_obj_val(val_ref(inst->target->flags & FLAG_SPEC, inst->target->name));
+		break;
+
+	case tpl_star_v: {
+		struct rule_inst_t *rinst;
+
+		for(rinst = ctx->rules->inst; rinst != NULL; rinst = rinst->next) {
+			for(inst = rinst->rule->gens->inst; inst != NULL; inst = inst->next) {
+				if(inst->target->flags & FLAG_SPEC)
+					continue;
+
+				val_add_ref(&val, false, inst->target->name);
+			}
+		}
+
+		obj = rt_obj_val(val);
+	} break;
+
+	default:
+		unreachable();
+	}
+
+	for(sel = node->sel; sel != NULL; sel = sel->next)
+		obj = tpl_sel(sel, obj, ctx, env);
+
+	return obj;
+}
+
+/**
+ * Apply a selector to an object.
+ *   @sel: The selector.
+ *   @obj: Consumed. The object.
+ *   @ctx: The context.
+ *   @env: The environment.
+ *   &returns: The selected object.
+ */
+struct rt_obj_t tpl_sel(struct tpl_sel_t *sel, struct rt_obj_t obj, struct rt_ctx_t *ctx, struct env_t *env)
+{
+	uint32_t i, cnt;
+	struct bind_t *bind;
+	struct rt_obj_t ret, *args;
+
+	switch(obj.tag) {
+	case rt_null_v:
+		fatal("FIXME exp_var null call");
+
+	case rt_val_v:
+		bind = env_find(env, sel->id, sel->hash);
+		if(bind == NULL)
+			loc_err(sel->after, "Unknown function '%s'.", sel->id);
+		else if(bind->obj.tag != rt_func_v)
+			loc_err(sel->after, "Variable '%s' is not a function.", sel->id);
+		else if(!sel->call)
+			loc_err(sel->pos, "Expected '('.");
+
+		cnt = sel->narg + 1;
+		args = malloc(cnt * sizeof(struct rt_obj_t));
+		args[0] = obj;
+		for(i = 0; i < sel->narg; i++)
+			args[i + 1] = tpl_eval(sel->arg[i], ctx, env);
+
+		ret = bind->obj.data.func(args, cnt, sel->after);
+		args_delete(args, cnt);
+
+		return ret;
+
+	case rt_env_v:
+		bind = env_find(obj.data.env, sel->id + 1, sel->mhash);
+		if(bind == NULL)
+			loc_err(sel->after, "Unknown member '%s'.", sel->id + 1);
+		else if(sel->call)
+			loc_err(sel->pos, "Expected '.' or '}'.");
+
+		ret = rt_obj_dup(bind->obj);
+		rt_obj_delete(obj);
+
+		return ret;
+
+	case rt_func_v:
+		fatal("FIXME exp_var func call");
+	}
+
+	unreachable();
+}
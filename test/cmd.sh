@@ -0,0 +1,49 @@
+#!/bin/sh
+# Check that a rule is rebuilt when its expanded commands change, when the
+# last run of its commands failed even though its target was written, and when
+# the build log has no record of it.
+#   usage: test/cmd.sh [hammer]
+
+set -e
+
+ham=$(cd "$(dirname "${1:-./hammer}")" && pwd)/$(basename "${1:-./hammer}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir"
+
+fail() {
+	echo "cmd: $1" >&2
+	exit 1
+}
+
+echo in > in.txt
+cat > Hammer <<'EOF'
+mode = bad;
+out.txt : in.txt { sh -c "echo $mode > out.txt; test $mode = good"; }
+EOF
+
+"$ham" out.txt > /dev/null 2>&1 && fail "failing command succeeded"
+test "$(cat out.txt)" = bad || fail "failing command did not write its target"
+
+"$ham" out.txt > /dev/null 2>&1 && fail "failed rule was not rerun"
+
+sed 's/bad/good/' Hammer > Hammer.tmp && mv Hammer.tmp Hammer
+"$ham" out.txt > /dev/null || fail "changed command failed"
+test "$(cat out.txt)" = good || fail "changed command was not run"
+
+echo unchanged > out.txt
+"$ham" out.txt > /dev/null || fail "up-to-date build failed"
+test "$(cat out.txt)" = unchanged || fail "up-to-date rule was rerun"
+
+rm .hammer.log
+sed 's/> out.txt;/> out.txt; echo again > out.txt;/' Hammer > Hammer.tmp && mv Hammer.tmp Hammer
+"$ham" out.txt > /dev/null || fail "unrecorded build failed"
+test "$(cat out.txt)" = again || fail "unrecorded rule was not rerun"
+
+"$ham" out.txt > /dev/null || fail "recorded build failed"
+echo unchanged > out.txt
+"$ham" out.txt > /dev/null || fail "recorded up-to-date build failed"
+test "$(cat out.txt)" = unchanged || fail "recorded rule was rerun"
+
+echo "cmd: ok"
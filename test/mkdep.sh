@@ -0,0 +1,79 @@
+#!/bin/sh
+# Check that makedep files add their dependencies to the rules that use them,
+# both when the file is written by the rule it belongs to and when it has a
+# generating rule of its own, and that cached makedep files are read again
+# once they change.
+#   usage: test/mkdep.sh [hammer]
+
+set -e
+
+ham=$(cd "$(dirname "${1:-./hammer}")" && pwd)/$(basename "${1:-./hammer}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir"
+
+fail() {
+	echo "mkdep: $1" >&2
+	exit 1
+}
+
+check() {
+	echo one > h.h
+	echo src > x.c
+	rm -f .hammer.* x.o x.d
+
+	"$ham" .all $1 > /dev/null || fail "$2: initial build failed"
+	test "$(cat x.o)" = "$(printf 'src\none')" || fail "$2: initial build is wrong"
+
+	echo two > h.h
+	touch -d '+1 second' h.h
+	"$ham" .all > /dev/null || fail "$2: rebuild failed"
+	test "$(cat x.o)" = "$(printf 'src\ntwo')" || fail "$2: header change did not rebuild"
+}
+
+cat > Hammer <<'EOF'
+.all : x.o;
+x.o : x.c { cat x.c h.h > x.o; echo "x.o: x.c h.h" > x.d; }
+makedep x.d;
+EOF
+check "" "owned by stem"
+
+cat > Hammer <<'EOF'
+.all : x.o;
+x.d : x.c { echo "x.o: x.c h.h" > x.d; }
+x.o : x.c { cat x.c h.h > x.o; }
+makedep x.d;
+EOF
+check x.d "generated separately"
+
+rm -f .hammer.* x.o x.d
+echo src > x.c
+echo one > h.h
+echo "x.o: x.c h.h" > x.d
+touch -d '-1 minute' x.c h.h x.d
+cat > Hammer <<'EOF'
+.all : x.o;
+x.o : x.c { cat x.c > x.o; echo run >> runs.txt; }
+makedep x.d;
+EOF
+
+"$ham" .all > /dev/null || fail "cached: initial build failed"
+"$ham" .all > /dev/null || fail "cached: first no-op failed"
+grep -q h.h .hammer.graph || fail "cached: makedep file was not cached"
+"$ham" .all > /dev/null || fail "cached: second no-op failed"
+test "$(wc -l < runs.txt)" -eq 1 || fail "cached: no-op rebuilt"
+
+touch -d '-30 seconds' x.o
+touch -d '-10 seconds' h.h
+"$ham" .all > /dev/null || fail "cached: rebuild failed"
+test "$(wc -l < runs.txt)" -eq 2 || fail "cached: header change did not rebuild"
+
+echo "x.o: x.c new.h" > x.d
+touch -d '-1 minute' x.d
+echo new > new.h
+touch -d '+1 second' new.h
+"$ham" .all > /dev/null || fail "cached: changed makedep build failed"
+test "$(wc -l < runs.txt)" -eq 3 || fail "cached: changed makedep file was not read"
+
+echo "mkdep: ok"
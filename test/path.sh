@@ -0,0 +1,35 @@
+#!/bin/sh
+# Check that targets are looked up by their canonical path while recipe
+# variables expand to the path as written, so `./gen.sh` still runs the local
+# script instead of searching PATH.
+#   usage: test/path.sh [hammer]
+
+set -e
+
+ham=$(cd "$(dirname "${1:-./hammer}")" && pwd)/$(basename "${1:-./hammer}")
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cd "$dir"
+
+fail() {
+	echo "path: $1" >&2
+	exit 1
+}
+
+printf '#!/bin/sh\necho generated\n' > gen.sh
+chmod +x gen.sh
+
+cat > Hammer <<'EOF'
+./out.txt : ./gen.sh { $< > $@; }
+all.txt : out.txt ./gen.sh { cat $^ > $@; }
+EOF
+
+"$ham" out.txt > /dev/null || fail "script dependency failed"
+test "$(cat out.txt)" = generated || fail "script output is wrong"
+
+rm -f out.txt
+"$ham" ./all.txt > /dev/null || fail "cached build failed"
+test "$(head -n 1 all.txt)" = generated || fail "canonical lookup is wrong"
+
+echo "path: ok"
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Check that a build server runs commands with the environment of the client
+# that requested the build.
+#   usage: test/serve.sh [hammer]
+
+set -e
+
+ham=$(cd "$(dirname "${1:-./hammer}")" && pwd)/$(basename "${1:-./hammer}")
+dir=$(mktemp -d)
+trap 'kill $pid 2> /dev/null; rm -rf "$dir"' EXIT
+
+cd "$dir"
+
+fail() {
+	echo "serve: $1" >&2
+	exit 1
+}
+
+printf '#!/bin/sh\necho "$MODE" > out.txt\n' > env.sh
+chmod +x env.sh
+echo 'out.txt : { ./env.sh; }' > Hammer
+
+MODE=server "$ham" --server > /dev/null &
+pid=$!
+
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	test -S .hammer.sock && break
+	sleep 0.2
+done
+
+test -S .hammer.sock || fail "server did not start"
+
+MODE=client "$ham" out.txt > /dev/null || fail "client build failed"
+test "$(cat out.txt)" = client || fail "command did not get the client environment"
+
+echo "serve: ok"